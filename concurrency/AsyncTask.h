@@ -13,51 +13,95 @@
 #include <xtra_rhel.h>
 
 // 本来想直接使用future来做的，但是现有生产环境太旧，std::future
-// 和boost::future都不可用，这里模拟一个任务结构，采用one-task-per-thread的方式，
-// 进行弹性的任务创建执行。
+// 和boost::future都不可用，这里模拟一个任务结构。
+//
+// 早期的实现是one-task-per-thread，每批任务都创建线程然后join_all，一个慢任务会
+// 拖住整批任务，线程创建的开销也在关键路径上。现在改为固定的常驻工作线程，
+// 并发度由信号量控制，某个任务完成释放许可之后，下一个任务立即可以开始执行。
 
 #include <memory>
 #include <functional>
+#include <atomic>
+#include <system_error>
 
 #include <other/Log.h>
 #include <system/ConstructException.h>
+#include <concurrency/Semaphore.h>
 #include <concurrency/ThreadMng.h>
+#include <concurrency/Future.h>
 #include <container/EQueue.h>
+#include <container/MpmcQueue.h>
 
 namespace roo {
 
-// 简单对ThreadMng的封装，用于一个任务一个task，不过带了一个
-// EQueue缓冲任务
-class AsyncTask {
+// max_spawn个常驻线程，带了一个EQueue缓冲任务，
+// 缓冲队列可以通过模板参数切换为MpmcQueue
+template<typename Queue = EQueue<TaskRunnable> >
+class BasicAsyncTask {
 
     // 禁止拷贝
-    AsyncTask(const AsyncTask&) = delete;
-    AsyncTask& operator=(const AsyncTask&) = delete;
+    BasicAsyncTask(const BasicAsyncTask&) = delete;
+    BasicAsyncTask& operator=(const BasicAsyncTask&) = delete;
 
 public:
 
-    explicit AsyncTask(uint8_t max_spawn) :
+    explicit BasicAsyncTask(uint8_t max_spawn) :
         max_spawn_(max_spawn),
-        thread_run_(),
+        threads_(),
         thread_terminate_(false),
-        thread_mng_(max_spawn_),
+        lock_(),
+        slots_(max_spawn),
         tasks_() {
 
-        thread_run_.reset(new std::thread(std::bind(&AsyncTask::run, this)));
-        if (!thread_run_) {
-            log_err("create run work thread failed! ");
-            throw ConstructException("AsyncTask Thread Create Fail");
+        if (max_spawn_ == 0) {
+            log_err("AsyncTask at least should have 1 thread.");
+            max_spawn_ = 1;
+            slots_.adjust(1);
         }
+
+        threads_.reserve(max_spawn_);
+        for (size_t i = 0; i < max_spawn_; ++i) {
+
+            std::thread* thd = NULL;
+            try {
+                thd = new std::thread(std::bind(&BasicAsyncTask::run, this));
+            } catch (const std::system_error& e) {
+                log_err("create AsyncTask thread failed: %s", e.what());
+                thd = NULL;
+            }
+
+            if (!thd) {
+
+                // 清理已经创建的线程
+                terminate();
+                throw ConstructException("AsyncTask Thread Create Fail");
+            }
+
+            threads_.push_back(thd);
+        }
+
+        log_warning("totally created %u threads for AsyncTask successfully!", max_spawn_);
     }
 
     void terminate() {
 
         thread_terminate_ = true;
-        if (thread_run_ && thread_run_->joinable())
-            thread_run_->join();
+
+        // 每个线程投递一个空任务，唤醒阻塞在POP上的线程
+        for (size_t j = 0; j < threads_.size(); ++j) {
+            tasks_.PUSH(TaskRunnable());
+        }
+
+        for (size_t j = 0; j < threads_.size(); ++j) {
+            if (threads_[j] && threads_[j]->joinable())
+                threads_[j]->join();
+            delete threads_[j];
+        }
+
+        threads_.clear();
     }
 
-    ~AsyncTask() {
+    ~BasicAsyncTask() {
         terminate();
         log_warning("AsyncTask destroy successfully.");
     }
@@ -66,6 +110,39 @@ public:
         tasks_.PUSH(func);
     }
 
+    void add_async_task(TaskRunnable&& func) {
+        tasks_.PUSH(std::move(func));
+    }
+
+    // 提交任务并通过Future获取结果，任务抛出的异常会在Future::get()时重新抛出
+    template<typename F, typename... Args>
+    Future<typename TaskResult<F, Args...>::type> submit(F&& func, Args&&... args) {
+        TaskRunnable task;
+        auto future = package_task(task, std::forward<F>(func), std::forward<Args>(args)...);
+        add_async_task(std::move(task));
+        return future;
+    }
+
+    // 运行时调整并发度，范围[1, 线程数]
+    // 调小时正在执行的任务不受影响，完成之后才会生效
+    void set_max_spawn(uint32_t max_spawn) {
+
+        std::lock_guard<std::mutex> lock(lock_);
+
+        if (max_spawn == 0)
+            max_spawn = 1;
+        if (max_spawn > threads_.size())
+            max_spawn = static_cast<uint32_t>(threads_.size());
+
+        slots_.adjust(static_cast<int>(max_spawn) - static_cast<int>(max_spawn_));
+        log_warning("AsyncTask update max_spawn from %u to %u", max_spawn_, max_spawn);
+        max_spawn_ = max_spawn;
+    }
+
+    uint32_t get_max_spawn() {
+        std::lock_guard<std::mutex> lock(lock_);
+        return max_spawn_;
+    }
 
 private:
 
@@ -75,39 +152,41 @@ private:
 
         while (true) {
 
+            TaskRunnable task = tasks_.POP();
+
             if (thread_terminate_) {
                 log_warning("AsyncTask thread %#lx about to terminate ...", (long)pthread_self());
                 break;
             }
 
-            std::vector<TaskRunnable> tasks{};
-            size_t count = tasks_.POP(tasks, max_spawn_, 1000 /*1s*/);
-            if (!count) {  // 空闲
+            if (!task) {
                 continue;
             }
 
-            for (size_t i = 0; i < tasks.size(); ++i) {
-                thread_mng_.add_task(tasks[i]);
-            }
+            slots_.acquire();
+            int code = task();
+            slots_.release();
 
-            thread_mng_.join_all();
-            log_warning("count %d task process done!", static_cast<int>(tasks.size()));
+            if (code != 0)
+                log_err("AsyncTask run code %d.", code);
         }
     }
 
 private:
 
     uint32_t max_spawn_;
-    std::unique_ptr<std::thread> thread_run_;
-    bool thread_terminate_;
+    std::vector<std::thread*> threads_;
+    std::atomic<bool> thread_terminate_;
 
-    // 封装线程管理细节
-    ThreadMng thread_mng_;
+    // 并发度控制
+    std::mutex lock_;
+    Semaphore slots_;
 
     // 待单独执行的任务列表
-    EQueue<TaskRunnable> tasks_;
+    Queue tasks_;
 };
 
+typedef BasicAsyncTask<> AsyncTask;
 
 } // roo
 
@@ -16,116 +16,68 @@
 #include <functional>
 
 #include <other/Log.h>
-#include <system/ConstructException.h>
 #include <container/EQueue.h>
+#include <container/MpmcQueue.h>
+#include <concurrency/WorkStealingPool.h>
 
-// 相比AsyncTask，这里采用固定线程池执行EQueue任务的方式
+// 相比AsyncTask，这里采用固定线程池执行任务的方式，底层为WorkStealingPool，
+// 任务中再提交的任务会进入当前线程的本地队列，空闲线程之间互相窃取。
+// 外部提交的注入队列可以通过模板参数切换，例如高并发提交的场景可以使用
+// BasicDeferTask<MpmcQueue<TaskRunnable>> 避免所有生产者争用同一把锁
 
 namespace roo {
 
-// 可执行任务类型
-typedef std::function<int()> TaskRunnable;
-
-
-class DeferTask {
+template<typename Queue = EQueue<TaskRunnable> >
+class BasicDeferTask {
 
     // 禁止拷贝
-    DeferTask(const DeferTask&) = delete;
-    DeferTask& operator=(const DeferTask&) = delete;
+    BasicDeferTask(const BasicDeferTask&) = delete;
+    BasicDeferTask& operator=(const BasicDeferTask&) = delete;
 
 public:
 
-    explicit DeferTask(uint8_t thread_num = 1) :
-        threads_(),
-        thread_terminate_(false),
-        tasks_() {
-
-        if (thread_num == 0) {
-            log_err("DeferTask at least should have 1 thread.");
-            thread_num = 1;
-        }
-
-        threads_.reserve(thread_num);
-        for (int i = 0; i < thread_num; ++i) {
-
-            std::thread* thd = new std::thread(std::bind(&DeferTask::thread_run,  this));
-            if (!thd) {
-                log_err("create DeferTask thread failed.");
-
-                // 清理已经创建的线程
-                thread_terminate_ = true;
-                for (size_t j = 0; j < threads_.size(); ++j) {
-                    if (threads_[j] && threads_[j]->joinable())
-                        threads_[j]->join();
-                    delete threads_[j];
-                }
-
-                // 抛出异常
-                throw ConstructException("DeferTask Thread Create Fail");
-            }
-
-            threads_.push_back(thd);
-        }
-
-        log_warning("totally created %u threads for DeferTask successfully!", thread_num);
+    explicit BasicDeferTask(uint8_t thread_num = 1) :
+        pool_(thread_num) {
     }
 
     void terminate() {
-
-        // flag to terminate
-        thread_terminate_ = true;
-
-        // join all threads
-        for (size_t j = 0; j < threads_.size(); ++j) {
-            if (threads_[j] && threads_[j]->joinable())
-                threads_[j]->join();
-            delete threads_[j];
-        }
-
-        threads_.clear();
+        pool_.terminate();
         log_warning("terminate DeferTask finished.");
     }
 
-    ~DeferTask() {
+    ~BasicDeferTask() {
         terminate();
         log_warning("DeferTask destroy successfully.");
     }
 
     // 增加需要执行的任务
     void add_defer_task(const TaskRunnable& func) {
-        tasks_.PUSH(func);
+        pool_.add_task(func);
     }
 
-private:
-
-    void thread_run() {
-
-        log_warning("DeferTask thread %#lx begin to run ...", (long)pthread_self());
-
-        while (true) {
+    void add_defer_task(TaskRunnable&& func) {
+        pool_.add_task(std::move(func));
+    }
 
-            if (thread_terminate_) {
-                log_warning("log_warning thread %#lx about to terminate ...", (long)pthread_self());
-                break;
-            }
+    template<typename F, typename... Args>
+    Future<typename TaskResult<F, Args...>::type> submit(F&& func, Args&&... args) {
+        return pool_.submit(std::forward<F>(func), std::forward<Args>(args)...);
+    }
 
-            TaskRunnable task = tasks_.POP();
+    bool is_terminating() const {
+        return pool_.is_terminating();
+    }
 
-            int code = task();
-            if (code != 0)
-                log_err("DeferTask run code %d.", code);
-        }
+    WorkStealingPool<Queue>& pool() {
+        return pool_;
     }
 
 private:
 
-    std::vector<std::thread*> threads_;
-    bool thread_terminate_;
-
-    // 待单独执行的任务列表
-    EQueue<TaskRunnable> tasks_;
+    WorkStealingPool<Queue> pool_;
 };
 
+typedef BasicDeferTask<> DeferTask;
 
 } // roo
 
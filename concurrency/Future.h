@@ -0,0 +1,645 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+
+#ifndef __ROO_CONCURRENCY_FUTURE_H__
+#define __ROO_CONCURRENCY_FUTURE_H__
+
+// 生产环境中std::future和boost::future都不可用，这里实现一个简化版本的
+// Future/Promise，用于获取异步任务的执行结果
+//
+// 1. then()注册的后续任务，在Promise被设置的线程中直接执行(通常就是完成任务的
+//    工作线程)，如果注册的时候已经完成了，就在注册者线程中立即执行
+// 2. then()的后续任务如果返回Future<U>，结果会自动展开为Future<U>，方便串联异步调用
+// 3. 任务抛出的异常会被捕获并沿着then()链条传递，在get()的时候重新抛出
+// 4. 所有的Promise副本都销毁了还没有设置结果(比如任务在线程池终止时被丢弃)，
+//    Future会以broken promise异常完成，等待者不会永久阻塞
+//
+// Future可以被多次get()，返回结果的拷贝
+
+#include <vector>
+#include <tuple>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <boost/optional.hpp>
+
+#include <concurrency/ThreadMng.h>
+
+namespace roo {
+
+template<typename T> class Future;
+template<typename T> class Promise;
+
+// Future<void>内部的占位类型
+struct Unit { };
+
+namespace future_detail {
+
+template<typename T>
+struct Storage {
+    typedef T type;
+};
+
+template<>
+struct Storage<void> {
+    typedef Unit type;
+};
+
+template<typename T>
+class State {
+
+    // 禁止拷贝
+    State(const State&) = delete;
+    State& operator=(const State&) = delete;
+
+public:
+    typedef typename Storage<T>::type value_type;
+    typedef std::function<void()> Callback;
+
+    State() :
+        lock_(),
+        notify_(),
+        ready_(false),
+        value_(),
+        error_(),
+        callbacks_() {
+    }
+
+    template<typename U>
+    bool set_value(U&& value) {
+        std::vector<Callback> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (ready_)
+                return false;
+
+            value_ = value_type(std::forward<U>(value));
+            ready_ = true;
+            callbacks.swap(callbacks_);
+        }
+
+        notify_.notify_all();
+        for (size_t i = 0; i < callbacks.size(); ++i) {
+            callbacks[i]();
+        }
+        return true;
+    }
+
+    bool set_exception(std::exception_ptr error) {
+        std::vector<Callback> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (ready_)
+                return false;
+
+            error_ = error;
+            ready_ = true;
+            callbacks.swap(callbacks_);
+        }
+
+        notify_.notify_all();
+        for (size_t i = 0; i < callbacks.size(); ++i) {
+            callbacks[i]();
+        }
+        return true;
+    }
+
+    // 已经完成的话在当前线程直接执行
+    void add_callback(Callback callback) {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (!ready_) {
+                callbacks_.push_back(std::move(callback));
+                return;
+            }
+        }
+
+        callback();
+    }
+
+    bool is_ready() {
+        std::lock_guard<std::mutex> lock(lock_);
+        return ready_;
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(lock_);
+        while (!ready_) {
+            notify_.wait(lock);
+        }
+    }
+
+    bool wait_for(uint64_t msec) {
+        std::unique_lock<std::mutex> lock(lock_);
+
+        auto expire_tp = std::chrono::steady_clock::now() + std::chrono::milliseconds(msec);
+        while (!ready_) {
+            if (notify_.wait_until(lock, expire_tp) == std::cv_status::timeout) {
+                break;
+            }
+        }
+        return ready_;
+    }
+
+    // 完成之后value_和error_不再改变，wait()之后可以不持锁访问
+    const value_type& value() {
+        wait();
+        if (error_)
+            std::rethrow_exception(error_);
+        return *value_;
+    }
+
+    std::exception_ptr error() {
+        wait();
+        return error_;
+    }
+
+private:
+    std::mutex lock_;
+    std::condition_variable notify_;
+
+    bool ready_;
+    boost::optional<value_type> value_;
+    std::exception_ptr error_;
+
+    std::vector<Callback> callbacks_;
+};
+
+template<typename R>
+struct Unwrap {
+    typedef R type;
+};
+
+template<typename R>
+struct Unwrap<Future<R> > {
+    typedef R type;
+};
+
+// 执行func并将结果或者异常写入promise
+template<typename R>
+struct Setter {
+
+    template<typename F, typename... Args>
+    static void call(const Promise<R>& promise, F& func, Args&&... args) {
+        try {
+            promise.set_value(func(std::forward<Args>(args)...));
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }
+
+    static void forward(const Promise<R>& promise, const Future<R>& future) {
+        if (future.has_exception()) {
+            promise.set_exception(future.exception());
+        } else {
+            promise.set_value(future.get());
+        }
+    }
+};
+
+// 模板化promise以延迟到Promise<void>/Future<void>完整定义之后再实例化
+template<>
+struct Setter<void> {
+
+    template<typename P, typename F, typename... Args>
+    static void call(const P& promise, F& func, Args&&... args) {
+        try {
+            func(std::forward<Args>(args)...);
+            promise.set_value();
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }
+
+    template<typename P, typename FT>
+    static void forward(const P& promise, const FT& future) {
+        if (future.has_exception()) {
+            promise.set_exception(future.exception());
+        } else {
+            promise.set_value();
+        }
+    }
+};
+
+// 返回Future<R>的时候，等待其完成之后再转发结果
+template<typename R>
+struct Setter<Future<R> > {
+
+    template<typename F, typename... Args>
+    static void call(const Promise<R>& promise, F& func, Args&&... args) {
+        try {
+            Future<R> inner = func(std::forward<Args>(args)...);
+            inner.on_complete([promise](const Future<R>& done) {
+                Setter<R>::forward(promise, done);
+            });
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }
+};
+
+template<typename F, typename T>
+struct ThenTraits {
+    typedef typename std::result_of<F&(const T&)>::type raw_type;
+    typedef typename Unwrap<raw_type>::type value_type;
+
+    static void call(const Promise<value_type>& promise, F& func, const Future<T>& src) {
+        Setter<raw_type>::call(promise, func, src.get());
+    }
+};
+
+template<typename F>
+struct ThenTraits<F, void> {
+    typedef typename std::result_of<F&()>::type raw_type;
+    typedef typename Unwrap<raw_type>::type value_type;
+
+    static void call(const Promise<value_type>& promise, F& func, const Future<void>& src) {
+        Setter<raw_type>::call(promise, func);
+    }
+};
+
+template<size_t... Is>
+struct IndexSeq { };
+
+template<size_t N, size_t... Is>
+struct MakeIndexSeq : MakeIndexSeq<N - 1, N - 1, Is...> { };
+
+template<size_t... Is>
+struct MakeIndexSeq<0, Is...> {
+    typedef IndexSeq<Is...> type;
+};
+
+} // future_detail
+
+
+template<typename T>
+class Future {
+
+    template<typename U> friend class Promise;
+
+public:
+    typedef T value_type;
+
+    Future() :
+        state_() {
+    }
+
+    bool valid() const {
+        return !!state_;
+    }
+
+    bool is_ready() const {
+        return state_->is_ready();
+    }
+
+    void wait() const {
+        state_->wait();
+    }
+
+    // 超时返回false
+    bool wait_for(uint64_t msec) const {
+        return state_->wait_for(msec);
+    }
+
+    // 阻塞直到完成，任务失败的话重新抛出其异常
+    T get() const {
+        return Getter<T>::get(*state_);
+    }
+
+    bool has_exception() const {
+        return !!state_->error();
+    }
+
+    std::exception_ptr exception() const {
+        return state_->error();
+    }
+
+    // 完成(包括失败)之后调用func(const Future<T>&)
+    template<typename F>
+    void on_complete(F&& func) const {
+        Future<T> self(*this);
+        typename std::decay<F>::type callback(std::forward<F>(func));
+        state_->add_callback([self, callback]() mutable {
+            callback(self);
+        });
+    }
+
+    // 成功之后调用func(const T&)或者func()，失败的话直接传递异常
+    template<typename F>
+    Future<typename future_detail::ThenTraits<typename std::decay<F>::type, T>::value_type>
+    then(F&& func) const {
+
+        typedef typename std::decay<F>::type Func;
+        typedef future_detail::ThenTraits<Func, T> Traits;
+
+        Promise<typename Traits::value_type> promise;
+        Func continuation(std::forward<F>(func));
+        on_complete([promise, continuation](const Future<T>& src) mutable {
+            if (src.has_exception()) {
+                promise.set_exception(src.exception());
+                return;
+            }
+            Traits::call(promise, continuation, src);
+        });
+
+        return promise.get_future();
+    }
+
+private:
+
+    explicit Future(const std::shared_ptr<future_detail::State<T> >& state) :
+        state_(state) {
+    }
+
+    template<typename U, typename Dummy = void>
+    struct Getter {
+        static U get(future_detail::State<U>& state) {
+            return state.value();
+        }
+    };
+
+    template<typename Dummy>
+    struct Getter<void, Dummy> {
+        static void get(future_detail::State<void>& state) {
+            state.value();
+        }
+    };
+
+    std::shared_ptr<future_detail::State<T> > state_;
+};
+
+
+template<typename T>
+class Promise {
+
+public:
+
+    Promise() :
+        core_(std::make_shared<Core>()) {
+    }
+
+    Future<T> get_future() const {
+        return Future<T>(core_->state_);
+    }
+
+    // 只有第一次设置有效，之后的设置返回false
+    template<typename U>
+    bool set_value(U&& value) const {
+        return core_->state_->set_value(std::forward<U>(value));
+    }
+
+    // Promise<void>使用
+    bool set_value() const {
+        return core_->state_->set_value(Unit());
+    }
+
+    bool set_exception(std::exception_ptr error) const {
+        return core_->state_->set_exception(error);
+    }
+
+private:
+
+    // 被所有Promise副本共享，最后一个副本销毁时检查是否已经设置了结果
+    struct Core {
+        Core() :
+            state_(std::make_shared<future_detail::State<T> >()) {
+        }
+
+        ~Core() {
+            if (!state_->is_ready())
+                state_->set_exception(std::make_exception_ptr(std::runtime_error("roo::Promise broken promise")));
+        }
+
+        std::shared_ptr<future_detail::State<T> > state_;
+    };
+
+    std::shared_ptr<Core> core_;
+};
+
+
+// 所有的Future都成功之后，按照原来的顺序返回结果；任何一个失败则以该异常完成
+template<typename T>
+Future<std::vector<T> > when_all(const std::vector<Future<T> >& futures) {
+
+    struct Context {
+        std::mutex lock_;
+        std::vector<boost::optional<T> > values_;
+        size_t pending_;
+        Promise<std::vector<T> > promise_;
+    };
+
+    std::shared_ptr<Context> ctx = std::make_shared<Context>();
+    ctx->values_.resize(futures.size());
+    ctx->pending_ = futures.size();
+
+    Future<std::vector<T> > result = ctx->promise_.get_future();
+    if (futures.empty()) {
+        ctx->promise_.set_value(std::vector<T>());
+        return result;
+    }
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].on_complete([ctx, i](const Future<T>& done) {
+            if (done.has_exception()) {
+                ctx->promise_.set_exception(done.exception());
+                return;
+            }
+
+            bool finished = false;
+            {
+                std::lock_guard<std::mutex> lock(ctx->lock_);
+                ctx->values_[i] = done.get();
+                finished = (--ctx->pending_ == 0);
+            }
+
+            if (finished) {
+                std::vector<T> values;
+                values.reserve(ctx->values_.size());
+                for (size_t j = 0; j < ctx->values_.size(); ++j) {
+                    values.push_back(std::move(*ctx->values_[j]));
+                }
+                ctx->promise_.set_value(std::move(values));
+            }
+        });
+    }
+
+    return result;
+}
+
+inline Future<void> when_all(const std::vector<Future<void> >& futures) {
+
+    struct Context {
+        std::mutex lock_;
+        size_t pending_;
+        Promise<void> promise_;
+    };
+
+    std::shared_ptr<Context> ctx = std::make_shared<Context>();
+    ctx->pending_ = futures.size();
+
+    Future<void> result = ctx->promise_.get_future();
+    if (futures.empty()) {
+        ctx->promise_.set_value();
+        return result;
+    }
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].on_complete([ctx](const Future<void>& done) {
+            if (done.has_exception()) {
+                ctx->promise_.set_exception(done.exception());
+                return;
+            }
+
+            bool finished = false;
+            {
+                std::lock_guard<std::mutex> lock(ctx->lock_);
+                finished = (--ctx->pending_ == 0);
+            }
+
+            if (finished)
+                ctx->promise_.set_value();
+        });
+    }
+
+    return result;
+}
+
+
+namespace future_detail {
+
+template<typename... Ts>
+struct TupleContext {
+
+    TupleContext() :
+        lock_(),
+        values_(),
+        pending_(sizeof...(Ts)),
+        promise_() {
+    }
+
+    template<size_t I, typename U>
+    void set(const Future<U>& done) {
+
+        if (done.has_exception()) {
+            promise_.set_exception(done.exception());
+            return;
+        }
+
+        bool finished = false;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            std::get<I>(values_) = done.get();
+            finished = (--pending_ == 0);
+        }
+
+        if (finished)
+            finish(typename MakeIndexSeq<sizeof...(Ts)>::type());
+    }
+
+    template<size_t... Is>
+    void finish(IndexSeq<Is...>) {
+        promise_.set_value(std::tuple<Ts...>(std::move(*std::get<Is>(values_))...));
+    }
+
+    std::mutex lock_;
+    std::tuple<boost::optional<Ts>...> values_;
+    size_t pending_;
+    Promise<std::tuple<Ts...> > promise_;
+};
+
+template<size_t I, typename Context>
+void attach_all(const std::shared_ptr<Context>& ctx) {
+}
+
+template<size_t I, typename Context, typename U, typename... Rest>
+void attach_all(const std::shared_ptr<Context>& ctx, const Future<U>& future, const Future<Rest>&... rest) {
+    future.on_complete([ctx](const Future<U>& done) {
+        ctx->template set<I>(done);
+    });
+    attach_all<I + 1>(ctx, rest...);
+}
+
+} // future_detail
+
+// 不同类型的并发请求，例如 when_all(redis_future, mysql_future).then(...)
+template<typename... Ts>
+Future<std::tuple<Ts...> > when_all(const Future<Ts>&... futures) {
+
+    typedef future_detail::TupleContext<Ts...> Context;
+
+    std::shared_ptr<Context> ctx = std::make_shared<Context>();
+    Future<std::tuple<Ts...> > result = ctx->promise_.get_future();
+    future_detail::attach_all<0>(ctx, futures...);
+    return result;
+}
+
+
+// 第一个完成的Future，返回其下标和结果；如果第一个完成的是失败的，则以该异常完成
+template<typename T>
+Future<std::pair<size_t, T> > when_any(const std::vector<Future<T> >& futures) {
+
+    Promise<std::pair<size_t, T> > promise;
+    Future<std::pair<size_t, T> > result = promise.get_future();
+
+    if (futures.empty()) {
+        promise.set_exception(std::make_exception_ptr(std::invalid_argument("when_any with empty futures")));
+        return result;
+    }
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].on_complete([promise, i](const Future<T>& done) {
+            if (done.has_exception()) {
+                promise.set_exception(done.exception());
+            } else {
+                promise.set_value(std::make_pair(i, done.get()));
+            }
+        });
+    }
+
+    return result;
+}
+
+
+// 任务返回值的类型，返回Future<U>的任务会展开为U
+template<typename F, typename... Args>
+struct TaskResult {
+    typedef typename std::result_of<
+        typename std::decay<F>::type&(typename std::decay<Args>::type&...)
+    >::type raw_type;
+    typedef typename future_detail::Unwrap<raw_type>::type type;
+};
+
+// 将func(args...)打包成TaskRunnable，结果通过返回的Future获取
+// 各个任务执行器的submit()都基于此实现
+template<typename F, typename... Args>
+Future<typename TaskResult<F, Args...>::type>
+package_task(TaskRunnable& task, F&& func, Args&&... args) {
+
+    typedef typename TaskResult<F, Args...>::raw_type R;
+    typedef typename TaskResult<F, Args...>::type V;
+
+    Promise<V> promise;
+    auto bound = std::bind(std::forward<F>(func), std::forward<Args>(args)...);
+    task = [promise, bound]() mutable -> int {
+        future_detail::Setter<R>::call(promise, bound);
+        return 0;
+    };
+
+    return promise.get_future();
+}
+
+} // roo
+
+#endif // __ROO_CONCURRENCY_FUTURE_H__
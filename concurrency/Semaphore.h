@@ -0,0 +1,108 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+
+#ifndef __ROO_CONCURRENCY_SEMAPHORE_H__
+#define __ROO_CONCURRENCY_SEMAPHORE_H__
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// 计数信号量，用于限制并发度
+// 支持运行时调整总量，调小的时候计数可能为负，已经持有的许可在归还之后才会生效
+
+namespace roo {
+
+class Semaphore {
+
+    // 禁止拷贝
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+public:
+
+    explicit Semaphore(int count = 0) :
+        lock_(),
+        notify_(),
+        count_(count) {
+    }
+
+    ~Semaphore() = default;
+
+    void acquire() {
+        std::unique_lock<std::mutex> lock(lock_);
+        while (count_ <= 0) {
+            notify_.wait(lock);
+        }
+        --count_;
+    }
+
+    bool try_acquire() {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (count_ <= 0)
+            return false;
+
+        --count_;
+        return true;
+    }
+
+    bool acquire(uint64_t msec) {
+        std::unique_lock<std::mutex> lock(lock_);
+
+        auto expire_tp = std::chrono::steady_clock::now() + std::chrono::milliseconds(msec);
+        while (count_ <= 0) {
+            if (notify_.wait_until(lock, expire_tp) == std::cv_status::timeout) {
+                break;
+            }
+        }
+
+        if (count_ <= 0)
+            return false;
+
+        --count_;
+        return true;
+    }
+
+    void release(int count = 1) {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            count_ += count;
+        }
+
+        if (count == 1)
+            notify_.notify_one();
+        else
+            notify_.notify_all();
+    }
+
+    // 调整许可总量，delta可以为负
+    void adjust(int delta) {
+        if (delta > 0) {
+            release(delta);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(lock_);
+        count_ += delta;
+    }
+
+    int available() {
+        std::lock_guard<std::mutex> lock(lock_);
+        return count_;
+    }
+
+private:
+    std::mutex lock_;
+    std::condition_variable notify_;
+    int count_;
+};
+
+} // roo
+
+#endif // __ROO_CONCURRENCY_SEMAPHORE_H__
@@ -15,11 +15,11 @@
 using boost::asio::steady_timer;
 
 #include <container/EQueue.h>
+#include <concurrency/TimingWheel.h>
 #include <other/Log.h>
 
 // 提供定时回调接口服务
-
-typedef std::function<void(const boost::system::error_code& ec)> TimerEventCallable;
+// TimerEventCallable和时间轮共用，定义在TimingWheel.h中
 
 namespace roo {
 
@@ -87,7 +87,8 @@ public:
     Timer() :
         io_service_thread_(),
         io_service_(),
-        work_guard_(new boost::asio::io_service::work(io_service_)) {
+        work_guard_(new boost::asio::io_service::work(io_service_)),
+        timing_wheel_(io_service_) {
     }
 
     ~Timer() {
@@ -120,6 +121,19 @@ public:
     bool add_timer(const TimerEventCallable& func, uint64_t msec, bool forever);
     std::shared_ptr<TimerObject> add_better_timer(const TimerEventCallable& func, uint64_t msec, bool forever);
 
+    // 大量的超时类定时器使用时间轮，WheelTimer由调用者持有，插入和取消都是O(1)
+    bool add_wheel_timer(WheelTimer& timer, uint64_t msec, bool forever = false) {
+        return timing_wheel_.add_timer(timer, msec, forever);
+    }
+
+    bool cancel_wheel_timer(WheelTimer& timer) {
+        return timing_wheel_.cancel_timer(timer);
+    }
+
+    TimingWheel& get_timing_wheel() {
+        return timing_wheel_;
+    }
+
 
 private:
 
@@ -133,6 +147,9 @@ private:
     // 一个强制的work来持有之
     std::unique_ptr<boost::asio::io_service::work> work_guard_;
 
+    // 由io_service_线程驱动
+    TimingWheel timing_wheel_;
+
     void io_service_run() {
 
         log_warning("Timer io_service thread running...");
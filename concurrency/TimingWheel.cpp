@@ -0,0 +1,203 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <concurrency/TimingWheel.h>
+
+namespace roo {
+
+WheelTimer::~WheelTimer() {
+    if (wheel_)
+        wheel_->cancel_timer(*this);
+}
+
+
+TimingWheel::TimingWheel(boost::asio::io_service& io_service) :
+    lock_(),
+    io_service_(io_service),
+    tick_timer_(io_service),
+    ticking_(false),
+    start_(std::chrono::steady_clock::now()),
+    current_(0),
+    count_(0) {
+
+    for (size_t i = 0; i < kRootSize; ++i) {
+        root_[i].prev_ = root_[i].next_ = &root_[i];
+    }
+
+    for (size_t l = 0; l < kLevels; ++l) {
+        for (size_t i = 0; i < kLevelSize; ++i) {
+            levels_[l][i].prev_ = levels_[l][i].next_ = &levels_[l][i];
+        }
+    }
+}
+
+TimingWheel::~TimingWheel() {
+
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    boost::system::error_code ec;
+    tick_timer_.cancel(ec);
+
+    log_warning_if(count_, "TimingWheel destroyed with %lu pending timers.", count_);
+}
+
+bool TimingWheel::add_timer(WheelTimer& timer, uint64_t msec, bool forever) {
+
+    if (forever && msec == 0) {
+        log_err("forever timer with zero interval is not allowed.");
+        return false;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    if (timer.wheel_ && timer.wheel_ != this) {
+        log_err("WheelTimer already attached to another TimingWheel.");
+        return false;
+    }
+
+    if (timer.pending()) {
+        unlink(&timer);
+        --count_;
+    }
+
+    uint64_t now = now_tick();
+
+    // 空闲期间没有推进，直接对齐到当前时间，所有槽位此时都是空的
+    if (count_ == 0 && current_ < now)
+        current_ = now;
+
+    timer.wheel_    = this;
+    timer.expire_   = now + msec;
+    timer.interval_ = forever ? msec : 0;
+
+    do_link(&timer);
+    ++count_;
+
+    arm_tick();
+    return true;
+}
+
+bool TimingWheel::cancel_timer(WheelTimer& timer) {
+
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+
+    if (timer.wheel_ != this || !timer.pending())
+        return false;
+
+    unlink(&timer);
+    --count_;
+    return true;
+}
+
+void TimingWheel::do_link(WheelTimer* timer) {
+
+    if (timer->expire_ < current_)
+        timer->expire_ = current_;
+
+    uint64_t delta = timer->expire_ - current_;
+    const uint64_t kMaxDelta = (1ULL << (kRootBits + kLevels * kLevelBits)) - 1;
+    if (delta > kMaxDelta) {
+        delta = kMaxDelta;
+        timer->expire_ = current_ + kMaxDelta;
+    }
+
+    if (delta < kRootSize) {
+        link(&root_[timer->expire_ & (kRootSize - 1)], timer);
+        return;
+    }
+
+    size_t level = 0;
+    while (level + 1 < kLevels &&
+           delta >= (1ULL << (kRootBits + (level + 1) * kLevelBits))) {
+        ++level;
+    }
+
+    size_t idx = (timer->expire_ >> (kRootBits + level * kLevelBits)) & (kLevelSize - 1);
+    link(&levels_[level][idx], timer);
+}
+
+// 高层的槽位到期，重新分散到低层中
+void TimingWheel::cascade(size_t level, size_t idx) {
+
+    WheelLink list;
+    splice(&levels_[level][idx], &list);
+
+    while (list.next_ != &list) {
+        WheelTimer* timer = static_cast<WheelTimer*>(list.next_);
+        unlink(timer);
+        do_link(timer);
+    }
+}
+
+void TimingWheel::tick_once() {
+
+    size_t idx = current_ & (kRootSize - 1);
+    if (idx == 0) {
+        for (size_t l = 0; l < kLevels; ++l) {
+            size_t i = (current_ >> (kRootBits + l * kLevelBits)) & (kLevelSize - 1);
+            cascade(l, i);
+            if (i != 0)
+                break;
+        }
+    }
+
+    WheelLink expired;
+    splice(&root_[idx], &expired);
+
+    // 回调中添加的定时器最早在下一个tick触发
+    ++current_;
+
+    const boost::system::error_code ec;
+    while (expired.next_ != &expired) {
+
+        WheelTimer* timer = static_cast<WheelTimer*>(expired.next_);
+        unlink(timer);
+        --count_;
+
+        // 周期性定时器先重新调度，回调中可以将其取消
+        if (timer->interval_) {
+            timer->expire_ = current_ - 1 + timer->interval_;
+            do_link(timer);
+            ++count_;
+        }
+
+        if (timer->func_) {
+            timer->func_(ec);
+        } else {
+            log_err("critical, func not initialized");
+        }
+    }
+}
+
+void TimingWheel::arm_tick() {
+
+    if (ticking_ || count_ == 0)
+        return;
+
+    ticking_ = true;
+    tick_timer_.expires_from_now(std::chrono::milliseconds(1));
+    tick_timer_.async_wait(
+        std::bind(&TimingWheel::tick_handler, this, std::placeholders::_1));
+}
+
+void TimingWheel::tick_handler(const boost::system::error_code& ec) {
+
+    if (ec == boost::asio::error::operation_aborted)
+        return;
+
+    std::lock_guard<std::recursive_mutex> lock(lock_);
+    ticking_ = false;
+
+    uint64_t now = now_tick();
+    while (current_ <= now && count_ > 0) {
+        tick_once();
+    }
+
+    arm_tick();
+}
+
+} // end namespace roo
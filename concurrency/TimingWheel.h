@@ -0,0 +1,163 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __ROO_CONCURRENCY_TIMING_WHEEL_H__
+#define __ROO_CONCURRENCY_TIMING_WHEEL_H__
+
+#include <xtra_rhel.h>
+
+#include <mutex>
+#include <chrono>
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <other/Log.h>
+
+// 分层时间轮，毫秒精度，用于海量的请求超时类定时器
+//
+// 和Timer::add_better_timer相比，每个定时器不再单独持有steady_timer并进入asio的
+// 堆结构，插入、取消都是O(1)；WheelTimer由使用者持有(可以直接嵌入到请求结构体中)，
+// 反复的调度、取消、重新调度都不需要分配内存。
+//
+// 第一层256个槽位，每个1ms；之后四层每层64个槽位，覆盖约49天，超出的按最大值处理。
+// 只有存在活跃定时器的时候，才会在io_service上每毫秒推进一次。
+//
+// 回调在io_service线程中持锁执行，回调中可以再次调度或者取消定时器，但是不要做
+// 耗时的操作，也不能在回调中析构正在触发的WheelTimer。WheelTimer必须先于TimingWheel析构。
+
+typedef std::function<void(const boost::system::error_code& ec)> TimerEventCallable;
+
+namespace roo {
+
+class TimingWheel;
+
+struct WheelLink {
+    WheelLink() :
+        prev_(NULL),
+        next_(NULL) {
+    }
+
+    WheelLink* prev_;
+    WheelLink* next_;
+};
+
+class WheelTimer : private WheelLink {
+
+    __noncopyable__(WheelTimer)
+
+    friend class TimingWheel;
+
+public:
+    explicit WheelTimer(const TimerEventCallable& func) :
+        WheelLink(),
+        func_(func),
+        wheel_(NULL),
+        expire_(0),
+        interval_(0) {
+    }
+
+    // 析构时自动取消
+    ~WheelTimer();
+
+    // 其他线程调用只能作为参考
+    bool pending() const {
+        return next_ != NULL;
+    }
+
+private:
+    TimerEventCallable func_;
+    TimingWheel* wheel_;
+    uint64_t expire_;      // 到期的tick
+    uint64_t interval_;    // 非0表示周期性的定时器
+};
+
+
+class TimingWheel {
+
+    __noncopyable__(TimingWheel)
+
+public:
+    explicit TimingWheel(boost::asio::io_service& io_service);
+    ~TimingWheel();
+
+    // 如果timer已经在调度中，则按照新的时间重新调度
+    bool add_timer(WheelTimer& timer, uint64_t msec, bool forever = false);
+
+    // 返回false表示timer不在调度中(已经触发或者没有添加)
+    bool cancel_timer(WheelTimer& timer);
+
+    size_t size() {
+        std::lock_guard<std::recursive_mutex> lock(lock_);
+        return count_;
+    }
+
+private:
+
+    static const size_t kRootBits  = 8;
+    static const size_t kLevelBits = 6;
+    static const size_t kRootSize  = 1 << kRootBits;
+    static const size_t kLevelSize = 1 << kLevelBits;
+    static const size_t kLevels    = 4;
+
+    uint64_t now_tick() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - start_).count();
+    }
+
+    static void link(WheelLink* head, WheelLink* node) {
+        node->prev_ = head->prev_;
+        node->next_ = head;
+        head->prev_->next_ = node;
+        head->prev_ = node;
+    }
+
+    static void unlink(WheelLink* node) {
+        node->prev_->next_ = node->next_;
+        node->next_->prev_ = node->prev_;
+        node->prev_ = node->next_ = NULL;
+    }
+
+    // 把槽位中的所有节点转移到list中
+    static void splice(WheelLink* slot, WheelLink* list) {
+        if (slot->next_ == slot) {
+            list->prev_ = list->next_ = list;
+            return;
+        }
+
+        list->next_ = slot->next_;
+        list->prev_ = slot->prev_;
+        list->next_->prev_ = list;
+        list->prev_->next_ = list;
+        slot->prev_ = slot->next_ = slot;
+    }
+
+    // 以下函数需要持锁调用
+    void do_link(WheelTimer* timer);
+    void cascade(size_t level, size_t idx);
+    void tick_once();
+    void arm_tick();
+
+    void tick_handler(const boost::system::error_code& ec);
+
+    std::recursive_mutex lock_;
+
+    boost::asio::io_service& io_service_;
+    boost::asio::steady_timer tick_timer_;
+    bool ticking_;
+
+    const std::chrono::steady_clock::time_point start_;
+    uint64_t current_;     // 下一个待处理的tick
+    size_t   count_;
+
+    WheelLink root_[kRootSize];
+    WheelLink levels_[kLevels][kLevelSize];
+};
+
+} // end namespace roo
+
+#endif // __ROO_CONCURRENCY_TIMING_WHEEL_H__
@@ -0,0 +1,412 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+
+#ifndef __ROO_CONCURRENCY_WORK_STEALING_POOL_H__
+#define __ROO_CONCURRENCY_WORK_STEALING_POOL_H__
+
+
+#include <xtra_rhel.h>
+
+#include <memory>
+#include <sstream>
+#include <functional>
+#include <atomic>
+#include <system_error>
+
+#include <other/Log.h>
+#include <system/ConstructException.h>
+#include <container/EQueue.h>
+#include <container/ChaseLevDeque.h>
+#include <concurrency/ThreadMng.h>
+#include <concurrency/Future.h>
+
+// 每个工作线程持有一个Chase-Lev双端队列，任务执行过程中提交的新任务直接压入
+// 本线程的队列(LIFO，缓存友好)，空闲的线程随机选择其他线程进行窃取(FIFO)。
+// 外部线程提交的任务先进入注入队列Queue，由空闲的工作线程批量领取到本地队列中。
+//
+// 没有任务的时候工作线程会挂起，只有存在挂起线程时提交方才会持锁唤醒；
+// terminate()会立即唤醒所有线程并在当前任务执行完之后退出，未执行的任务被丢弃，
+// 长时间运行的任务可以通过is_terminating()进行协作式的提前退出。
+
+namespace roo {
+
+template<typename Queue = EQueue<TaskRunnable> >
+class WorkStealingPool {
+
+    // 禁止拷贝
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+public:
+
+    struct WorkerStat {
+        uint64_t executed_;   // 执行的任务数
+        uint64_t stolen_;     // 其中从其他线程窃取的任务数
+        uint64_t idle_ms_;    // 挂起等待的总时长
+    };
+
+    explicit WorkStealingPool(uint8_t thread_num = 1) :
+        workers_(),
+        threads_(),
+        terminate_(false),
+        injection_(),
+        sleepers_(0),
+        epoch_(0),
+        park_lock_(),
+        park_notify_() {
+
+        if (thread_num == 0) {
+            log_err("WorkStealingPool at least should have 1 thread.");
+            thread_num = 1;
+        }
+
+        // 工作线程启动之后可能立即窃取，所以所有的Worker需要先于线程创建
+        workers_.reserve(thread_num);
+        for (size_t i = 0; i < thread_num; ++i) {
+            workers_.emplace_back(new Worker(this, i));
+        }
+
+        threads_.reserve(thread_num);
+        for (size_t i = 0; i < thread_num; ++i) {
+
+            std::thread* thd = NULL;
+            try {
+                thd = new std::thread(std::bind(&WorkStealingPool::thread_run, this, i));
+            } catch (const std::system_error& e) {
+                log_err("create WorkStealingPool thread failed: %s", e.what());
+                thd = NULL;
+            }
+
+            if (!thd) {
+
+                // 清理已经创建的线程
+                terminate();
+
+                // 抛出异常
+                throw ConstructException("WorkStealingPool Thread Create Fail");
+            }
+
+            threads_.push_back(thd);
+        }
+
+        log_warning("totally created %u threads for WorkStealingPool successfully!", thread_num);
+    }
+
+    ~WorkStealingPool() {
+        terminate();
+    }
+
+    void terminate() {
+
+        terminate_.store(true);
+        {
+            std::lock_guard<std::mutex> lock(park_lock_);
+            epoch_.fetch_add(1, std::memory_order_release);
+        }
+        park_notify_.notify_all();
+
+        // join all threads
+        for (size_t j = 0; j < threads_.size(); ++j) {
+            if (threads_[j] && threads_[j]->joinable())
+                threads_[j]->join();
+            delete threads_[j];
+        }
+        threads_.clear();
+
+        // 工作线程都退出了，此时可以安全的访问各个本地队列
+        size_t dropped = 0;
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            TaskRunnable* task = NULL;
+            while ((task = workers_[i]->deque_.TAKE()) != NULL) {
+                delete task;
+                ++dropped;
+            }
+        }
+
+        std::vector<TaskRunnable> pending;
+        dropped += injection_.TRY_POP(pending);
+
+        log_warning_if(dropped, "WorkStealingPool dropped %lu pending tasks.", dropped);
+    }
+
+    bool is_terminating() const {
+        return terminate_.load(std::memory_order_relaxed);
+    }
+
+    // 在本池的工作线程中调用会直接压入本地队列，否则进入注入队列
+    void add_task(const TaskRunnable& func) {
+        Worker* worker = current_worker();
+        if (worker && worker->pool_ == this) {
+            worker->deque_.PUSH(new TaskRunnable(func));
+        } else {
+            injection_.PUSH(func);
+        }
+        wakeup_one();
+    }
+
+    void add_task(TaskRunnable&& func) {
+        Worker* worker = current_worker();
+        if (worker && worker->pool_ == this) {
+            worker->deque_.PUSH(new TaskRunnable(std::move(func)));
+        } else {
+            injection_.PUSH(std::move(func));
+        }
+        wakeup_one();
+    }
+
+    // 提交任务并通过Future获取结果，任务抛出的异常会在Future::get()时重新抛出
+    template<typename F, typename... Args>
+    Future<typename TaskResult<F, Args...>::type> submit(F&& func, Args&&... args) {
+        TaskRunnable task;
+        auto future = package_task(task, std::forward<F>(func), std::forward<Args>(args)...);
+        add_task(std::move(task));
+        return future;
+    }
+
+    size_t thread_num() const {
+        return workers_.size();
+    }
+
+    WorkerStat worker_stat(size_t idx) const {
+        WorkerStat stat {};
+        if (idx < workers_.size()) {
+            stat.executed_ = workers_[idx]->executed_.load(std::memory_order_relaxed);
+            stat.stolen_   = workers_[idx]->stolen_.load(std::memory_order_relaxed);
+            stat.idle_ms_  = workers_[idx]->idle_us_.load(std::memory_order_relaxed) / 1000;
+        }
+        return stat;
+    }
+
+    int module_status(std::string& module, std::string& name, std::string& val) {
+
+        module = "WorkStealingPool";
+        name = "workers";
+
+        std::stringstream ss;
+
+        ss << "\t" << "thread_num: " << workers_.size() << std::endl;
+        ss << "\t" << "injection_pending: " << injection_.SIZE() << std::endl;
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            WorkerStat stat = worker_stat(i);
+            ss << "\t" << "worker#" << i << ": "
+               << "executed " << stat.executed_ << ", "
+               << "stolen " << stat.stolen_ << ", "
+               << "idle_ms " << stat.idle_ms_ << ", "
+               << "local_pending " << workers_[i]->deque_.SIZE() << std::endl;
+        }
+
+        val = ss.str();
+
+        return 0;
+    }
+
+private:
+
+    struct Worker {
+
+        Worker(WorkStealingPool* pool, size_t idx) :
+            pool_(pool),
+            idx_(idx),
+            deque_(),
+            batch_(),
+            seed_(static_cast<uint32_t>(idx * 2654435761UL + 1)),
+            tick_(0),
+            executed_(0),
+            stolen_(0),
+            idle_us_(0) {
+        }
+
+        WorkStealingPool* const pool_;
+        const size_t idx_;
+
+        ChaseLevDeque<TaskRunnable> deque_;
+        std::vector<TaskRunnable>   batch_;     // 从注入队列领取任务的临时缓冲
+
+        uint32_t seed_;   // 随机选取窃取对象
+        uint32_t tick_;   // 周期性的检查注入队列，防止本地任务饿死外部任务
+
+        std::atomic<uint64_t> executed_;
+        std::atomic<uint64_t> stolen_;
+        std::atomic<uint64_t> idle_us_;
+
+        char pad_[64];
+    };
+
+    static Worker*& current_worker() {
+        static thread_local Worker* worker = NULL;
+        return worker;
+    }
+
+    void thread_run(size_t idx) {
+
+        log_warning("WorkStealingPool thread %#lx begin to run ...", (long)pthread_self());
+
+        Worker& worker = *workers_[idx];
+        current_worker() = &worker;
+
+        while (!terminate_.load(std::memory_order_relaxed)) {
+
+            TaskRunnable* task = next_task(worker);
+            for (int i = 0; !task && i < kSpinRounds; ++i) {
+                std::this_thread::yield();
+                task = next_task(worker);
+            }
+
+            if (!task) {
+                park(worker);
+                continue;
+            }
+
+            int code = (*task)();
+            if (code != 0)
+                log_err("WorkStealingPool task run code %d.", code);
+
+            delete task;
+            worker.executed_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        current_worker() = NULL;
+        log_warning("WorkStealingPool thread %#lx about to terminate ...", (long)pthread_self());
+    }
+
+    TaskRunnable* next_task(Worker& worker) {
+
+        TaskRunnable* task = NULL;
+
+        if ((++worker.tick_ % kInjectionCheckInterval) != 0) {
+            task = worker.deque_.TAKE();
+            if (task)
+                return task;
+        }
+
+        task = take_injection(worker);
+        if (task)
+            return task;
+
+        task = worker.deque_.TAKE();
+        if (task)
+            return task;
+
+        // 从随机位置开始轮询一遍其他线程
+        size_t count = workers_.size();
+        size_t start = next_random(worker) % count;
+        for (size_t i = 0; i < count; ++i) {
+            Worker& victim = *workers_[(start + i) % count];
+            if (&victim == &worker)
+                continue;
+
+            task = victim.deque_.STEAL();
+            if (task) {
+                worker.stolen_.fetch_add(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+
+        return NULL;
+    }
+
+    // 批量领取注入队列的任务，除了第一个之外都放到本地队列供其他线程窃取
+    TaskRunnable* take_injection(Worker& worker) {
+
+        if (injection_.EMPTY() || !injection_.TRY_POP(worker.batch_))
+            return NULL;
+
+        TaskRunnable* task = new TaskRunnable(std::move(worker.batch_[0]));
+        for (size_t i = 1; i < worker.batch_.size(); ++i) {
+            worker.deque_.PUSH(new TaskRunnable(std::move(worker.batch_[i])));
+        }
+
+        if (worker.batch_.size() > 1)
+            wakeup_one();
+
+        worker.batch_.clear();
+        return task;
+    }
+
+    bool has_pending() {
+
+        if (!injection_.EMPTY())
+            return true;
+
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            if (!workers_[i]->deque_.EMPTY())
+                return true;
+        }
+
+        return false;
+    }
+
+    // 先登记为挂起者再检查是否有任务，和wakeup_one()配合保证不会丢失唤醒
+    void park(Worker& worker) {
+
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t epoch = epoch_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (terminate_.load() || has_pending()) {
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(park_lock_);
+            while (epoch_.load(std::memory_order_relaxed) == epoch) {
+                park_notify_.wait(lock);
+            }
+        }
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+
+        auto elapse = std::chrono::steady_clock::now() - start;
+        worker.idle_us_.fetch_add(
+            std::chrono::duration_cast<std::chrono::microseconds>(elapse).count(),
+            std::memory_order_relaxed);
+    }
+
+    void wakeup_one() {
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) > 0) {
+            {
+                std::lock_guard<std::mutex> lock(park_lock_);
+                epoch_.fetch_add(1, std::memory_order_release);
+            }
+            park_notify_.notify_one();
+        }
+    }
+
+    static uint32_t next_random(Worker& worker) {
+        uint32_t x = worker.seed_;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        worker.seed_ = x;
+        return x;
+    }
+
+    static const int      kSpinRounds = 4;
+    static const uint32_t kInjectionCheckInterval = 61;
+
+    std::vector<std::unique_ptr<Worker> > workers_;
+    std::vector<std::thread*> threads_;
+    std::atomic<bool> terminate_;
+
+    // 外部线程提交的任务
+    Queue injection_;
+
+    // 空闲线程挂起
+    std::atomic<int>      sleepers_;
+    std::atomic<uint32_t> epoch_;
+    std::mutex              park_lock_;
+    std::condition_variable park_notify_;
+};
+
+
+} // roo
+
+#endif // __ROO_CONCURRENCY_WORK_STEALING_POOL_H__
@@ -0,0 +1,657 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include <string/StrUtil.h>
+
+#include <connect/AsyncRedisConn.h>
+
+namespace roo {
+
+
+// hiredis的事件适配器，把redisAsyncContext的fd挂到asio上
+//
+// 只等待可读、可写事件(null_buffers)，真正的读写还是由hiredis完成。
+// 适配器由context通过ev.data持有，cleanup之后等待中的handler仍然持有
+// 适配器本身，所以不会访问已经释放的内存。
+
+class RedisAsioAdapter : public std::enable_shared_from_this<RedisAsioAdapter> {
+
+public:
+    RedisAsioAdapter(boost::asio::io_service& io_service, redisAsyncContext* context) :
+        descriptor_(io_service),
+        context_(context),
+        reading_(false),
+        writing_(false),
+        read_wanted_(false),
+        write_wanted_(false) {
+        descriptor_.assign(context->c.fd);
+    }
+
+    // 禁止拷贝
+    RedisAsioAdapter(const RedisAsioAdapter&) = delete;
+    RedisAsioAdapter& operator=(const RedisAsioAdapter&) = delete;
+
+    static int attach(redisAsyncContext* context, boost::asio::io_service& io_service) {
+
+        if (context->ev.data != NULL)
+            return REDIS_ERR;
+
+        std::shared_ptr<RedisAsioAdapter> adapter
+            = std::make_shared<RedisAsioAdapter>(io_service, context);
+
+        context->ev.data = new std::shared_ptr<RedisAsioAdapter>(adapter);
+        context->ev.addRead  = &RedisAsioAdapter::add_read;
+        context->ev.delRead  = &RedisAsioAdapter::del_read;
+        context->ev.addWrite = &RedisAsioAdapter::add_write;
+        context->ev.delWrite = &RedisAsioAdapter::del_write;
+        context->ev.cleanup  = &RedisAsioAdapter::cleanup;
+        return REDIS_OK;
+    }
+
+private:
+
+    static RedisAsioAdapter* get(void* privdata) {
+        return static_cast<std::shared_ptr<RedisAsioAdapter>*>(privdata)->get();
+    }
+
+    static void add_read(void* privdata) {
+        RedisAsioAdapter* adapter = get(privdata);
+        adapter->read_wanted_ = true;
+        adapter->start_read();
+    }
+
+    static void del_read(void* privdata) {
+        get(privdata)->read_wanted_ = false;
+    }
+
+    static void add_write(void* privdata) {
+        RedisAsioAdapter* adapter = get(privdata);
+        adapter->write_wanted_ = true;
+        adapter->start_write();
+    }
+
+    static void del_write(void* privdata) {
+        get(privdata)->write_wanted_ = false;
+    }
+
+    // context释放的时候调用，fd由hiredis关闭
+    static void cleanup(void* privdata) {
+
+        std::shared_ptr<RedisAsioAdapter>* holder
+            = static_cast<std::shared_ptr<RedisAsioAdapter>*>(privdata);
+
+        RedisAsioAdapter* adapter = holder->get();
+        adapter->context_ = NULL;
+        adapter->read_wanted_ = false;
+        adapter->write_wanted_ = false;
+
+        boost::system::error_code ec;
+        adapter->descriptor_.cancel(ec);
+        adapter->descriptor_.release();
+
+        delete holder;
+    }
+
+    void start_read() {
+
+        if (reading_ || !context_)
+            return;
+
+        reading_ = true;
+        std::shared_ptr<RedisAsioAdapter> self = shared_from_this();
+        descriptor_.async_read_some(boost::asio::null_buffers(),
+            [self](const boost::system::error_code& ec, size_t) {
+                self->reading_ = false;
+                if (!self->context_ || ec == boost::asio::error::operation_aborted)
+                    return;
+
+                // 出错的时候也交给hiredis处理，由它检测并断开连接
+                if (self->read_wanted_)
+                    redisAsyncHandleRead(self->context_);
+
+                if (self->context_ && self->read_wanted_)
+                    self->start_read();
+            });
+    }
+
+    void start_write() {
+
+        if (writing_ || !context_)
+            return;
+
+        writing_ = true;
+        std::shared_ptr<RedisAsioAdapter> self = shared_from_this();
+        descriptor_.async_write_some(boost::asio::null_buffers(),
+            [self](const boost::system::error_code& ec, size_t) {
+                self->writing_ = false;
+                if (!self->context_ || ec == boost::asio::error::operation_aborted)
+                    return;
+
+                if (self->write_wanted_)
+                    redisAsyncHandleWrite(self->context_);
+
+                if (self->context_ && self->write_wanted_)
+                    self->start_write();
+            });
+    }
+
+    boost::asio::posix::stream_descriptor descriptor_;
+    redisAsyncContext* context_;
+
+    bool reading_;
+    bool writing_;
+    bool read_wanted_;
+    bool write_wanted_;
+};
+
+
+
+
+#if !defined(REDIS_NO_AUTO_FREE_REPLIES)
+
+// 老版本的hiredis在回调返回之后就会释放reply，只能深拷贝一份出来
+static redisReply* clone_reply(const redisReply* reply) {
+
+    redisReply* copy = static_cast<redisReply*>(::calloc(1, sizeof(redisReply)));
+    copy->type = reply->type;
+    copy->integer = reply->integer;
+
+    if (reply->str) {
+        copy->len = reply->len;
+        copy->str = static_cast<char*>(::malloc(reply->len + 1));
+        ::memcpy(copy->str, reply->str, reply->len);
+        copy->str[reply->len] = '\0';
+    }
+
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements) {
+        copy->elements = reply->elements;
+        copy->element = static_cast<redisReply**>(::calloc(reply->elements, sizeof(redisReply*)));
+        for (size_t i = 0; i < reply->elements; ++i) {
+            copy->element[i] = clone_reply(reply->element[i]);
+        }
+    }
+
+    return copy;
+}
+
+#endif
+
+
+// 每个命令的回调上下文，持有连接避免在应答之前被析构
+struct AsyncReplyContext {
+    std::shared_ptr<AsyncRedisConn> conn_;
+    AsyncRedisConn::ReplyCallback callback_;
+};
+
+
+AsyncRedisConn::~AsyncRedisConn() {
+    log_info("Destroy Async Redis Connection OK!");
+}
+
+bool AsyncRedisConn::init(uint32_t timeout_ms) {
+
+    Promise<bool> promise;
+    Future<bool> future = promise.get_future();
+
+    io_service_.io_service().post(
+        std::bind(&AsyncRedisConn::do_connect, shared_from_this(), promise));
+
+    if (!future.wait_for(timeout_ms)) {
+        log_err("async redis connect %s:%d timeout.", helper_.host_.c_str(), helper_.port_);
+        close();
+        return false;
+    }
+
+    if (!future.get()) {
+        log_err("async redis connect %s:%d failed.", helper_.host_.c_str(), helper_.port_);
+        close();
+        return false;
+    }
+
+    log_info("Create New Async Redis Connection OK! %s:%d", helper_.host_.c_str(), helper_.port_);
+    return true;
+}
+
+void AsyncRedisConn::close() {
+    io_service_.io_service().dispatch(
+        std::bind(&AsyncRedisConn::do_close, shared_from_this()));
+}
+
+void AsyncRedisConn::do_connect(const Promise<bool>& promise) {
+
+    context_ = redisAsyncConnect(helper_.host_.c_str(), helper_.port_);
+    if (!context_ || context_->err) {
+        if (context_) {
+            log_err("redis async context problem: %s", context_->errstr);
+            redisAsyncFree(context_);
+            context_ = NULL;
+        } else {
+            log_err("create async context error");
+        }
+        promise.set_value(false);
+        return;
+    }
+
+#if defined(REDIS_NO_AUTO_FREE_REPLIES)
+    // 由redisReply_ptr接管应答对象
+    context_->c.flags |= REDIS_NO_AUTO_FREE_REPLIES;
+#endif
+
+    if (RedisAsioAdapter::attach(context_, io_service_.io_service()) != REDIS_OK) {
+        log_err("attach redis async context to io_service failed.");
+        redisAsyncFree(context_);
+        context_ = NULL;
+        promise.set_value(false);
+        return;
+    }
+
+    context_->data = this;
+    redisAsyncSetConnectCallback(context_, &AsyncRedisConn::on_connect);
+    redisAsyncSetDisconnectCallback(context_, &AsyncRedisConn::on_disconnect);
+
+    // 连接由context持有，直到断开
+    self_ = shared_from_this();
+    connect_promise_ = promise;
+
+    // 初始化的命令排在所有的业务命令之前，最后的PING返回的时候初始化完成
+    std::shared_ptr<bool> setup_ok = std::make_shared<bool>(true);
+
+    if (!helper_.passwd_.empty()) {
+        std::vector<std::string> argv { "AUTH", helper_.passwd_ };
+        send_command(argv, [setup_ok](const redisReply_ptr& reply) {
+            if (!reply) {
+                log_err("redis async conn auth failed!");
+                *setup_ok = false;
+            }
+        });
+    }
+
+    if (helper_.db_idx_ != 0) {
+        std::vector<std::string> argv { "SELECT", StrUtil::to_string(helper_.db_idx_) };
+        int db_idx = helper_.db_idx_;
+        send_command(argv, [setup_ok, db_idx](const redisReply_ptr& reply) {
+            if (!reply) {
+                log_err("redis async select db failed: %d", db_idx);
+                *setup_ok = false;
+            }
+        });
+    }
+
+    std::vector<std::string> argv { "PING" };
+    send_command(argv, [setup_ok, promise](const redisReply_ptr& reply) {
+        promise.set_value(!!reply && *setup_ok);
+    });
+}
+
+void AsyncRedisConn::do_close() {
+
+    // 等待已经发出的命令应答之后断开
+    if (context_)
+        redisAsyncDisconnect(context_);
+}
+
+void AsyncRedisConn::on_connect(const redisAsyncContext* context, int status) {
+
+    AsyncRedisConn* conn = static_cast<AsyncRedisConn*>(context->data);
+    if (!conn)
+        return;
+
+    // 连接失败的时候hiredis直接释放context，不会再调用disconnect的回调，
+    // 已经发出的命令随后以空的应答回调
+    if (status != REDIS_OK) {
+        log_err("redis async connect failed: %s", context->errstr);
+
+        conn->disconnected_ = true;
+        conn->context_ = NULL;
+        conn->connect_promise_.set_value(false);
+
+        std::shared_ptr<AsyncRedisConn> self;
+        self.swap(conn->self_);
+        return;
+    }
+
+    conn->connected_ = true;
+}
+
+void AsyncRedisConn::on_disconnect(const redisAsyncContext* context, int status) {
+
+    AsyncRedisConn* conn = static_cast<AsyncRedisConn*>(context->data);
+    if (!conn)
+        return;
+
+    if (status != REDIS_OK) {
+        log_err("redis async connection lost: %s", context->errstr);
+    }
+
+    // 返回之后hiredis会释放context
+    conn->disconnected_ = true;
+    conn->context_ = NULL;
+    conn->connect_promise_.set_value(false);
+
+    std::shared_ptr<AsyncRedisConn> self;
+    self.swap(conn->self_);
+}
+
+void AsyncRedisConn::on_reply(redisAsyncContext* context, void* r, void* privdata) {
+
+    std::unique_ptr<AsyncReplyContext> reply_context(static_cast<AsyncReplyContext*>(privdata));
+    redisReply* raw = static_cast<redisReply*>(r);
+
+    redisReply_ptr reply{};
+    if (raw) {
+#if defined(REDIS_NO_AUTO_FREE_REPLIES)
+        reply.reset(raw, freeReplyObject);
+#else
+        reply.reset(clone_reply(raw), freeReplyObject);
+#endif
+    }
+
+    if (!reply) {
+        if (context && context->err) {
+            log_err("async exec failed supply context info: %s", context->errstr);
+        } else {
+            log_err("async exec failed with empty reply.");
+        }
+    } else if (reply->type == REDIS_REPLY_ERROR) {
+        if (reply->str) {
+            log_err("async exec failed with error: %s", reply->str);
+        } else {
+            log_err("async exec failed");
+        }
+        reply.reset();
+    }
+
+    --reply_context->conn_->pending_;
+    if (reply_context->callback_)
+        reply_context->callback_(reply);
+}
+
+void AsyncRedisConn::send_command(std::vector<std::string>& argv, const ReplyCallback& callback) {
+
+    if (!context_ || disconnected_ || argv.empty()) {
+        if (callback)
+            callback(redisReply_ptr());
+        return;
+    }
+
+    std::vector<const char*> argvptrs;
+    std::vector<size_t> argvlens;
+    argvptrs.reserve(argv.size());
+    argvlens.reserve(argv.size());
+    for (size_t i = 0; i < argv.size(); ++i) {
+        argvptrs.push_back(argv[i].c_str());
+        argvlens.push_back(argv[i].size());
+    }
+
+    AsyncReplyContext* reply_context = new AsyncReplyContext();
+    reply_context->conn_ = shared_from_this();
+    reply_context->callback_ = callback;
+
+    ++pending_;
+    if (redisAsyncCommandArgv(context_, &AsyncRedisConn::on_reply, reply_context,
+                              static_cast<int>(argvptrs.size()), &argvptrs[0], &argvlens[0]) != REDIS_OK) {
+        log_err("redisAsyncCommandArgv failed.");
+        --pending_;
+        delete reply_context;
+        if (callback)
+            callback(redisReply_ptr());
+    }
+}
+
+void AsyncRedisConn::ExecV(const std::vector<std::string>& argv, const ReplyCallback& callback) {
+
+    // 在io_service线程中调用的话直接发送
+    std::shared_ptr<AsyncRedisConn> self = shared_from_this();
+    std::vector<std::string> args(argv);
+    io_service_.io_service().dispatch([self, args, callback]() mutable {
+        self->send_command(args, callback);
+    });
+}
+
+Future<redisReply_ptr> AsyncRedisConn::ExecV(const std::vector<std::string>& argv) {
+
+    Promise<redisReply_ptr> promise;
+    ExecV(argv, [promise](const redisReply_ptr& reply) {
+        promise.set_value(reply);
+    });
+    return promise.get_future();
+}
+
+template<typename T>
+Future<T> AsyncRedisConn::command(std::vector<std::string>&& argv,
+                                  std::function<T(const redisReply* reply)> parser) {
+
+    Promise<T> promise;
+    ExecV(argv, [promise, parser](const redisReply_ptr& reply) {
+        promise.set_value(parser(reply.get()));
+    });
+    return promise.get_future();
+}
+
+
+// 应答的解析，失败的时候reply为NULL
+
+static bool reply_ok(const redisReply* reply) {
+    return reply &&
+           reply->type == REDIS_REPLY_STATUS &&
+           reply->str != NULL &&
+           ::strcmp(reply->str, "OK") == 0;
+}
+
+static int reply_int(const redisReply* reply) {
+    if (reply && reply->type == REDIS_REPLY_INTEGER)
+        return static_cast<int>(reply->integer);
+    return -1;
+}
+
+static boost::optional<int64_t> reply_integer(const redisReply* reply) {
+    if (reply && reply->type == REDIS_REPLY_INTEGER)
+        return reply->integer;
+    return boost::none;
+}
+
+static boost::optional<std::string> reply_string(const redisReply* reply) {
+
+    if (!reply)
+        return boost::none;
+
+    if (reply->type == REDIS_REPLY_STRING && reply->str != NULL)
+        return std::string(reply->str, reply->len);
+    if (reply->type == REDIS_REPLY_INTEGER)
+        return StrUtil::to_string(reply->integer);
+
+    return boost::none;
+}
+
+static boost::optional<int64_t> reply_int64(const redisReply* reply) {
+
+    if (!reply)
+        return boost::none;
+
+    if (reply->type == REDIS_REPLY_INTEGER)
+        return reply->integer;
+    if (reply->type == REDIS_REPLY_STRING && reply->str != NULL)
+        return static_cast<int64_t>(::atoll(reply->str));
+
+    return boost::none;
+}
+
+
+Future<bool> AsyncRedisConn::Exists(const std::string& key) {
+    return command<bool>({ "EXISTS", key }, [](const redisReply* reply) {
+        return reply && reply->type == REDIS_REPLY_INTEGER && reply->integer == 1;
+    });
+}
+
+Future<boost::optional<std::string>> AsyncRedisConn::Get(const std::string& key) {
+    return command<boost::optional<std::string>>({ "GET", key }, reply_string);
+}
+
+Future<boost::optional<int64_t>> AsyncRedisConn::GetInt(const std::string& key) {
+    return command<boost::optional<int64_t>>({ "GET", key }, reply_int64);
+}
+
+Future<int> AsyncRedisConn::Del(const std::string& key) {
+    return command<int>({ "DEL", key }, reply_int);
+}
+
+Future<int> AsyncRedisConn::Del(const std::vector<std::string>& keys) {
+
+    std::vector<std::string> argv;
+    argv.reserve(keys.size() + 1);
+    argv.push_back("DEL");
+    argv.insert(argv.end(), keys.begin(), keys.end());
+    return command<int>(std::move(argv), reply_int);
+}
+
+Future<bool> AsyncRedisConn::Set(const std::string& key, int64_t value, int expire) {
+    return Set(key, StrUtil::to_string(value), expire);
+}
+
+Future<bool> AsyncRedisConn::Set(const std::string& key, const std::string& value, int expire) {
+
+    if (expire > 0)
+        return command<bool>({ "SET", key, value, "EX", StrUtil::to_string(expire) }, reply_ok);
+    return command<bool>({ "SET", key, value }, reply_ok);
+}
+
+Future<std::vector<std::string>> AsyncRedisConn::MGet(const std::vector<std::string>& keys,
+                                                      const std::string& nil_value) {
+
+    std::vector<std::string> argv;
+    argv.reserve(keys.size() + 1);
+    argv.push_back("MGET");
+    argv.insert(argv.end(), keys.begin(), keys.end());
+
+    return command<std::vector<std::string>>(std::move(argv), [nil_value](const redisReply* reply) {
+        std::vector<std::string> values;
+        if (!reply || reply->type != REDIS_REPLY_ARRAY)
+            return values;
+
+        values.reserve(reply->elements);
+        for (size_t index = 0; index < reply->elements; index++) {
+            boost::optional<std::string> value = reply_string(reply->element[index]);
+            values.push_back(value ? *value : nil_value);
+        }
+        return values;
+    });
+}
+
+Future<std::vector<int64_t>> AsyncRedisConn::MGetInt(const std::vector<std::string>& keys,
+                                                     int64_t nil_value) {
+
+    std::vector<std::string> argv;
+    argv.reserve(keys.size() + 1);
+    argv.push_back("MGET");
+    argv.insert(argv.end(), keys.begin(), keys.end());
+
+    return command<std::vector<int64_t>>(std::move(argv), [nil_value](const redisReply* reply) {
+        std::vector<int64_t> values;
+        if (!reply || reply->type != REDIS_REPLY_ARRAY)
+            return values;
+
+        values.reserve(reply->elements);
+        for (size_t index = 0; index < reply->elements; index++) {
+            boost::optional<int64_t> value = reply_int64(reply->element[index]);
+            values.push_back(value ? *value : nil_value);
+        }
+        return values;
+    });
+}
+
+Future<bool> AsyncRedisConn::MSet(const std::vector<std::string>& keys,
+                                  const std::vector<std::string>& values) {
+
+    if (keys.empty() || keys.size() != values.size()) {
+        log_err("param error");
+        Promise<bool> promise;
+        promise.set_value(false);
+        return promise.get_future();
+    }
+
+    std::vector<std::string> argv;
+    argv.reserve(keys.size() * 2 + 1);
+    argv.push_back("MSET");
+    for (size_t index = 0; index < keys.size(); index++) {
+        argv.push_back(keys[index]);
+        argv.push_back(values[index]);
+    }
+
+    return command<bool>(std::move(argv), reply_ok);
+}
+
+Future<boost::optional<int64_t>> AsyncRedisConn::Incr(const std::string& key) {
+    return command<boost::optional<int64_t>>({ "INCR", key }, reply_integer);
+}
+
+Future<boost::optional<int64_t>> AsyncRedisConn::IncrBy(const std::string& key, int64_t value) {
+    return command<boost::optional<int64_t>>({ "INCRBY", key, StrUtil::to_string(value) }, reply_integer);
+}
+
+Future<boost::optional<int64_t>> AsyncRedisConn::HIncrBy(const std::string& key, const std::string& hkey, int64_t value) {
+    return command<boost::optional<int64_t>>({ "HINCRBY", key, hkey, StrUtil::to_string(value) }, reply_integer);
+}
+
+Future<boost::optional<int64_t>> AsyncRedisConn::Decr(const std::string& key) {
+    return command<boost::optional<int64_t>>({ "DECR", key }, reply_integer);
+}
+
+Future<boost::optional<int64_t>> AsyncRedisConn::DecrBy(const std::string& key, int64_t value) {
+    return command<boost::optional<int64_t>>({ "DECRBY", key, StrUtil::to_string(value) }, reply_integer);
+}
+
+Future<int> AsyncRedisConn::Expire(const std::string& key, int expire) {
+
+    if (key.empty() || expire < 0) {
+        Promise<int> promise;
+        promise.set_value(-1);
+        return promise.get_future();
+    }
+
+    return command<int>({ "EXPIRE", key, StrUtil::to_string(expire) }, [](const redisReply* reply) {
+        return reply && reply->type == REDIS_REPLY_INTEGER ? static_cast<int>(reply->integer) : -2;
+    });
+}
+
+Future<int> AsyncRedisConn::HSet(const std::string& key, const std::string& hkey, const std::string& value) {
+    return command<int>({ "HSET", key, hkey, value }, reply_int);
+}
+
+Future<boost::optional<std::string>> AsyncRedisConn::HGet(const std::string& key, const std::string& hkey) {
+    return command<boost::optional<std::string>>({ "HGET", key, hkey }, reply_string);
+}
+
+Future<std::map<std::string, std::string>> AsyncRedisConn::HGetAll(const std::string& key) {
+
+    typedef std::map<std::string, std::string> ResultType;
+    return command<ResultType>({ "HGETALL", key }, [](const redisReply* reply) {
+        ResultType values;
+        if (!reply || reply->type != REDIS_REPLY_ARRAY)
+            return values;
+
+        for (size_t index = 0; index + 1 < reply->elements; index += 2) {
+            boost::optional<std::string> field = reply_string(reply->element[index]);
+            boost::optional<std::string> value = reply_string(reply->element[index + 1]);
+            if (field && value)
+                values[*field] = *value;
+        }
+        return values;
+    });
+}
+
+Future<int> AsyncRedisConn::LPush(const std::string& key, const std::string& value) {
+    return command<int>({ "LPUSH", key, value }, reply_int);
+}
+
+Future<boost::optional<std::string>> AsyncRedisConn::RPop(const std::string& key) {
+    return command<boost::optional<std::string>>({ "RPOP", key }, reply_string);
+}
+
+} // end namespace roo
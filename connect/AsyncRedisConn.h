@@ -0,0 +1,165 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+
+#ifndef __ROO_CONNECT_ASYNC_REDIS_CONN_H__
+#define __ROO_CONNECT_ASYNC_REDIS_CONN_H__
+
+#include <map>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <hiredis/hiredis.h>
+#include <hiredis/async.h>
+
+#include <boost/optional.hpp>
+
+#include <connect/RedisConn.h>
+#include <concurrency/IoService.h>
+#include <concurrency/Future.h>
+
+// 非阻塞的Redis连接
+//
+// redisAsyncContext的读写事件挂在IoService的io_service上，所有对hiredis的调用
+// 都在io_service线程中进行，其他线程发起的命令会被post过去。命令在连接上流水线
+// 发送，结果通过回调或者Future返回，少量的连接就可以支撑大量的并发请求。
+//
+// 回调和Future的后续任务在io_service线程中执行，不要在其中做阻塞的操作。
+// 出错(连接断开、错误应答)的时候回调得到空的redisReply_ptr，和RedisConn::Exec一致。
+//
+// 连接建立之后由hiredis的context持有，需要调用close()或者等连接断开之后才会释放。
+
+namespace roo {
+
+class AsyncRedisConn;
+typedef std::shared_ptr<AsyncRedisConn> async_redis_conn_ptr;
+
+class AsyncRedisConn : public std::enable_shared_from_this<AsyncRedisConn> {
+public:
+    typedef std::function<void(const redisReply_ptr& reply)> ReplyCallback;
+
+    AsyncRedisConn(IoService& io_service, const RedisConnPoolHelper& helper) :
+        io_service_(io_service),
+        helper_(helper),
+        context_(NULL),
+        connect_promise_(),
+        self_(),
+        connected_(false),
+        disconnected_(false),
+        pending_(0) {
+    }
+
+    ~AsyncRedisConn();
+
+    // 禁止拷贝
+    AsyncRedisConn(const AsyncRedisConn&) = delete;
+    AsyncRedisConn& operator=(const AsyncRedisConn&) = delete;
+
+    // 建立连接，完成AUTH和SELECT之后返回，io_service需要已经运行
+    bool init(uint32_t timeout_ms = 5000);
+
+    // 断开连接，已经发出的命令收到应答之后才真正断开
+    void close();
+
+    bool is_health() const {
+        return connected_ && !disconnected_;
+    }
+
+    // 已经发出还没有收到应答的命令数
+    size_t pending() const {
+        return pending_.load();
+    }
+
+    // 原始命令，回调在io_service线程中执行
+    void ExecV(const std::vector<std::string>& argv, const ReplyCallback& callback);
+    Future<redisReply_ptr> ExecV(const std::vector<std::string>& argv);
+
+public:
+
+    // 和RedisConn对应的命令封装，失败的含义也保持一致
+
+    Future<bool> Exists(const std::string& key);
+
+    // GET  nil或者失败返回boost::none
+    Future<boost::optional<std::string>> Get(const std::string& key);
+    Future<boost::optional<int64_t>> GetInt(const std::string& key);
+
+    // DEL  返回被删除 key 的数量，失败返回-1
+    Future<int> Del(const std::string& key);
+    Future<int> Del(const std::vector<std::string>& keys);
+
+    // SET
+    Future<bool> Set(const std::string& key, int64_t value, int expire = -1);
+    Future<bool> Set(const std::string& key, const std::string& value, int expire = -1);
+
+    // MGET  失败的时候返回空的数组
+    Future<std::vector<std::string>> MGet(const std::vector<std::string>& keys, const std::string& nil_value = "");
+    Future<std::vector<int64_t>> MGetInt(const std::vector<std::string>& keys, int64_t nil_value = 0);
+
+    // MSET
+    Future<bool> MSet(const std::vector<std::string>& keys, const std::vector<std::string>& values);
+
+    // INCR/DECR
+    Future<boost::optional<int64_t>> Incr(const std::string& key);
+    Future<boost::optional<int64_t>> IncrBy(const std::string& key, int64_t value);
+    Future<boost::optional<int64_t>> HIncrBy(const std::string& key, const std::string& hkey, int64_t value);
+    Future<boost::optional<int64_t>> Decr(const std::string& key);
+    Future<boost::optional<int64_t>> DecrBy(const std::string& key, int64_t value);
+
+    // Expire 设置成功返回 1
+    Future<int> Expire(const std::string& key, int expire);
+
+    // HSet  新建字段返回 1，覆盖返回 0，失败返回-1
+    Future<int> HSet(const std::string& key, const std::string& hkey, const std::string& value);
+
+    // HGet
+    Future<boost::optional<std::string>> HGet(const std::string& key, const std::string& hkey);
+
+    // HGetAll  失败的时候返回空的map
+    Future<std::map<std::string, std::string>> HGetAll(const std::string& key);
+
+    // List
+    // 执行 LPUSH 命令后，列表的长度，失败返回-1
+    Future<int> LPush(const std::string& key, const std::string& value);
+    Future<boost::optional<std::string>> RPop(const std::string& key);
+
+private:
+
+    // 发送命令并用parser在io_service线程中解析应答
+    template<typename T>
+    Future<T> command(std::vector<std::string>&& argv,
+                      std::function<T(const redisReply* reply)> parser);
+
+    void send_command(std::vector<std::string>& argv, const ReplyCallback& callback);
+
+    void do_connect(const Promise<bool>& promise);
+    void do_close();
+
+    static void on_connect(const redisAsyncContext* context, int status);
+    static void on_disconnect(const redisAsyncContext* context, int status);
+    static void on_reply(redisAsyncContext* context, void* reply, void* privdata);
+
+    IoService& io_service_;
+    const RedisConnPoolHelper helper_;
+
+    // 只在io_service线程中访问
+    redisAsyncContext* context_;
+    Promise<bool> connect_promise_;
+    std::shared_ptr<AsyncRedisConn> self_;
+
+    std::atomic<bool>   connected_;
+    std::atomic<bool>   disconnected_;
+    std::atomic<size_t> pending_;
+};
+
+
+} // end namespace roo
+
+#endif // __ROO_CONNECT_ASYNC_REDIS_CONN_H__
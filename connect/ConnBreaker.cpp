@@ -0,0 +1,156 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <random>
+#include <sstream>
+
+#include <other/Log.h>
+#include <connect/ConnBreaker.h>
+
+namespace roo {
+
+ConnBreaker::ConnBreaker(const ConnBreakerConf& conf) :
+    lock_(),
+    probe_done_(),
+    conf_(conf),
+    failures_(0),
+    suspect_(false),
+    probing_(false),
+    next_attempt_(),
+    rejected_(0),
+    open_count_(0) {
+}
+
+void ConnBreaker::set_conf(const ConnBreakerConf& conf) {
+    std::lock_guard<std::mutex> lock(lock_);
+    conf_ = conf;
+    if (conf_.failure_threshold_ == 0)
+        conf_.failure_threshold_ = 1;
+}
+
+ConnBreakerConf ConnBreaker::get_conf() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return conf_;
+}
+
+uint32_t ConnBreaker::backoff_ms(uint32_t failures) const {
+
+    if (failures < conf_.failure_threshold_)
+        return 0;
+
+    uint32_t shift = failures - conf_.failure_threshold_;
+    uint64_t backoff = conf_.base_backoff_ms_;
+    if (shift >= 32 || (backoff << shift) > conf_.max_backoff_ms_) {
+        backoff = conf_.max_backoff_ms_;
+    } else {
+        backoff <<= shift;
+    }
+
+    if (backoff < 2)
+        return static_cast<uint32_t>(backoff);
+
+    // 抖动避免多个进程在同一时刻重试
+    static thread_local std::mt19937 engine(std::random_device{}());
+    std::uniform_int_distribution<uint64_t> dist(backoff / 2, backoff);
+    return static_cast<uint32_t>(dist(engine));
+}
+
+ConnBreaker::Permit ConnBreaker::acquire() {
+
+    if (failures_.load(std::memory_order_acquire) == 0 &&
+        !suspect_.load(std::memory_order_acquire))
+        return kProceed;
+
+    std::unique_lock<std::mutex> lock(lock_);
+    auto deadline = Clock::now() + std::chrono::milliseconds(conf_.wait_ms_);
+
+    while (true) {
+
+        if (failures_.load() == 0 && !suspect_.load())
+            return kProceed;
+
+        if (probing_) {
+            if (probe_done_.wait_until(lock, deadline) == std::cv_status::timeout && probing_) {
+                ++rejected_;
+                return kReject;
+            }
+            continue;
+        }
+
+        if (Clock::now() < next_attempt_) {
+            ++rejected_;
+            return kReject;
+        }
+
+        probing_ = true;
+        return kProbe;
+    }
+}
+
+void ConnBreaker::release(Permit permit, bool success) {
+
+    if (permit == kReject)
+        return;
+
+    if (success && permit == kProceed && failures_.load() == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    if (permit == kProbe)
+        probing_ = false;
+
+    if (success) {
+        // 只有探测成功才解除suspect
+        if (permit == kProbe)
+            suspect_.store(false, std::memory_order_release);
+        if (failures_.load() != 0) {
+            log_info("connect recovered after %u failures.", failures_.load());
+            failures_.store(0, std::memory_order_release);
+        }
+    } else {
+        uint32_t failures = failures_.load() + 1;
+        failures_.store(failures);
+
+        uint32_t backoff = backoff_ms(failures);
+        next_attempt_ = Clock::now() + std::chrono::milliseconds(backoff);
+        if (failures >= conf_.failure_threshold_) {
+            ++open_count_;
+            log_warning("connect failed %u times, breaker open for %u ms.", failures, backoff);
+        }
+    }
+
+    probe_done_.notify_all();
+}
+
+bool ConnBreaker::is_open() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return failures_.load() >= conf_.failure_threshold_ && Clock::now() < next_attempt_;
+}
+
+std::string ConnBreaker::to_string() const {
+
+    std::stringstream ss;
+    ss << "open:" << (is_open() ? "true" : "false")
+       << " failures:" << failures()
+       << " rejected:" << rejected()
+       << " open_count:" << open_count();
+    return ss.str();
+}
+
+std::string ConnBreaker::to_json() const {
+
+    std::stringstream ss;
+    ss << "{\"open\":" << (is_open() ? "true" : "false")
+       << ",\"failures\":" << failures()
+       << ",\"rejected\":" << rejected()
+       << ",\"open_count\":" << open_count()
+       << "}";
+    return ss.str();
+}
+
+} // roo
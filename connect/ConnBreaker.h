@@ -0,0 +1,114 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __ROO_CONNECT_CONN_BREAKER_H__
+#define __ROO_CONNECT_CONN_BREAKER_H__
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <condition_variable>
+
+#include <stdint.h>
+
+// 建立连接的熔断器，每个连接池一个
+//
+// 没有失败记录的时候acquire()只有一次原子读，建立连接不受限制。出现失败或者发现已有
+// 的连接断开(suspect())之后，同一时间只允许一个线程去探测重连(single-flight)，其他线程最多等待wait_ms_看探测的结果：
+// 成功则各自去重连，失败或者等待超时则直接返回失败。连续失败达到failure_threshold_
+// 之后熔断打开，下一次探测的时间按照指数退避并加上随机抖动，期间所有请求立即失败，
+// 避免服务端故障切换的时候所有的工作线程同时同步地重连。
+
+namespace roo {
+
+struct ConnBreakerConf {
+
+    ConnBreakerConf() :
+        failure_threshold_(3),
+        base_backoff_ms_(100),
+        max_backoff_ms_(10000),
+        wait_ms_(200) {
+    }
+
+    uint32_t failure_threshold_;   // 连续失败多少次之后熔断
+    uint32_t base_backoff_ms_;     // 熔断之后第一次退避的时长，之后每次加倍
+    uint32_t max_backoff_ms_;      // 退避的上限
+    uint32_t wait_ms_;             // 等待其他线程探测结果的最长时间，0表示不等待
+};
+
+
+class ConnBreaker {
+
+    // 禁止拷贝
+    ConnBreaker(const ConnBreaker&) = delete;
+    ConnBreaker& operator=(const ConnBreaker&) = delete;
+
+public:
+
+    enum Permit {
+        kReject  = 0,    // 熔断中或者探测失败，直接返回失败
+        kProceed = 1,    // 可以建立连接
+        kProbe   = 2,    // 由当前线程负责探测，完成之后必须release()
+    };
+
+    explicit ConnBreaker(const ConnBreakerConf& conf = ConnBreakerConf());
+
+    void set_conf(const ConnBreakerConf& conf);
+    ConnBreakerConf get_conf() const;
+
+    // 建立连接之前调用，可能阻塞最多wait_ms_
+    Permit acquire();
+
+    // 报告建立连接的结果，kReject不需要调用
+    void release(Permit permit, bool success);
+
+    // 发现已有的连接断开，之后的acquire()先由一个线程探测，探测成功之前其他线程等待
+    void suspect() {
+        suspect_.store(true, std::memory_order_release);
+    }
+
+    bool is_open() const;
+
+    uint32_t failures() const {
+        return failures_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t rejected() const {
+        return rejected_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t open_count() const {
+        return open_count_.load(std::memory_order_relaxed);
+    }
+
+    std::string to_string() const;
+    std::string to_json() const;
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    // 带抖动的退避时长，在[d/2, d]之间均匀分布
+    uint32_t backoff_ms(uint32_t failures) const;
+
+    mutable std::mutex lock_;
+    std::condition_variable probe_done_;
+    ConnBreakerConf conf_;
+
+    std::atomic<uint32_t> failures_;     // 连续失败的次数，0表示健康
+    std::atomic<bool>     suspect_;      // 有连接断开，还没有探测过
+    bool                  probing_;      // 是否有线程正在探测
+    Clock::time_point     next_attempt_;
+
+    std::atomic<uint64_t> rejected_;     // 快速失败的次数
+    std::atomic<uint64_t> open_count_;   // 熔断打开的次数
+};
+
+} // end namespace roo
+
+#endif // __ROO_CONNECT_CONN_BREAKER_H__
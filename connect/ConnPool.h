@@ -11,74 +11,149 @@
 
 #include <xtra_rhel.h>
 
-#include <set>
 #include <deque>
+#include <vector>
+#include <memory>
 #include <numeric>
+#include <algorithm>
+#include <functional>
 
-#include <boost/circular_buffer.hpp>
-
+#include <atomic>
+#include <thread>
+#include <mutex>
 #include <condition_variable>
 #include <chrono>
 
-#include <other/Log.h>
-
-//#include <Utils/Timer.h>
+#include <libconfig/libconfig.h++>
 
+#include <other/Log.h>
+#include <other/Histogram.h>
+#include <concurrency/Timer.h>
+#include <connect/ConnBreaker.h>
+
+// 连接池
+//
+// 空闲的连接存放在一个固定大小的槽位数组中，通过带版本号的无锁栈进行组织，
+// 另外按照线程分散了若干个缓存槽位，同一个线程释放之后再次申请通常可以直接
+// 拿到刚才的连接，其他线程在空闲栈为空的时候也可以从这些缓存槽位中窃取。
+//
+// 连接被占用的时候池子不再持有它，只记录计数；连接耗尽时申请者进入FIFO的等待
+// 队列，释放者直接把连接交给队首的等待者并只唤醒它一个。
+//
+// 通过start_maintenance()可以在Timer上挂一个周期性的维护任务：启动时预热
+// min_idle_个连接，之后淘汰闲置超过linger的多余连接，对闲置较久的连接发送ping
+// 保活，避免被服务端超时断开之后第一个请求还要重新建立连接。
+//
+// 构造时的capacity是连接数的硬上限(槽位按此分配)，实际允许的连接数limit_可以
+// 通过set_elastic()设置上下限，由维护任务根据窗口内申请等待的p99和空闲比例自动
+// 伸缩，也可以通过Setting的回调在运行时调整。
+//
+// 建立连接(创建新连接以及连接类型自己的断线重连)都经过池子的ConnBreaker，服务端
+// 故障期间只有一个线程按照退避的节奏去探测，其余的申请快速失败。
 
 namespace roo {
 
-template<typename T>
-struct conn_ptr_compare {
-public:
-    typedef std::shared_ptr<T> ConnPtr;
-
-    bool operator ()(const ConnPtr& lhs,
-                     const ConnPtr& rhs) const {
-        return (lhs.get() < rhs.get());
-    }
-};
-
-
 struct ConnStat {
 
-    uint32_t start_;             // touch
+    uint32_t start_;             // touch，最近一次被归还的时间
+    uint32_t alive_;             // 最近一次确认连接可用的时间(归还或者ping)
+    int64_t  lend_us_;           // 被借出的时间，用于统计持有时长
+
+    static uint32_t now() {
+        return static_cast<uint32_t>(::time(NULL) & 0xFFFFFFFFL);
+    }
 
     void touch() {
-        start_ = static_cast<uint32_t>(::time(NULL) & 0xFFFFFFFFL);
+        start_ = alive_ = now();
     }
 
-    bool expire(uint32_t linger) {
+    void touch_alive() {
+        alive_ = now();
+    }
 
-        time_t elapse = ::time(NULL) - start_;
-        ignore_unused(elapse);
+    // 闲置超过linger秒
+    bool expire(uint32_t linger) {
+        return now() - start_ >= linger;
+    }
 
-        return static_cast<uint32_t>(::time(NULL) & 0xFFFFFFFFL) > linger;
+    // 超过keepalive秒没有确认过连接的可用性
+    bool need_keepalive(uint32_t keepalive) {
+        return now() - alive_ >= keepalive;
     }
 
     ConnStat() :
-        start_() {
+        start_(), alive_(), lend_us_() {
         touch();
     }
 }  __attribute__((aligned(4)));
 
 
-struct ConnPoolStat {
-    uint32_t acquired_count_;    // 总请求计数
-    uint32_t acquired_success_;  // 成功请求的数量
+// 连接池后台维护的配置
+struct ConnPoolMaintain {
 
-    void incr_count() {
-        ++acquired_count_;
+    ConnPoolMaintain() :
+        min_idle_(0),
+        keepalive_sec_(0),
+        interval_ms_(1000) {
     }
 
-    void incr_success() {
-        ++acquired_success_;
+    size_t   min_idle_;        // 至少保留的空闲连接数，启动时进行预热
+    uint32_t keepalive_sec_;   // 空闲超过该时长进行ping，0表示不检查，应当小于服务端的超时
+    uint32_t interval_ms_;     // 维护任务的执行间隔
+};
+
+
+// 连接池弹性伸缩的配置，max_conn_为0表示不启用
+struct ConnPoolElastic {
+
+    ConnPoolElastic() :
+        min_conn_(0),
+        max_conn_(0),
+        target_wait_us_(5000),
+        shrink_idle_ratio_(0.5),
+        shrink_rounds_(30) {
     }
 
+    size_t   min_conn_;
+    size_t   max_conn_;            // 不能超过构造时的capacity
+    uint64_t target_wait_us_;      // 窗口内申请等待的p99超过该值并且连接已满的时候扩容
+    double   shrink_idle_ratio_;   // 空闲比例连续shrink_rounds_个维护周期不低于该值的时候缩容
+    uint32_t shrink_rounds_;
+};
+
+
+// 连接池的运行统计，计数器和延迟分布都可以并发更新，时间单位为微秒
+struct ConnPoolStat {
+
     ConnPoolStat() :
         acquired_count_(0),
-        acquired_success_(0) {
+        acquired_success_(0),
+        timeout_count_(0),
+        create_count_(0),
+        create_failed_(0),
+        drop_count_(0),
+        trim_count_(0),
+        acquire_wait_us_(),
+        hold_us_(),
+        create_us_() {
     }
-}  __attribute__((aligned(4)));
+
+    // 禁止拷贝
+    ConnPoolStat(const ConnPoolStat&) = delete;
+    ConnPoolStat& operator=(const ConnPoolStat&) = delete;
+
+    std::atomic<uint64_t> acquired_count_;    // 总请求计数
+    std::atomic<uint64_t> acquired_success_;  // 成功请求的数量
+    std::atomic<uint64_t> timeout_count_;     // 失败的请求，包括等待超时、不等待时没有可用连接以及创建失败
+    std::atomic<uint64_t> create_count_;      // 成功创建的连接
+    std::atomic<uint64_t> create_failed_;     // 创建或者初始化失败的连接
+    std::atomic<uint64_t> drop_count_;        // 因为不健康(归还时或者ping失败)被丢弃的连接
+    std::atomic<uint64_t> trim_count_;        // 因为闲置被淘汰的连接
+
+    Histogram acquire_wait_us_;   // 成功申请到连接的等待时长
+    Histogram hold_us_;           // 连接被借出到归还的时长
+    Histogram create_us_;         // 创建并初始化连接的时长
+};
 
 
 template<typename T, typename Helper>
@@ -86,24 +161,47 @@ class ConnPool : public std::enable_shared_from_this<ConnPool<T, Helper> > {
 public:
     typedef std::shared_ptr<T> ConnPtr;
     typedef std::weak_ptr<T> ConnWeakPtr;
-    typedef std::set<ConnPtr, conn_ptr_compare<T> > ConnContainer;
 
 public:
     explicit ConnPool(std::string pool_name, size_t capacity, Helper helper,
                       uint32_t linger_sec = 0) :
         pool_name_(pool_name), capacity_(capacity),
         helper_(helper),
-        conns_busy_(), conns_idle_(),
-        conn_notify_(), conn_notify_mutex_(),
+        slots_(),
+        free_slots_(kNilTagged),
+        idle_slots_(kNilTagged),
+        total_(0), busy_(0),
+        waiters_(0), waiters_mutex_(), waiters_queue_(),
         stat_(),
-        conn_trim_linger_(linger_sec) {
+        conn_trim_linger_(linger_sec),
+        maintain_(),
+        maintain_guard_(),
+        maintain_timer_(),
+        limit_(capacity),
+        elastic_lock_(),
+        elastic_(),
+        window_wait_us_(),
+        shrink_streak_(0),
+        breaker_() {
 
         SAFE_ASSERT(capacity_);
         log_info("ConnPool Maxium Capacity: %lu", capacity_);
+
+        // 连接总数不超过capacity_，所以空闲的连接总能找到槽位
+        slots_.reset(new Slot[capacity_]);
+        for (size_t i = 0; i < capacity_; ++i) {
+            push_slot(free_slots_, static_cast<uint32_t>(i));
+        }
+
+        for (size_t i = 0; i < kCacheStripes; ++i) {
+            cache_slots_[i].index_.store(kNil);
+        }
+
         return;
     }
 
     virtual ~ConnPool() {
+        stop_maintenance();
         log_info("ConnPool Destructed, name: %s, capacity: %lu",
                  pool_name_.c_str(), capacity_);
     }
@@ -127,39 +225,161 @@ public:
             log_err("initialized ping test failed.");
             return false;
         }
-        
+
         return true;
     }
 
-    // 由于会返回nullptr，所以不能返回引用
-    ConnPtr request_conn() {
+    // 预热连接并在timer上启动周期性的维护任务，timer需要比连接池的生命周期长
+    bool start_maintenance(Timer& timer, const ConnPoolMaintain& maintain) {
 
-        stat_.incr_count();
-        std::unique_lock<std::mutex> lock(conn_notify_mutex_);
+        if (maintain_timer_) {
+            log_err("pool %s maintenance already started.", pool_name_.c_str());
+            return false;
+        }
 
-        while (!do_check_available()) {
-            conn_notify_.wait(lock);
+        maintain_ = maintain;
+        if (maintain_.min_idle_ > capacity_)
+            maintain_.min_idle_ = capacity_;
+
+        size_t warmed = do_conn_replenish(0);
+        log_info("pool %s prewarmed %lu conns.", pool_name_.c_str(), warmed);
+
+        maintain_guard_ = std::make_shared<MaintainGuard>();
+        std::shared_ptr<MaintainGuard> guard = maintain_guard_;
+        maintain_timer_ = timer.add_better_timer(
+            [this, guard](const boost::system::error_code& ec) {
+                std::lock_guard<std::mutex> lock(guard->lock_);
+                if (guard->alive_)
+                    do_conn_maintenance();
+            },
+            maintain_.interval_ms_, true);
+
+        if (!maintain_timer_) {
+            log_err("pool %s add maintenance timer failed.", pool_name_.c_str());
+            maintain_guard_.reset();
+            return false;
         }
 
-        return do_request_conn();
+        return true;
     }
 
-    ConnPtr try_request_conn(size_t msec)  {
+    // 停止之后保证维护任务不会再运行
+    void stop_maintenance() {
 
-        ConnPtr conn;
-        stat_.incr_count();
-        std::unique_lock<std::mutex> lock(conn_notify_mutex_);
+        if (maintain_guard_) {
+            std::lock_guard<std::mutex> lock(maintain_guard_->lock_);
+            maintain_guard_->alive_ = false;
+        }
 
-        if (!do_check_available() && !msec)
-            return conn; // nullptr
+        if (maintain_timer_) {
+            maintain_timer_->revoke_timer();
+            maintain_timer_.reset();
+        }
 
-        // timed_wait not work with 0
-        if (do_check_available() || conn_notify_.wait_for(lock, std::chrono::milliseconds(msec))) {
-            typename ConnContainer::iterator it;
-            return do_request_conn();
+        maintain_guard_.reset();
+    }
+
+    // 设置连接数的弹性范围，伸缩由维护任务执行
+    bool set_elastic(const ConnPoolElastic& elastic) {
+
+        if (!check_elastic(elastic))
+            return false;
+
+        std::lock_guard<std::mutex> lock(elastic_lock_);
+        elastic_ = elastic;
+        shrink_streak_ = 0;
+
+        size_t old_limit = limit_.load();
+        size_t limit = capacity_;
+        if (elastic_.max_conn_) {
+            limit = limit_.load();
+            if (limit < elastic_.min_conn_)
+                limit = elastic_.min_conn_;
+            if (limit > elastic_.max_conn_)
+                limit = elastic_.max_conn_;
         }
+        limit_.store(limit);
 
-        return conn;
+        log_info("pool %s elastic min %lu, max %lu, current limit %lu.",
+                 pool_name_.c_str(), elastic_.min_conn_, elastic_.max_conn_, limit);
+
+        // 上限提高之后等待者可以去创建连接了
+        for (size_t i = old_limit; i < limit; ++i)
+            wakeup_waiter();
+        return true;
+    }
+
+    // 作为Setting的回调，读取conn_pool.<pool_name>下的配置项，没有配置的项保持不变
+    // 所有的配置项都检查通过之后才会一起生效，否则全部不生效
+    int update_runtime_setting(const libconfig::Config& setting) {
+
+        ConnPoolElastic elastic;
+        {
+            std::lock_guard<std::mutex> lock(elastic_lock_);
+            elastic = elastic_;
+        }
+
+        const std::string prefix = "conn_pool." + pool_name_ + ".";
+        int min_conn = 0, max_conn = 0, target_wait_us = 0, shrink_rounds = 0;
+        double shrink_idle_ratio = 0;
+
+        if (setting.lookupValue(prefix + "min_conn", min_conn) && min_conn >= 0)
+            elastic.min_conn_ = min_conn;
+        if (setting.lookupValue(prefix + "max_conn", max_conn) && max_conn >= 0)
+            elastic.max_conn_ = max_conn;
+        if (setting.lookupValue(prefix + "target_wait_us", target_wait_us) && target_wait_us > 0)
+            elastic.target_wait_us_ = target_wait_us;
+        if (setting.lookupValue(prefix + "shrink_idle_ratio", shrink_idle_ratio))
+            elastic.shrink_idle_ratio_ = shrink_idle_ratio;
+        if (setting.lookupValue(prefix + "shrink_rounds", shrink_rounds) && shrink_rounds > 0)
+            elastic.shrink_rounds_ = shrink_rounds;
+
+        ConnBreakerConf breaker = breaker_.get_conf();
+        int failure_threshold = 0, base_backoff_ms = 0, max_backoff_ms = 0, reconnect_wait_ms = 0;
+
+        if (setting.lookupValue(prefix + "failure_threshold", failure_threshold) && failure_threshold > 0)
+            breaker.failure_threshold_ = failure_threshold;
+        if (setting.lookupValue(prefix + "base_backoff_ms", base_backoff_ms) && base_backoff_ms > 0)
+            breaker.base_backoff_ms_ = base_backoff_ms;
+        if (setting.lookupValue(prefix + "max_backoff_ms", max_backoff_ms) && max_backoff_ms > 0)
+            breaker.max_backoff_ms_ = max_backoff_ms;
+        if (setting.lookupValue(prefix + "reconnect_wait_ms", reconnect_wait_ms) && reconnect_wait_ms >= 0)
+            breaker.wait_ms_ = reconnect_wait_ms;
+
+        if (!check_elastic(elastic))
+            return -1;
+
+        if (breaker.base_backoff_ms_ > breaker.max_backoff_ms_) {
+            log_err("pool %s invalid breaker setting, base_backoff %u ms, max_backoff %u ms.",
+                    pool_name_.c_str(), breaker.base_backoff_ms_, breaker.max_backoff_ms_);
+            return -1;
+        }
+
+        breaker_.set_conf(breaker);
+        return set_elastic(elastic) ? 0 : -1;
+    }
+
+    void set_breaker(const ConnBreakerConf& conf) {
+        breaker_.set_conf(conf);
+    }
+
+    // 连接类型断线重连的时候也需要经过熔断器
+    ConnBreaker& breaker() {
+        return breaker_;
+    }
+
+    size_t get_limit() const {
+        return limit_.load();
+    }
+
+    // 由于会返回nullptr，所以不能返回引用
+    // 使用完之后需要调用free_conn归还
+    ConnPtr request_conn() {
+        return do_acquire(-1);
+    }
+
+    ConnPtr try_request_conn(size_t msec)  {
+        return do_acquire(static_cast<int64_t>(msec));
     }
 
     bool request_scoped_conn(ConnPtr& scope_conn) {
@@ -167,15 +387,9 @@ public:
         // reset first, all will stack at reset latter...
         // probably recursive require conn_nofity_mutex problem
 
-        stat_.incr_count();
         scope_conn.reset();
-        std::unique_lock<std::mutex> lock(conn_notify_mutex_);
-
-        while (!do_check_available()) {
-            conn_notify_.wait(lock);
-        }
 
-        ConnPtr conn = do_request_conn();
+        ConnPtr conn = do_acquire(-1);
         if (conn) {
             scope_conn.reset(conn.get(),
                              std::bind(&ConnPool::free_conn,
@@ -188,31 +402,47 @@ public:
 
     void free_conn(ConnPtr conn) {
 
-        {
-            std::lock_guard<std::mutex> lock(conn_notify_mutex_);
+        --busy_;
+        int64_t hold = now_us() - conn->lend_us_;
+        stat_.hold_us_.record(hold > 0 ? hold : 0);
 
-            // 如果健康，则将其丢回连接池中，否则直接丢弃
-            if (conn->is_health()) {
-                conns_idle_.push_back(conn);
-            } else {
-                log_err("connect not ok, drop it away");
-            }
+        // 如果健康，则将其丢回连接池中，否则直接丢弃
+        if (!conn->is_health()) {
+            log_err("connect not ok, drop it away");
+            conn.reset();
+            --total_;
+            ++stat_.drop_count_;
+
+            // 服务端可能已经故障，之后新建连接先由一个线程探测
+            breaker_.suspect();
 
-            conns_busy_.erase(conn);
+            // 空出了容量，让等待者去创建新的连接
+            wakeup_waiter();
+            return;
         }
 
-        conn_notify_.notify_all();
-        return;
+        // 缩容之后超出的连接在归还的时候关闭
+        if (total_.load() > limit_.load()) {
+            conn.reset();
+            --total_;
+            ++stat_.trim_count_;
+            wakeup_waiter();
+            return;
+        }
+
+        conn->touch();
+        put_idle(std::move(conn));
+        wakeup_waiter();
     }
 
     size_t get_busy_size() {
-        std::lock_guard<std::mutex> lock(conn_notify_mutex_);
-        return conns_busy_.size();
+        return busy_.load();
     }
 
-    size_t get_idle_size() {
-        std::lock_guard<std::mutex> lock(conn_notify_mutex_);
-        return conns_idle_.size();
+    size_t get_idle_size() const {
+        size_t total = total_.load();
+        size_t busy = busy_.load();
+        return total > busy ? total - busy : 0;
     }
 
     size_t get_capacity() const {
@@ -220,61 +450,324 @@ public:
     }
 
     std::string module_status() const {
+        return pool_name_ + ":\n" + status_string();
+    }
+
+    // 机器可读的统计输出，延迟的单位为微秒
+    std::string module_metrics() const {
 
         std::stringstream ss;
 
-        ss << "\t" << "capacity: " << capacity_ << std::endl;
-        ss << "\t" << "acquire_count: " << stat_.acquired_count_ << std::endl;
-        ss << "\t" << "acquire_success:" << stat_.acquired_success_ << std::endl;
+        ss << "{\"pool\":\"" << pool_name_ << "\""
+           << ",\"capacity\":" << capacity_
+           << ",\"limit\":" << limit_.load()
+           << ",\"busy\":" << busy_.load()
+           << ",\"idle\":" << get_idle_size()
+           << ",\"waiters\":" << waiters_.load()
+           << ",\"acquire_count\":" << stat_.acquired_count_.load()
+           << ",\"acquire_success\":" << stat_.acquired_success_.load()
+           << ",\"timeout_count\":" << stat_.timeout_count_.load()
+           << ",\"create_count\":" << stat_.create_count_.load()
+           << ",\"create_failed\":" << stat_.create_failed_.load()
+           << ",\"drop_count\":" << stat_.drop_count_.load()
+           << ",\"trim_count\":" << stat_.trim_count_.load()
+           << ",\"acquire_wait_us\":" << stat_.acquire_wait_us_.to_json()
+           << ",\"hold_us\":" << stat_.hold_us_.to_json()
+           << ",\"create_us\":" << stat_.create_us_.to_json()
+           << ",\"breaker\":" << breaker_.to_json()
+           << "}";
+
+        return ss.str();
+    }
 
-        {
-            std::lock_guard<std::mutex> lock(conn_notify_mutex_);
-            ss << "\t" << "current_busy:" << conns_busy_.size() << std::endl;
-            ss << "\t" << "current_idle:" << conns_idle_.size() << std::endl;
+    const ConnPoolStat& get_stat() const {
+        return stat_;
+    }
+
+private:
+
+    static const uint32_t kNil = 0xFFFFFFFFU;
+    static const uint64_t kNilTagged = kNil;
+    static const size_t   kCacheStripes = 16;
+
+    struct Slot {
+        Slot() :
+            conn_(),
+            next_(kNil) {
         }
 
-        return pool_name_ + ":\n" + ss.str();
+        ConnPtr               conn_;
+        std::atomic<uint32_t> next_;
+    };
+
+    // 独占一个cache line，避免线程之间的伪共享
+    struct CacheSlot {
+        std::atomic<uint32_t> index_;
+        char pad_[64 - sizeof(std::atomic<uint32_t>)];
+    };
+
+    // 等待者在自己的条件变量上等待，释放者只唤醒队首的一个
+    struct Waiter {
+        Waiter() :
+            notify_(),
+            conn_(),
+            signaled_(false) {
+        }
+
+        std::condition_variable notify_;
+        ConnPtr conn_;       // 释放者直接交付的连接
+        bool    signaled_;   // 没有交付连接，但是有了可以重试的容量
+    };
+
+    // 高32位是版本号，防止ABA
+    void push_slot(std::atomic<uint64_t>& head, uint32_t idx) {
+        uint64_t old = head.load();
+        do {
+            slots_[idx].next_.store(static_cast<uint32_t>(old));
+        } while (!head.compare_exchange_weak(old, (((old >> 32) + 1) << 32) | idx));
     }
 
-private:
+    uint32_t pop_slot(std::atomic<uint64_t>& head) {
+        uint64_t old = head.load();
+        while (true) {
+            uint32_t idx = static_cast<uint32_t>(old);
+            if (idx == kNil)
+                return kNil;
+
+            uint32_t next = slots_[idx].next_.load();
+            if (head.compare_exchange_weak(old, (((old >> 32) + 1) << 32) | next))
+                return idx;
+        }
+    }
 
-    // 持锁被调用的 conn_notify_mutex_
-    ConnPtr do_request_conn() {
+    // 线程依次分配缓存槽位
+    static size_t thread_stripe() {
+        static std::atomic<size_t> next_stripe(0);
+        static thread_local size_t stripe = next_stripe.fetch_add(1) % kCacheStripes;
+        return stripe;
+    }
 
-        ConnPtr conn;
+    void put_idle(ConnPtr conn) {
 
-        if (!conns_idle_.empty()) {
-            conn = conns_idle_.front();
-            conns_idle_.pop_front();
-            conns_busy_.insert(conn);
-            stat_.incr_success();
-            return conn;
+        uint32_t idx = pop_slot(free_slots_);
+        SAFE_ASSERT(idx != kNil);
+
+        slots_[idx].conn_ = std::move(conn);
+
+        // 优先放到本线程的缓存槽位
+        uint32_t expect = kNil;
+        if (!cache_slots_[thread_stripe()].index_.compare_exchange_strong(expect, idx))
+            push_slot(idle_slots_, idx);
+    }
+
+    ConnPtr take_idle() {
+
+        uint32_t idx = kNil;
+
+        std::atomic<uint32_t>& local = cache_slots_[thread_stripe()].index_;
+        if (local.load(std::memory_order_relaxed) != kNil)
+            idx = local.exchange(kNil);
+
+        if (idx == kNil)
+            idx = pop_slot(idle_slots_);
+
+        // 窃取其他线程缓存的连接
+        for (size_t i = 0; idx == kNil && i < kCacheStripes; ++i) {
+            std::atomic<uint32_t>& other = cache_slots_[i].index_;
+            if (other.load(std::memory_order_relaxed) != kNil)
+                idx = other.exchange(kNil);
+        }
+
+        if (idx == kNil)
+            return ConnPtr();
+
+        ConnPtr conn = std::move(slots_[idx].conn_);
+        push_slot(free_slots_, idx);
+        return conn;
+    }
+
+    // 不阻塞的申请，创建连接失败的时候设置failed
+    bool try_acquire(ConnPtr& conn, bool& failed) {
+
+        conn = take_idle();
+        if (conn) {
+            lend_conn(conn);
+            return true;
+        }
+
+        // 预占容量之后在锁外创建连接
+        if (!reserve_capacity())
+            return false;
+
+        conn = create_conn();
+        if (!conn) {
+            --total_;
+            failed = true;
+            wakeup_waiter();
+            return false;
+        }
+
+        lend_conn(conn);
+        return true;
+    }
+
+    void lend_conn(const ConnPtr& conn) {
+        ++busy_;
+        conn->lend_us_ = now_us();
+    }
+
+    static int64_t now_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool reserve_capacity() {
+        size_t total = total_.load();
+        do {
+            if (total >= limit_.load())
+                return false;
+        } while (!total_.compare_exchange_weak(total, total + 1));
+        return true;
+    }
+
+    ConnPtr create_conn() {
+
+        // 熔断期间不再尝试建立连接
+        ConnBreaker::Permit permit = breaker_.acquire();
+        if (permit == ConnBreaker::kReject) {
+            ++stat_.create_failed_;
+            return ConnPtr();
+        }
+
+        int64_t start = now_us();
+
+        ConnPtr new_conn = std::make_shared<T>(*this, helper_);
+        if (!new_conn) {
+            log_err("creating new Conn failed!");
+            breaker_.release(permit, false);
+            ++stat_.create_failed_;
+            return new_conn;
+        }
+
+        if (!new_conn->init(reinterpret_cast<int64_t>(new_conn.get()))) {
+            log_err("init new Conn failed!");
+            breaker_.release(permit, false);
+            new_conn.reset();
+            ++stat_.create_failed_;
+            return new_conn;
+        }
+
+        breaker_.release(permit, true);
+
+        ++stat_.create_count_;
+        stat_.create_us_.record(now_us() - start);
+        return new_conn;
+    }
+
+    // msec小于0表示一直等待，等于0表示不等待
+    ConnPtr do_acquire(int64_t msec) {
+
+        ++stat_.acquired_count_;
+        int64_t start = now_us();
+
+        ConnPtr conn = wait_acquire(msec);
+        int64_t wait = now_us() - start;
+        if (conn) {
+            ++stat_.acquired_success_;
+            stat_.acquire_wait_us_.record(wait);
+        } else {
+            ++stat_.timeout_count_;
         }
 
-        if ((conns_idle_.size() + conns_busy_.size()) < capacity_) {
+        // 失败的等待也反映了连接的不足
+        window_wait_us_.record(wait);
+
+        return conn;
+    }
+
+    ConnPtr wait_acquire(int64_t msec) {
+
+        ConnPtr conn;
+        bool failed = false;
+        if (try_acquire(conn, failed) || failed || msec == 0)
+            return conn;
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(msec);
+
+        Waiter waiter;
+        std::unique_lock<std::mutex> lock(waiters_mutex_);
+        waiters_queue_.push_back(&waiter);
+        waiters_.fetch_add(1);
+
+        while (!waiter.conn_) {
+
+            // 登记之后再检查一次，和释放者先放回连接再检查等待者的顺序配合，不会丢失唤醒
+            lock.unlock();
+            bool success = try_acquire(conn, failed);
+            lock.lock();
 
-            ConnPtr new_conn = std::make_shared<T>(*this, helper_);
-            if (!new_conn) {
-                log_err("creating new Conn failed!");
-                return new_conn;
+            if (success || failed || waiter.conn_)
+                break;
+
+            if (!waiter.signaled_) {
+                if (msec < 0) {
+                    waiter.notify_.wait(lock);
+                } else if (waiter.notify_.wait_until(lock, deadline) == std::cv_status::timeout &&
+                           !waiter.conn_ && !waiter.signaled_) {
+                    break;
+                }
             }
 
-            if (!new_conn->init(reinterpret_cast<int64_t>(new_conn.get()))) {
-                log_err("init new Conn failed!");
-                new_conn.reset();
-                return new_conn;
+            waiter.signaled_ = false;
+        }
+
+        // 被交付了连接的等待者已经被移出了队列
+        if (!waiter.conn_) {
+            for (auto iter = waiters_queue_.begin(); iter != waiters_queue_.end(); ++iter) {
+                if (*iter == &waiter) {
+                    waiters_queue_.erase(iter);
+                    break;
+                }
             }
+        }
 
-            conns_busy_.insert(new_conn);
-            stat_.incr_success();
-            return new_conn;
+        waiters_.fetch_sub(1);
+        ConnPtr handed = std::move(waiter.conn_);
+        lock.unlock();
+
+        if (handed) {
+            if (!conn)
+                return handed;
+
+            // 自己已经拿到了连接，多余的归还
+            free_conn(handed);
         }
 
         return conn;
     }
 
-    bool do_check_available() {
-        return (!conns_idle_.empty() || (conns_idle_.size() + conns_busy_.size()) < capacity_);
+    void wakeup_waiter() {
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load() == 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(waiters_mutex_);
+        if (waiters_queue_.empty())
+            return;
+
+        Waiter* waiter = waiters_queue_.front();
+
+        ConnPtr conn = take_idle();
+        if (conn) {
+            lend_conn(conn);
+            waiter->conn_ = std::move(conn);
+            waiters_queue_.pop_front();
+        } else {
+            waiter->signaled_ = true;
+        }
+
+        waiter->notify_.notify_one();
     }
 
 
@@ -285,61 +778,224 @@ private:
     // 各种连接类型的配置信息会放在这个模板类型中
     const Helper helper_;
 
-    // 正在被使用的连接
-    std::set<ConnPtr, conn_ptr_compare<T> > conns_busy_;
-    std::deque<ConnPtr> conns_idle_;
+    // 空闲连接的存储，free_slots_为未使用的槽位，idle_slots_为存放了空闲连接的槽位
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint64_t>   free_slots_;
+    std::atomic<uint64_t>   idle_slots_;
+    CacheSlot               cache_slots_[kCacheStripes];
+
+    std::atomic<size_t> total_;     // 已经创建的连接数
+    std::atomic<size_t> busy_;      // 正在被使用的连接数
 
-    // If the lock is std::unique_lock, std::condition_variable may provide better performance.
-    // http://en.cppreference.com/w/cpp/thread/condition_variable
-    std::condition_variable conn_notify_;
-    std::mutex conn_notify_mutex_;
+    // 连接耗尽时的等待者
+    std::atomic<size_t>  waiters_;
+    std::mutex           waiters_mutex_;
+    std::deque<Waiter*>  waiters_queue_;
 
     ConnPoolStat stat_;
-    const uint32_t conn_trim_linger_;    // 连接闲置该时长之后会被自动删除
+    const uint32_t conn_trim_linger_;    // 连接闲置该时长之后会被自动删除，0表示不删除
+
+    // 维护任务在Timer线程中执行，析构时通过guard保证不会再访问连接池
+    struct MaintainGuard {
+        MaintainGuard() :
+            lock_(), alive_(true) {
+        }
+
+        std::mutex lock_;
+        bool alive_;
+    };
+
+    ConnPoolMaintain maintain_;
+    std::shared_ptr<MaintainGuard> maintain_guard_;
+    std::shared_ptr<TimerObject>   maintain_timer_;
+
+    // 当前允许的连接数，不超过capacity_
+    std::atomic<size_t> limit_;
+
+    std::mutex      elastic_lock_;
+    ConnPoolElastic elastic_;
+    Histogram       window_wait_us_;   // 一个维护周期内的申请等待时长
+    uint32_t        shrink_streak_;
+
+    ConnBreaker     breaker_;
 
 private:
-    void do_conn_linger_trim() {
+    static const int64_t kMaintainBudgetMs = 20;  // 不能卡顿太长时间
+    static const size_t  kMaintainPingBatch = 4;  // 每个维护周期最多ping的连接数
+
+    static int64_t elapse_ms(const struct timeval& start_time) {
+        struct timeval now;
+        ::gettimeofday(&now, NULL);
+        return (1000000 * (now.tv_sec - start_time.tv_sec) + now.tv_usec - start_time.tv_usec) / 1000;
+    }
+
+    // 淘汰闲置超过linger的多余连接，并对闲置较久的连接进行保活检查
+    //
+    // 空闲连接组织成LIFO的栈，闲置最久的在栈底，只能先全部取出才能访问到。取出之后
+    // 只在内存中分拣：需要淘汰的直接关闭，需要ping的留下最多kMaintainPingBatch个，
+    // 其余的立即按照原来的顺序放回；之后再逐个ping，检查完一个就放回一个，
+    // 不会在持有全部空闲连接的时候进行阻塞的网络操作
+    void do_conn_maintenance() {
 
         struct timeval start_time {};
         ::gettimeofday(&start_time, NULL);
 
-        std::lock_guard<std::mutex> lock(conn_notify_mutex_);
+        do_conn_resize();
 
-        if (conns_idle_.empty()) {
-            return;
+        std::vector<ConnPtr> conns;
+        size_t idle = get_idle_size();
+        for (size_t i = 0; i < idle; ++i) {
+            ConnPtr conn = take_idle();
+            if (!conn)
+                break;
+            conns.push_back(std::move(conn));
         }
 
-        int count = 0;
+        int count = static_cast<int>(conns.size());
         int trim_count = 0;
+        int ping_count = 0;
+        int drop_count = 0;
+
+        // 保留min_idle_个空闲连接不被淘汰
+        size_t trimmable = conns.size() > maintain_.min_idle_ ? conns.size() - maintain_.min_idle_ : 0;
+
+        std::vector<ConnPtr> pings;
+        for (auto iter = conns.begin(); iter != conns.end(); ++iter) {
+
+            // 超出limit_的连接优先关闭
+            if (total_.load() > limit_.load() ||
+                (conn_trim_linger_ && trim_count < static_cast<int>(trimmable) &&
+                 (*iter)->expire(conn_trim_linger_))) {
+                iter->reset();
+                --total_;
+                ++stat_.trim_count_;
+                ++trim_count;
+                continue;
+            }
 
-        for (auto iter = conns_idle_.begin(); iter != conns_idle_.end();) {
+            if (maintain_.keepalive_sec_ && pings.size() < kMaintainPingBatch &&
+                (*iter)->need_keepalive(maintain_.keepalive_sec_)) {
+                pings.push_back(std::move(*iter));
+            }
+        }
+
+        for (auto iter = conns.rbegin(); iter != conns.rend(); ++iter) {
+            if (*iter)
+                put_idle(std::move(*iter));
+            wakeup_waiter();
+        }
 
-            ++count;
+        for (size_t i = 0; i < pings.size(); ++i) {
 
-            // gettimeofday的秒和time的秒是一样的
-            if ((*iter)->expire(conn_trim_linger_)) {
-                iter = conns_idle_.erase(iter);
-                ++trim_count;
+            // 超出时间预算之后剩下的直接放回，下个周期再检查
+            if (elapse_ms(start_time) > kMaintainBudgetMs) {
+                put_idle(std::move(pings[i]));
+                wakeup_waiter();
+                continue;
+            }
+
+            ++ping_count;
+            if (pings[i]->ping_test()) {
+                pings[i]->touch_alive();
+                put_idle(std::move(pings[i]));
             } else {
-                ++iter;
+                log_err("pool %s keepalive ping failed, drop it away", pool_name_.c_str());
+                pings[i].reset();
+                --total_;
+                ++stat_.drop_count_;
+                ++drop_count;
+                breaker_.suspect();
             }
+            wakeup_waiter();
+        }
 
-            if ((count % 20) == 0) {  // 不能卡顿太长时间
-                struct timeval now;
-                ::gettimeofday(&now, NULL);
-                int64_t elapse_ms = (1000000 * (now.tv_sec - start_time.tv_sec) + now.tv_usec - start_time.tv_usec) / 1000;
-                if (elapse_ms > 20) {
-                    log_warning("too long elapse time: %ld ms, break now", elapse_ms);
-                    break;
-                }
+        if (trim_count || drop_count) {
+            log_info("pool %s, total checked %d conns, trimed %d conns, pinged %d conns, dropped %d conns.",
+                     pool_name_.c_str(), count, trim_count, ping_count, drop_count);
+        }
+
+        // 空闲连接不足的时候补充
+        do_conn_replenish(kMaintainBudgetMs);
+    }
+
+    bool check_elastic(const ConnPoolElastic& elastic) const {
+
+        if (elastic.max_conn_ > capacity_ || elastic.min_conn_ > elastic.max_conn_ ||
+            elastic.shrink_idle_ratio_ <= 0 || elastic.shrink_idle_ratio_ > 1) {
+            log_err("pool %s invalid elastic setting, min %lu, max %lu, capacity %lu.",
+                    pool_name_.c_str(), elastic.min_conn_, elastic.max_conn_, capacity_);
+            return false;
+        }
+
+        return true;
+    }
+
+    // 根据上一个维护周期内的申请等待和空闲比例调整limit_
+    void do_conn_resize() {
+
+        std::lock_guard<std::mutex> lock(elastic_lock_);
+        if (!elastic_.max_conn_) {
+            window_wait_us_.reset();
+            return;
+        }
+
+        size_t limit = limit_.load();
+        size_t total = total_.load();
+        size_t idle = get_idle_size();
+        uint64_t wait_p99 = window_wait_us_.percentile(99);
+        window_wait_us_.reset();
+
+        size_t step = limit / 4 ? limit / 4 : 1;
+        size_t new_limit = limit;
+
+        if (wait_p99 > elastic_.target_wait_us_ && total >= limit) {
+            shrink_streak_ = 0;
+            new_limit = std::min(limit + step, elastic_.max_conn_);
+        } else if (total && waiters_.load() == 0 &&
+                   static_cast<double>(idle) / total >= elastic_.shrink_idle_ratio_) {
+            if (++shrink_streak_ >= elastic_.shrink_rounds_) {
+                shrink_streak_ = 0;
+                step = limit / 8 ? limit / 8 : 1;
+                new_limit = limit > elastic_.min_conn_ + step ? limit - step : elastic_.min_conn_;
             }
+        } else {
+            shrink_streak_ = 0;
         }
 
-        if (trim_count) {
-            log_info("pool %s, total checked %d conns, trimed %d conns.", pool_name_.c_str(), count, trim_count);
+        if (new_limit != limit) {
+            limit_.store(new_limit);
+            log_info("pool %s resize limit %lu -> %lu, wait p99 %lu us, idle %lu/%lu.",
+                     pool_name_.c_str(), limit, new_limit, wait_p99, idle, total);
+            for (size_t i = limit; i < new_limit; ++i)
+                wakeup_waiter();
         }
+    }
 
-        return;
+    // 补充空闲连接到min_idle_，budget_ms为0表示不限制时长，返回新建的连接数
+    size_t do_conn_replenish(int64_t budget_ms) {
+
+        struct timeval start_time {};
+        ::gettimeofday(&start_time, NULL);
+
+        size_t created = 0;
+        while (get_idle_size() < maintain_.min_idle_ && reserve_capacity()) {
+
+            ConnPtr conn = create_conn();
+            if (!conn) {
+                --total_;
+                wakeup_waiter();
+                break;
+            }
+
+            put_idle(std::move(conn));
+            wakeup_waiter();
+            ++created;
+
+            if (budget_ms && elapse_ms(start_time) > budget_ms)
+                break;
+        }
+
+        return created;
     }
 
 
@@ -348,21 +1004,32 @@ private:
         module = "ConnPool";
         name = pool_name_;
 
-        std::stringstream ss;
-
-        ss << "\t" << "capacity: " << capacity_ << std::endl;
-        ss << "\t" << "acquire_count: " << stat_.acquired_count_ << std::endl;
-        ss << "\t" << "acquire_success:" << stat_.acquired_success_ << std::endl;
+        val = status_string();
+        return 0;
+    }
 
-        {
-            std::lock_guard<std::mutex> lock(conn_notify_mutex_);
-            ss << "\t" << "current_busy:" << conns_busy_.size() << std::endl;
-            ss << "\t" << "current_idle:" << conns_idle_.size() << std::endl;
-        }
+    std::string status_string() const {
 
-        val = ss.str();
+        std::stringstream ss;
 
-        return 0;
+        ss << "\t" << "capacity: " << capacity_ << std::endl;
+        ss << "\t" << "current_limit: " << limit_.load() << std::endl;
+        ss << "\t" << "acquire_count: " << stat_.acquired_count_.load() << std::endl;
+        ss << "\t" << "acquire_success:" << stat_.acquired_success_.load() << std::endl;
+        ss << "\t" << "acquire_timeout:" << stat_.timeout_count_.load() << std::endl;
+        ss << "\t" << "conn_created:" << stat_.create_count_.load() << std::endl;
+        ss << "\t" << "conn_create_failed:" << stat_.create_failed_.load() << std::endl;
+        ss << "\t" << "conn_dropped:" << stat_.drop_count_.load() << std::endl;
+        ss << "\t" << "conn_trimmed:" << stat_.trim_count_.load() << std::endl;
+        ss << "\t" << "breaker: " << breaker_.to_string() << std::endl;
+        ss << "\t" << "current_busy:" << busy_.load() << std::endl;
+        ss << "\t" << "current_idle:" << get_idle_size() << std::endl;
+        ss << "\t" << "current_waiters:" << waiters_.load() << std::endl;
+        ss << "\t" << "acquire_wait_us: " << stat_.acquire_wait_us_.to_string() << std::endl;
+        ss << "\t" << "hold_us: " << stat_.hold_us_.to_string() << std::endl;
+        ss << "\t" << "create_us: " << stat_.create_us_.to_string() << std::endl;
+
+        return ss.str();
     }
 
 };
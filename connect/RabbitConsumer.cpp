@@ -0,0 +1,295 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <chrono>
+#include <exception>
+
+#include <other/Log.h>
+#include <connect/RabbitConsumer.h>
+
+namespace roo {
+
+RabbitConsumer::RabbitConsumer(RabbitMQHelper& helper, amqp_channel_t channel,
+                               const RabbitConsumeHandler& handler,
+                               const RabbitConsumerConf& conf) :
+    helper_(helper),
+    channel_(channel),
+    handler_(handler),
+    conf_(conf),
+    stop_(false),
+    batch_(),
+    lock_(),
+    completed_notify_(),
+    completed_(),
+    processing_(0),
+    generation_(0),
+    base_tag_(0),
+    done_(),
+    delivered_(0),
+    acked_(0),
+    nacked_(0),
+    ack_frames_(0),
+    executor_(conf.worker_num_) {
+
+    if (conf_.batch_size_ == 0)
+        conf_.batch_size_ = 1;
+
+    if (conf_.max_inflight_ < conf_.batch_size_)
+        conf_.max_inflight_ = conf_.batch_size_;
+}
+
+RabbitConsumer::~RabbitConsumer() {
+    executor_.terminate();
+}
+
+int RabbitConsumer::run(const std::string& queue, const std::string& consumer_tag) {
+
+    if (conf_.prefetch_count_ &&
+        helper_.basicQos(channel_, conf_.prefetch_count_, false) < 0) {
+        log_err("set prefetch %u on channel %d failed.", conf_.prefetch_count_, channel_);
+        return -1;
+    }
+
+    // basicCancel需要知道consumer_tag，所以不使用broker生成的
+    std::string tag = consumer_tag;
+    if (tag.empty())
+        tag = "roo_consumer_" + std::to_string(channel_);
+
+    if (helper_.basicConsume(channel_, queue, tag, false, false, false) < 0) {
+        log_err("consume queue %s on channel %d failed.", queue.c_str(), channel_);
+        return -1;
+    }
+
+    // 上一次run()出错退出的时候可能还有没处理完的消息，它们的结果不能用在新的通道上
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        ++generation_;
+        completed_.clear();
+    }
+
+    base_tag_ = 0;
+    done_.clear();
+    batch_.clear();
+    batch_.reserve(conf_.batch_size_);
+
+    int ret = 0;
+    while (!stop_) {
+
+        if (settle() < 0) {
+            ret = -1;
+            break;
+        }
+
+        // 工作线程处理不过来，暂停读取socket
+        if (done_.size() >= conf_.max_inflight_) {
+            dispatch();
+            wait_completion(conf_.poll_ms_);
+            continue;
+        }
+
+        // 已经有攒下的消息时不阻塞，socket上暂时没有数据就立即交给工作线程
+        int wait_ms = batch_.empty() ? conf_.poll_ms_ : 0;
+        struct timeval timeout;
+        timeout.tv_sec = wait_ms / 1000;
+        timeout.tv_usec = (wait_ms % 1000) * 1000;
+
+        RabbitMessagePtr message = std::make_shared<RabbitMessage>();
+        int code = helper_.basicConsumeMessage(*message, &timeout, 0);
+        if (code == WAIT_MSG_TIMEOUT) {
+            dispatch();
+            continue;
+        } else if (code < 0) {
+            log_err("consume message on channel %d failed.", channel_);
+            ret = -1;
+            break;
+        }
+
+        // 不是消息投递，比如publisher的ack
+        if (message->envelope.delivery_tag == 0)
+            continue;
+
+        if (message->envelope.channel != channel_) {
+            log_warning("ignore delivery on channel %d, expect %d.",
+                        message->envelope.channel, channel_);
+            continue;
+        }
+
+        uint64_t delivery_tag = message->envelope.delivery_tag;
+        if (done_.empty()) {
+            base_tag_ = delivery_tag;
+        } else if (delivery_tag != base_tag_ + done_.size()) {
+            log_err("unexpected delivery_tag %lu, expect %lu.",
+                    delivery_tag, base_tag_ + done_.size());
+            ret = -1;
+            break;
+        }
+
+        done_.push_back(kPending);
+        ++delivered_;
+
+        batch_.push_back(message);
+        if (batch_.size() >= conf_.batch_size_)
+            dispatch();
+    }
+
+    // 等待正在处理的消息，超时没有确认的消息会在通道关闭之后由broker重新投递
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(conf_.drain_ms_);
+    if (ret == 0) {
+        dispatch();
+        while (!done_.empty() && std::chrono::steady_clock::now() < deadline) {
+            wait_completion(conf_.poll_ms_);
+            if (settle() < 0) {
+                ret = -1;
+                break;
+            }
+        }
+    }
+
+    log_warning_if(!done_.empty(), "channel %d left %lu messages unacked.", channel_, done_.size());
+
+    // 出错的时候通道已经不能再确认，没有交出去的消息直接放弃
+    if (ret < 0) {
+        batch_.clear();
+        int64_t remain = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            deadline - std::chrono::steady_clock::now()).count();
+        drain_processing(remain > 0 ? static_cast<int>(remain) : 0);
+    }
+
+    if (ret == 0 && helper_.basicCancel(channel_, tag) < 0) {
+        log_err("cancel consumer %s failed.", tag.c_str());
+        ret = -1;
+    }
+
+    return ret;
+}
+
+void RabbitConsumer::dispatch() {
+
+    if (batch_.empty())
+        return;
+
+    std::vector<RabbitMessagePtr> batch;
+    batch.reserve(conf_.batch_size_);
+    batch.swap(batch_);
+
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        processing_ += batch.size();
+    }
+
+    executor_.add_task(std::bind(&RabbitConsumer::process, this, std::move(batch), generation_));
+}
+
+int RabbitConsumer::process(const std::vector<RabbitMessagePtr>& batch, uint64_t generation) {
+
+    std::vector<Completion> result;
+    result.reserve(batch.size());
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+        Completion completion;
+        completion.delivery_tag_ = batch[i]->envelope.delivery_tag;
+        completion.success_ = false;
+
+        // handler抛出异常的消息按照失败处理，否则它会一直停留在kPending，之后的ack都无法合并
+        try {
+            completion.success_ = handler_(*batch[i]);
+        } catch (const std::exception& e) {
+            log_err("handle delivery_tag %lu exception: %s", completion.delivery_tag_, e.what());
+        } catch (...) {
+            log_err("handle delivery_tag %lu unknown exception.", completion.delivery_tag_);
+        }
+
+        result.push_back(completion);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        processing_ -= batch.size();
+        if (generation == generation_)
+            completed_.insert(completed_.end(), result.begin(), result.end());
+    }
+
+    completed_notify_.notify_all();
+    return 0;
+}
+
+void RabbitConsumer::wait_completion(int timeout_ms) {
+
+    std::unique_lock<std::mutex> lock(lock_);
+    completed_notify_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                               [this] { return !completed_.empty(); });
+}
+
+void RabbitConsumer::drain_processing(int timeout_ms) {
+
+    std::unique_lock<std::mutex> lock(lock_);
+    bool done = completed_notify_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                           [this] { return processing_ == 0; });
+
+    log_warning_if(!done, "channel %d still has %lu messages in processing.", channel_, processing_);
+
+    // 之后到达的结果在下一次run()中按照generation_丢弃
+    ++generation_;
+    completed_.clear();
+}
+
+int RabbitConsumer::settle() {
+
+    std::vector<Completion> completed;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        completed.swap(completed_);
+    }
+
+    if (completed.empty())
+        return 0;
+
+    for (size_t i = 0; i < completed.size(); ++i) {
+
+        uint64_t delivery_tag = completed[i].delivery_tag_;
+        if (delivery_tag < base_tag_ || delivery_tag >= base_tag_ + done_.size()) {
+            log_err("unknown delivery_tag %lu completed.", delivery_tag);
+            continue;
+        }
+
+        if (completed[i].success_) {
+            done_[delivery_tag - base_tag_] = kSucceed;
+            continue;
+        }
+
+        // 失败的消息立即nack，之后合并的ack不会再包含它
+        if (helper_.basicNack(channel_, delivery_tag, conf_.requeue_on_fail_, false) < 0)
+            return -1;
+
+        done_[delivery_tag - base_tag_] = kFailed;
+        ++nacked_;
+    }
+
+    // 对最大的连续完成的成功消息发送multiple的ack，已经nack的tag不能再ack
+    uint64_t last_succeed = 0;
+    uint64_t succeed = 0;
+    while (!done_.empty() && done_.front() != kPending) {
+        if (done_.front() == kSucceed) {
+            last_succeed = base_tag_;
+            ++succeed;
+        }
+        done_.pop_front();
+        ++base_tag_;
+    }
+
+    if (last_succeed == 0)
+        return 0;
+
+    if (helper_.basicAck(channel_, last_succeed, true) < 0)
+        return -1;
+
+    acked_ += succeed;
+    ++ack_frames_;
+    return 0;
+}
+
+} // end namespace roo
@@ -0,0 +1,145 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+
+#ifndef __ROO_CONNECT_RABBIT_CONSUMER_H__
+#define __ROO_CONNECT_RABBIT_CONSUMER_H__
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <condition_variable>
+
+#include <connect/RabbitMQ.h>
+#include <concurrency/WorkStealingPool.h>
+
+// 基于prefetch的消费者
+//
+// 设置basicQos之后在run()的线程中持续读取消息，每batch_size_条(或者socket上暂时没有
+// 更多的数据时)打包交给内部的线程池处理。连接不是线程安全的，所以工作线程只报告处理
+// 结果，所有的ack/nack都在run()的线程中发送：失败的消息单独nack，成功的消息等到
+// delivery_tag连续之后，对最大的连续tag发送一次multiple的ack。
+//
+// 未确认的消息达到max_inflight_的时候停止读取socket，等待工作线程处理完成，
+// broker那边则受prefetch的限制不会继续投递。
+
+namespace roo {
+
+// 返回true表示处理成功，会被ack；否则nack，是否重新入队由requeue_on_fail_决定
+typedef std::function<bool (RabbitMessage& message)> RabbitConsumeHandler;
+
+struct RabbitConsumerConf {
+
+    RabbitConsumerConf() :
+        prefetch_count_(256),
+        batch_size_(32),
+        max_inflight_(256),
+        worker_num_(4),
+        requeue_on_fail_(true),
+        poll_ms_(100),
+        drain_ms_(5000) {
+    }
+
+    uint16_t prefetch_count_;   // basicQos，0表示不限制
+    size_t   batch_size_;       // 一次交给工作线程的消息数
+    size_t   max_inflight_;     // 已经收到但是还没有确认的消息上限
+    uint8_t  worker_num_;
+    bool     requeue_on_fail_;
+    int      poll_ms_;          // 读取消息的超时时间，也是检查stop()的间隔
+    int      drain_ms_;         // 退出的时候等待正在处理的消息的最长时间
+};
+
+
+class RabbitConsumer {
+
+    // 禁止拷贝
+    RabbitConsumer(const RabbitConsumer&) = delete;
+    RabbitConsumer& operator=(const RabbitConsumer&) = delete;
+
+public:
+
+    // helper和channel只能在run()的线程中使用
+    RabbitConsumer(RabbitMQHelper& helper, amqp_channel_t channel,
+                   const RabbitConsumeHandler& handler,
+                   const RabbitConsumerConf& conf = RabbitConsumerConf());
+
+    ~RabbitConsumer();
+
+    // 订阅队列并处理消息，直到stop()或者出错才返回
+    // 正常停止返回0，出错返回-1，此时需要重建通道之后再次调用
+    int run(const std::string& queue, const std::string& consumer_tag = "");
+
+    // 可以在任意的线程中调用，包括handler中
+    void stop() {
+        stop_ = true;
+    }
+
+    uint64_t delivered() const { return delivered_; }
+    uint64_t acked() const { return acked_; }
+    uint64_t nacked() const { return nacked_; }
+    uint64_t ack_frames() const { return ack_frames_; }
+
+private:
+
+    enum {
+        kPending = 0,
+        kSucceed = 1,     // 等待合并的ack
+        kFailed  = 2,     // 已经nack
+    };
+
+    struct Completion {
+        uint64_t delivery_tag_;
+        bool     success_;
+    };
+
+    void dispatch();
+    int process(const std::vector<RabbitMessagePtr>& batch, uint64_t generation);
+
+    // 处理工作线程完成的消息，发送nack和合并的ack
+    int settle();
+
+    // 等待工作线程的完成通知
+    void wait_completion(int timeout_ms);
+
+    // 出错退出之前等待工作线程处理完已经交出去的消息，结果直接丢弃
+    void drain_processing(int timeout_ms);
+
+    RabbitMQHelper& helper_;
+    amqp_channel_t channel_;
+    RabbitConsumeHandler handler_;
+    RabbitConsumerConf conf_;
+
+    std::atomic<bool> stop_;
+
+    std::vector<RabbitMessagePtr> batch_;
+
+    // 工作线程完成的消息
+    std::mutex lock_;
+    std::condition_variable completed_notify_;
+    std::vector<Completion> completed_;
+    size_t processing_;       // 已经交给工作线程还没有完成的消息数
+    uint64_t generation_;     // 每次run()递增，通道重建之后delivery_tag从1重新开始，旧的结果要丢弃
+
+    // 从base_tag_开始每个delivery_tag的处理状态，只在run()的线程中访问
+    uint64_t base_tag_;
+    std::deque<uint8_t> done_;
+
+    uint64_t delivered_;
+    uint64_t acked_;
+    uint64_t nacked_;
+    uint64_t ack_frames_;
+
+    WorkStealingPool<> executor_;
+};
+
+} // end namespace roo
+
+#endif // __ROO_CONNECT_RABBIT_CONSUMER_H__
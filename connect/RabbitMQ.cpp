@@ -5,6 +5,12 @@
 #include <cstdint>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <chrono>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 
 #include <boost/algorithm/string.hpp>
 
@@ -56,14 +62,14 @@ amqp_channel_t RabbitMQHelper::createChannel() {
     amqp_channel_t t;
     if ( (t = getChannelId()) <= 0) {
         log_err("getChannelId failed!");
-        return -1;
+        return 0;
     }
 
     std::shared_ptr<RabbitChannel> pChannel;
     pChannel.reset(new RabbitChannel(t, *this));
     if (!pChannel || pChannel->initChannel() < 0) {
         freeChannelId(t);
-        return -1;
+        return 0;
     }
 
     channels_[t] = pChannel;    // insert it!!
@@ -184,6 +190,58 @@ int RabbitMQHelper::basicPublish(amqp_channel_t channel, const std::string &exch
     return channelInstance(channel)->basicPublish(exchange_name, routing_key, mandatory, immediate, message);
 }
 
+int RabbitMQHelper::basicPublish(amqp_channel_t channel, const std::string &exchange_name,
+                                 const std::string &routing_key, bool mandatory, bool immediate,
+                                 const std::string &message, uint64_t& seq) {
+    if (!isChannelOpen(channel))
+        return -1;
+
+    return channelInstance(channel)->basicPublish(exchange_name, routing_key, mandatory, immediate, message, seq);
+}
+
+int RabbitMQHelper::basicPublish(amqp_channel_t channel, const std::string &exchange_name,
+                                 const std::string &routing_key, bool mandatory, bool immediate,
+                                 const RabbitBytes &message) {
+    if (!isChannelOpen(channel))
+        return -1;
+
+    return channelInstance(channel)->basicPublish(exchange_name, routing_key, mandatory, immediate, message);
+}
+
+int RabbitMQHelper::basicPublish(amqp_channel_t channel, const std::string &exchange_name,
+                                 const std::string &routing_key, bool mandatory, bool immediate,
+                                 const RabbitBytes &message, uint64_t& seq) {
+    if (!isChannelOpen(channel))
+        return -1;
+
+    return channelInstance(channel)->basicPublish(exchange_name, routing_key, mandatory, immediate, message, seq);
+}
+
+int RabbitMQHelper::publishBatch(amqp_channel_t channel, const std::string &exchange_name,
+                                 const std::string &routing_key, bool mandatory,
+                                 const RabbitPublishItem* items, size_t count,
+                                 size_t coalesce_size, std::vector<uint64_t>* seqs) {
+    if (!isChannelOpen(channel))
+        return -1;
+
+    return channelInstance(channel)->publishBatch(exchange_name, routing_key, mandatory,
+                                                  items, count, coalesce_size, seqs);
+}
+
+int RabbitMQHelper::pollConfirms(amqp_channel_t channel, int timeout_ms) {
+    if (!isChannelOpen(channel))
+        return -1;
+
+    return channelInstance(channel)->pollConfirms(timeout_ms);
+}
+
+int RabbitMQHelper::waitConfirms(amqp_channel_t channel, int timeout_ms) {
+    if (!isChannelOpen(channel))
+        return -1;
+
+    return channelInstance(channel)->waitConfirms(timeout_ms);
+}
+
 int RabbitMQHelper::basicGet(amqp_channel_t channel, RabbitMessage& rabbit_msg,
                              const std::string &queue, bool no_ack) {
     if (!isChannelOpen(channel))
@@ -192,6 +250,29 @@ int RabbitMQHelper::basicGet(amqp_channel_t channel, RabbitMessage& rabbit_msg,
     return channelInstance(channel)->basicGet(rabbit_msg, queue, no_ack);
 }
 
+int RabbitMQHelper::basicQos(amqp_channel_t channel, uint16_t message_prefetch_count, bool global_set) {
+    if (!isChannelOpen(channel))
+        return -1;
+
+    return channelInstance(channel)->basicQos(message_prefetch_count, global_set);
+}
+
+int RabbitMQHelper::basicConsume(amqp_channel_t channel, const std::string &queue,
+                                 const std::string &consumer_tag,
+                                 bool no_local, bool no_ack, bool exclusive) {
+    if (!isChannelOpen(channel))
+        return -1;
+
+    return channelInstance(channel)->basicConsume(queue, consumer_tag, no_local, no_ack, exclusive);
+}
+
+int RabbitMQHelper::basicCancel(amqp_channel_t channel, const std::string &consumer_tag) {
+    if (!isChannelOpen(channel))
+        return -1;
+
+    return channelInstance(channel)->basicCancel(consumer_tag);
+}
+
 int RabbitMQHelper::basicAck(amqp_channel_t channel, uint64_t delivery_tag,
                              bool multiple){
     if (!isChannelOpen(channel))
@@ -303,10 +384,28 @@ int RabbitChannel::setConfirmSelect(){
     }
 
     is_publish_confirm_ = true;
+    next_publish_seq_ = 1;
     log_warning("Channel will work in confirm mode...");
     return 0;
 }
 
+int RabbitChannel::setConfirmStream(size_t window, const RabbitConfirmCallback& callback,
+                                    int timeout_ms) {
+    if (window == 0) {
+        log_err("invalid confirm window: %lu", window);
+        return -1;
+    }
+
+    if (!is_publish_confirm_ && setConfirmSelect() < 0)
+        return -1;
+
+    confirm_window_ = window;
+    confirm_timeout_ms_ = timeout_ms;
+    confirm_callback_ = callback;
+    log_warning("Channel will work in stream confirm mode, window: %lu", window);
+    return 0;
+}
+
 
 int RabbitChannel::declareExchange(const std::string &exchange_name,
                                    const std::string &exchange_type,
@@ -662,23 +761,79 @@ int RabbitChannel::basicRecover(const std::string &consumer) {
 int RabbitChannel::basicPublish(const std::string &exchange_name,
                                 const std::string &routing_key, bool mandatory, bool immediate,
                                 const std::string &message) {
+    uint64_t seq = 0;
+    return basicPublish(exchange_name, routing_key, mandatory, immediate, message, seq);
+}
+
+int RabbitChannel::basicPublish(const std::string &exchange_name,
+                                const std::string &routing_key, bool mandatory, bool immediate,
+                                const std::string &message, uint64_t& seq) {
+    return basicPublish(exchange_name, routing_key, mandatory, immediate, RabbitBytes(message), seq);
+}
+
+int RabbitChannel::basicPublish(const std::string &exchange_name,
+                                const std::string &routing_key, bool mandatory, bool immediate,
+                                const RabbitBytes &message) {
+    uint64_t seq = 0;
+    return basicPublish(exchange_name, routing_key, mandatory, immediate, message, seq);
+}
+
+int RabbitChannel::basicPublish(const std::string &exchange_name,
+                                const std::string &routing_key, bool mandatory, bool immediate,
+                                const RabbitBytes &message, uint64_t& seq) {
     if (!isChannelOpen())
         return -1;
 
-    amqp_bytes_t message_bytes;
-    message_bytes.bytes = (void *)(message.c_str());
-    message_bytes.len = message.size();
+    amqp_bytes_t message_bytes = message.bytes();
 
     //消息持久化的三要素之一:消息的投递模式为持久
     amqp_basic_properties_t props;
     props._flags = AMQP_BASIC_DELIVERY_MODE_FLAG;
     props.delivery_mode = 2; /* persistent delivery mode */
 
+    return publishBytes(amqp_cstring_bytes(exchange_name.c_str()),
+                        amqp_cstring_bytes(routing_key.c_str()),
+                        mandatory, immediate, &props, message_bytes, seq);
+}
+
+// 距离deadline剩余的时间，已经超时返回false
+static bool confirm_remaining(const std::chrono::steady_clock::time_point& deadline,
+                              struct timeval* timeout) {
+    int64_t remain = std::chrono::duration_cast<std::chrono::microseconds>(
+                        deadline - std::chrono::steady_clock::now()).count();
+    if (remain <= 0)
+        return false;
+
+    timeout->tv_sec = remain / 1000000;
+    timeout->tv_usec = remain % 1000000;
+    return true;
+}
+
+int RabbitChannel::publishBytes(amqp_bytes_t exchange, amqp_bytes_t routing_key,
+                                bool mandatory, bool immediate,
+                                const amqp_basic_properties_t* props, amqp_bytes_t body, uint64_t& seq) {
+
+    // 窗口已满，先等待最早的消息被确认
+    // 期间可能收到basic.return等其他帧，整个等待共用一个截止时间
+    if (confirm_window_ && unconfirmed_.size() >= confirm_window_) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(confirm_timeout_ms_);
+
+        while (unconfirmed_.size() >= confirm_window_) {
+            struct timeval timeout;
+            int ret = confirm_remaining(deadline, &timeout) ? readConfirmFrame(&timeout) : 0;
+            if (ret == 0) {
+                log_err("wait confirm timeout, unconfirmed: %lu", unconfirmed_.size());
+                return -1;
+            } else if (ret < 0) {
+                return -1;
+            }
+        }
+    }
+
     int retCode = amqp_basic_publish(mqHelper_.connection_, id_,
-                                 amqp_cstring_bytes(exchange_name.c_str()),
-                                 amqp_cstring_bytes(routing_key.c_str()),
+                                 exchange, routing_key,
                                  mandatory, immediate,
-                                 &props, message_bytes);
+                                 props, body);
 
     if (retCode < 0) {
         log_err("amqp_basic_publish fail! ret:%d", retCode);
@@ -689,6 +844,12 @@ int RabbitChannel::basicPublish(const std::string &exchange_name,
         return 0;
     }
 
+    seq = next_publish_seq_++;
+    if (confirm_window_) {
+        unconfirmed_.push_back(seq);
+        return 0;
+    }
+
     // Publish Confirm mode
     // - basic.ack - our channel is in confirm mode, messsage was 'dealt with' by the broker
     // - basic.return then basic.ack - the message wasn't delievered, but was dealt with
@@ -724,6 +885,381 @@ connection_err:
 }
 
 
+// 长度明确的字符串，消息体中可能有'\0'，不能用amqp_cstring_bytes
+static amqp_bytes_t amqp_string_bytes(const std::string& str) {
+    amqp_bytes_t bytes;
+    bytes.len = str.size();
+    bytes.bytes = (void *)(str.data());
+    return bytes;
+}
+
+// TCP_CORK期间内核只发送满的报文段，取消的时候把剩余的数据一起发出
+static void amqp_socket_cork(amqp_connection_state_t connection, bool cork) {
+#ifdef TCP_CORK
+    int fd = amqp_get_sockfd(connection);
+    if (fd < 0)
+        return;
+
+    int flag = cork ? 1 : 0;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_CORK, &flag, sizeof(flag));
+#endif
+}
+
+int RabbitChannel::publishBatch(const std::string &exchange_name,
+                                const std::string &routing_key, bool mandatory,
+                                const RabbitPublishItem* items, size_t count,
+                                size_t coalesce_size, std::vector<uint64_t>* seqs) {
+    if (!isChannelOpen())
+        return -1;
+
+    if (seqs)
+        seqs->assign(count, 0);
+
+    amqp_bytes_t exchange = amqp_cstring_bytes(exchange_name.c_str());
+    amqp_bytes_t routing = amqp_cstring_bytes(routing_key.c_str());
+
+    amqp_basic_properties_t base_props;
+    base_props._flags = AMQP_BASIC_DELIVERY_MODE_FLAG;
+    base_props.delivery_mode = 2; /* persistent delivery mode */
+
+    amqp_basic_properties_t batch_props = base_props;
+    batch_props._flags |= AMQP_BASIC_CONTENT_TYPE_FLAG;
+    batch_props.content_type = amqp_cstring_bytes(MQ_BATCH_CONTENT_TYPE);
+
+    // 同步确认模式下每条消息都要等待ACK，不能延迟发送
+    const bool cork = !is_publish_confirm_ || confirm_window_ != 0;
+    if (cork)
+        amqp_socket_cork(mqHelper_.connection_, true);
+
+    int published = 0;
+    bool success = true;
+
+    // 发送一条消息，对应items中[first, first + n)
+    auto publish = [&](const amqp_basic_properties_t* props, amqp_bytes_t body,
+                       size_t first, size_t n) -> bool {
+
+        // 窗口满的时候要等待broker的ACK，先把积累的数据发出去
+        if (cork && confirm_window_ && unconfirmed_.size() >= confirm_window_) {
+            amqp_socket_cork(mqHelper_.connection_, false);
+            amqp_socket_cork(mqHelper_.connection_, true);
+        }
+
+        uint64_t seq = 0;
+        if (publishBytes(exchange, routing, mandatory, false, props, body, seq) < 0)
+            return false;
+
+        ++published;
+        if (seqs)
+            std::fill(seqs->begin() + first, seqs->begin() + first + n, seq);
+        return true;
+    };
+
+    std::string packed;
+    size_t packed_first = 0;
+    size_t packed_count = 0;
+
+    auto flush_packed = [&]() -> bool {
+        if (packed_count == 0)
+            return true;
+
+        // 只有一条的时候原样发送
+        bool ret = (packed_count == 1) ?
+            publish(&base_props, amqp_string_bytes(items[packed_first].body_), packed_first, 1) :
+            publish(&batch_props, amqp_string_bytes(packed), packed_first, packed_count);
+
+        packed.clear();
+        packed_count = 0;
+        return ret;
+    };
+
+    std::vector<amqp_table_entry_t> headers;
+
+    for (size_t i = 0; i < count && success; ++i) {
+
+        const RabbitPublishItem& item = items[i];
+
+        if (coalesce_size && !item.has_properties() && item.body_.size() + 4 <= coalesce_size) {
+
+            if (packed.size() + 4 + item.body_.size() > coalesce_size && !flush_packed()) {
+                success = false;
+                break;
+            }
+
+            if (packed_count == 0) {
+                packed_first = i;
+                packed.reserve(coalesce_size);
+            }
+
+            uint32_t len = htonl(static_cast<uint32_t>(item.body_.size()));
+            packed.append(reinterpret_cast<const char *>(&len), sizeof(len));
+            packed.append(item.body_);
+            ++packed_count;
+            continue;
+        }
+
+        // 保持消息的顺序，先发送之前合并的消息
+        if (!flush_packed()) {
+            success = false;
+            break;
+        }
+
+        if (!item.has_properties()) {
+            success = publish(&base_props, amqp_string_bytes(item.body_), i, 1);
+            continue;
+        }
+
+        amqp_basic_properties_t props = base_props;
+        if (!item.content_type_.empty()) {
+            props._flags |= AMQP_BASIC_CONTENT_TYPE_FLAG;
+            props.content_type = amqp_string_bytes(item.content_type_);
+        }
+        if (!item.message_id_.empty()) {
+            props._flags |= AMQP_BASIC_MESSAGE_ID_FLAG;
+            props.message_id = amqp_string_bytes(item.message_id_);
+        }
+        if (!item.expiration_.empty()) {
+            props._flags |= AMQP_BASIC_EXPIRATION_FLAG;
+            props.expiration = amqp_string_bytes(item.expiration_);
+        }
+        if (!item.headers_.empty()) {
+            headers.clear();
+            std::map<std::string, std::string>::const_iterator it;
+            for (it = item.headers_.begin(); it != item.headers_.end(); ++it) {
+                amqp_table_entry_t entry;
+                entry.key = amqp_string_bytes(it->first);
+                entry.value.kind = AMQP_FIELD_KIND_UTF8;
+                entry.value.value.bytes = amqp_string_bytes(it->second);
+                headers.push_back(entry);
+            }
+
+            props._flags |= AMQP_BASIC_HEADERS_FLAG;
+            props.headers.num_entries = static_cast<int>(headers.size());
+            props.headers.entries = &headers[0];
+        }
+
+        success = publish(&props, amqp_string_bytes(item.body_), i, 1);
+    }
+
+    if (success)
+        success = flush_packed();
+
+    // 出错的时候连接可能已经被关闭
+    if (cork && mqHelper_.isConnectionOpen())
+        amqp_socket_cork(mqHelper_.connection_, false);
+
+    return success ? published : -1;
+}
+
+int RabbitChannel::readConfirmFrame(struct timeval* timeout) {
+
+    amqp_frame_t frame;
+    int ret = timeout ? amqp_simple_wait_frame_noblock(mqHelper_.connection_, &frame, timeout)
+                      : amqp_simple_wait_frame(mqHelper_.connection_, &frame);
+    if (ret == AMQP_STATUS_TIMEOUT)
+        return 0;
+
+    if (ret != AMQP_STATUS_OK) {
+        log_err("wait confirm frame failed: %s", amqp_error_string2(ret));
+        closeConnection();
+        return -1;
+    }
+
+    if (frame.frame_type != AMQP_FRAME_METHOD) {
+        log_err("unexpected frame_type %d on channel %d", frame.frame_type, frame.channel);
+        return 1;
+    }
+
+    // 同一个连接上的其他通道的帧也会在这里读到，确认的序号是每个通道独立的，
+    // 必须交给对应的通道处理
+    RabbitChannelPtr target = mqHelper_.channelInstance(frame.channel);
+
+    switch (frame.payload.method.id) {
+        case AMQP_BASIC_ACK_METHOD: {
+            amqp_basic_ack_t* ack = (amqp_basic_ack_t *) frame.payload.method.decoded;
+            if (target)
+                target->handleConfirm(ack->delivery_tag, ack->multiple, kConfirmAck);
+            else
+                log_warning("ack on unknown channel %d", frame.channel);
+            break;
+        }
+
+        case AMQP_BASIC_NACK_METHOD: {
+            amqp_basic_nack_t* nack = (amqp_basic_nack_t *) frame.payload.method.decoded;
+            log_warning("broker nack delivery_tag %lu, multiple %d on channel %d",
+                        nack->delivery_tag, nack->multiple, frame.channel);
+            if (target)
+                target->handleConfirm(nack->delivery_tag, nack->multiple, kConfirmNack);
+            break;
+        }
+
+        case AMQP_BASIC_RETURN_METHOD: {
+            // mandatory的消息无法路由，之后broker仍然会ack这条消息
+            amqp_message_t message;
+            amqp_rpc_reply_t res = amqp_read_message(mqHelper_.connection_, frame.channel, &message, 0);
+            if (AMQP_RESPONSE_NORMAL != res.reply_type) {
+                closeConnection();
+                return -1;
+            }
+
+            amqp_destroy_message(&message);
+            if (target)
+                ++target->returned_count_;
+            log_warning("basic.return on channel %d", frame.channel);
+            break;
+        }
+
+        case AMQP_BASIC_DELIVER_METHOD: {
+            // 其他通道上消费者的消息，这里没有地方暂存，读完之后nack让broker重新投递
+            amqp_basic_deliver_t* deliver = (amqp_basic_deliver_t *) frame.payload.method.decoded;
+            uint64_t delivery_tag = deliver->delivery_tag;
+
+            amqp_message_t message;
+            amqp_rpc_reply_t res = amqp_read_message(mqHelper_.connection_, frame.channel, &message, 0);
+            if (AMQP_RESPONSE_NORMAL != res.reply_type) {
+                closeConnection();
+                return -1;
+            }
+
+            amqp_destroy_message(&message);
+            log_warning("requeue delivery %lu on channel %d while waiting confirms",
+                        delivery_tag, frame.channel);
+            if (amqp_basic_nack(mqHelper_.connection_, frame.channel, delivery_tag, false, true) != AMQP_STATUS_OK) {
+                closeConnection();
+                return -1;
+            }
+            break;
+        }
+
+        case AMQP_CHANNEL_CLOSE_METHOD:
+            // broker关闭的通道只需要回复close-ok，不能再发送channel.close
+            log_err("Channel %d closed by broker", frame.channel);
+            if (target) {
+                target->closeByPeer();
+            } else {
+                amqp_channel_close_ok_t close_ok;
+                amqp_send_method(mqHelper_.connection_, frame.channel, AMQP_CHANNEL_CLOSE_OK_METHOD, &close_ok);
+            }
+
+            if (frame.channel == id_)
+                return -1;
+            break;
+
+        case AMQP_CONNECTION_CLOSE_METHOD:
+            log_err("Close connection");
+            closeConnection();
+            return -1;
+
+        default:
+            log_err("Unexpeced method.id: %d", frame.payload.method.id);
+            break;
+    }
+
+    return 1;
+}
+
+void RabbitChannel::handleConfirm(uint64_t delivery_tag, bool multiple, RabbitConfirm result) {
+
+    if (multiple) {
+        while (!unconfirmed_.empty() && unconfirmed_.front() <= delivery_tag) {
+            uint64_t seq = unconfirmed_.front();
+            unconfirmed_.pop_front();
+            if (confirm_callback_)
+                confirm_callback_(seq, result);
+        }
+        return;
+    }
+
+    std::deque<uint64_t>::iterator it = std::lower_bound(unconfirmed_.begin(), unconfirmed_.end(), delivery_tag);
+    if (it == unconfirmed_.end() || *it != delivery_tag) {
+        log_warning("unknown confirm delivery_tag: %lu", delivery_tag);
+        return;
+    }
+
+    unconfirmed_.erase(it);
+    if (confirm_callback_)
+        confirm_callback_(delivery_tag, result);
+}
+
+void RabbitChannel::closeByPeer() {
+
+    if (!is_connected_)
+        return;
+
+    log_warning("Channel: %d closed by broker", id_);
+
+    amqp_channel_close_ok_t close_ok;
+    amqp_send_method(mqHelper_.connection_, id_, AMQP_CHANNEL_CLOSE_OK_METHOD, &close_ok);
+    is_connected_ = false;
+
+    failUnconfirmed();
+}
+
+void RabbitChannel::failUnconfirmed() {
+
+    if (unconfirmed_.empty())
+        return;
+
+    log_err("channel %d closed with %lu unconfirmed messages", id_, unconfirmed_.size());
+
+    std::deque<uint64_t> unconfirmed;
+    unconfirmed.swap(unconfirmed_);
+    for (size_t i = 0; i < unconfirmed.size(); ++i) {
+        if (confirm_callback_)
+            confirm_callback_(unconfirmed[i], kConfirmLost);
+    }
+}
+
+int RabbitChannel::pollConfirms(int timeout_ms) {
+
+    if (!isChannelOpen())
+        return -1;
+
+    if (unconfirmed_.empty())
+        return 0;
+
+    struct timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+    // 第一帧最多等待timeout_ms，之后只处理已经到达的
+    int count = 0;
+    while (!unconfirmed_.empty()) {
+        int ret = readConfirmFrame(&timeout);
+        if (ret < 0)
+            return -1;
+        if (ret == 0)
+            break;
+
+        ++count;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 0;
+    }
+
+    amqp_maybe_release_buffers_on_channel(mqHelper_.connection_, id_);
+    return count;
+}
+
+int RabbitChannel::waitConfirms(int timeout_ms) {
+
+    if (!isChannelOpen())
+        return -1;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!unconfirmed_.empty()) {
+
+        struct timeval timeout;
+        if (!confirm_remaining(deadline, &timeout))
+            return WAIT_MSG_TIMEOUT;
+
+        if (readConfirmFrame(&timeout) < 0)
+            return -1;
+    }
+
+    amqp_maybe_release_buffers_on_channel(mqHelper_.connection_, id_);
+    return 0;
+}
+
+
 int RabbitChannel::basicGet(RabbitMessage& rabbit_msg, const std::string &queue,
                             bool no_ack) {
 
@@ -969,7 +1505,6 @@ bool RabbitMQHelper::doConnect() {
     }
 
     // when re-connect, free all channel
-    channel_ids_.clear();
     channels_.clear();
 
     amqp_connection_info info;
@@ -1017,6 +1552,7 @@ bool RabbitMQHelper::doConnect() {
             max_channel_id_ = 2048;
         }
         log_warning("current we support maxium channel: %d", max_channel_id_);
+        resetChannelIds();
 
         return true;
     }
@@ -1144,5 +1680,61 @@ bool mq_setup_channel_publish_default(RabbitChannelPtr pChannel, void* pArg) {
 }
 
 
+bool mq_is_batch_message(const amqp_envelope_t& envelope) {
+
+    const amqp_basic_properties_t& props = envelope.message.properties;
+    if (!(props._flags & AMQP_BASIC_CONTENT_TYPE_FLAG))
+        return false;
+
+    size_t len = ::strlen(MQ_BATCH_CONTENT_TYPE);
+    return props.content_type.len == len &&
+           ::memcmp(props.content_type.bytes, MQ_BATCH_CONTENT_TYPE, len) == 0;
+}
+
+// 依次回调每条消息在batch中的偏移和长度
+template<typename Output>
+static bool mq_scan_batch(const char* data, size_t len, Output output) {
+
+    size_t offset = 0;
+    while (offset < len) {
+
+        uint32_t size = 0;
+        if (len - offset < sizeof(size)) {
+            log_err("invalid batch message, truncated length.");
+            return false;
+        }
+
+        ::memcpy(&size, data + offset, sizeof(size));
+        size = ntohl(size);
+        offset += sizeof(size);
+
+        if (len - offset < size) {
+            log_err("invalid batch message, expect %u bytes but left %lu.", size, len - offset);
+            return false;
+        }
+
+        output(offset, size);
+        offset += size;
+    }
+
+    return true;
+}
+
+bool mq_unpack_batch(const void* data, size_t len, std::vector<std::string>& messages) {
+
+    const char* ptr = static_cast<const char *>(data);
+    return mq_scan_batch(ptr, len, [&](size_t offset, size_t size) {
+        messages.push_back(std::string(ptr + offset, size));
+    });
+}
+
+bool mq_unpack_batch(const RabbitBuffer& batch, std::vector<RabbitBuffer>& messages) {
+
+    return mq_scan_batch(batch.data(), batch.size(), [&](size_t offset, size_t size) {
+        messages.push_back(batch.slice(offset, size));
+    });
+}
+
+
 } // roo
 
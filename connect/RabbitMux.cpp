@@ -0,0 +1,549 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <limits>
+#include <chrono>
+
+#include <other/Log.h>
+#include <connect/RabbitMux.h>
+
+namespace roo {
+
+static const int kPollMs = 100;          // 没有数据的时候检查stop_的间隔
+static const int kMaxFramesPerRound = 256;   // 每轮最多处理的帧数，避免命令饿死
+
+RabbitMuxChannel::RabbitMuxChannel(RabbitMux& mux, amqp_channel_t channel, bool confirm,
+                                   const RabbitConfirmCallback& callback) :
+    mux_(mux),
+    id_(channel),
+    confirm_(confirm),
+    open_(true),
+    confirm_callback_(callback),
+    prefetch_count_(0),
+    lock_(),
+    notify_(),
+    deliveries_(),
+    published_(0),
+    settled_(0) {
+}
+
+int RabbitMuxChannel::basicPublish(const std::string &exchange_name,
+                                   const std::string &routing_key, bool mandatory, bool immediate,
+                                   const RabbitBytes &message) {
+    uint64_t seq = 0;
+    return basicPublish(exchange_name, routing_key, mandatory, immediate, message, seq);
+}
+
+int RabbitMuxChannel::basicPublish(const std::string &exchange_name,
+                                   const std::string &routing_key, bool mandatory, bool immediate,
+                                   const RabbitBytes &message, uint64_t& seq) {
+
+    return execute([&](RabbitChannel& channel) -> int {
+        if (channel.basicPublish(exchange_name, routing_key, mandatory, immediate, message, seq) < 0)
+            return -1;
+
+        if (confirm_) {
+            std::lock_guard<std::mutex> lock(lock_);
+            ++published_;
+        }
+        return 0;
+    });
+}
+
+int RabbitMuxChannel::waitConfirms(int timeout_ms) {
+
+    std::unique_lock<std::mutex> lock(lock_);
+    bool done = notify_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                 [this] { return settled_ >= published_; });
+    return done ? 0 : WAIT_MSG_TIMEOUT;
+}
+
+int RabbitMuxChannel::basicQos(uint16_t message_prefetch_count) {
+    return execute([&](RabbitChannel& channel) -> int {
+        if (channel.basicQos(message_prefetch_count, false) < 0)
+            return -1;
+
+        prefetch_count_ = message_prefetch_count;
+        return 0;
+    });
+}
+
+int RabbitMuxChannel::basicConsume(const std::string &queue, const std::string &consumer_tag) {
+    return execute([&](RabbitChannel& channel) -> int {
+        // 未确认的消息最多prefetch_count_条，deliveries_不会无限增长
+        if (prefetch_count_ == 0) {
+            log_err("channel %d consume without prefetch, call basicQos first.", id_);
+            return -1;
+        }
+        return channel.basicConsume(queue, consumer_tag, false, false, false);
+    });
+}
+
+int RabbitMuxChannel::consumeMessage(RabbitMessagePtr& message, int timeout_ms) {
+
+    std::unique_lock<std::mutex> lock(lock_);
+    notify_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                     [this] { return !deliveries_.empty() || !open_; });
+
+    if (!deliveries_.empty()) {
+        message = deliveries_.front();
+        deliveries_.pop_front();
+        return 0;
+    }
+
+    return open_ ? WAIT_MSG_TIMEOUT : -1;
+}
+
+int RabbitMuxChannel::basicAck(uint64_t delivery_tag, bool multiple) {
+    return execute([&](RabbitChannel& channel) {
+        return channel.basicAck(delivery_tag, multiple);
+    });
+}
+
+int RabbitMuxChannel::basicNack(uint64_t delivery_tag, bool requeue, bool multiple) {
+    return execute([&](RabbitChannel& channel) {
+        return channel.basicNack(delivery_tag, requeue, multiple);
+    });
+}
+
+int RabbitMuxChannel::execute(const std::function<int (RabbitChannel&)>& func) {
+
+    if (!open_)
+        return -1;
+
+    return mux_.execute([&]() -> int {
+        RabbitChannelPtr channel = mux_.channel_instance(id_);
+        if (!channel || !channel->isChannelOpen())
+            return -1;
+        return func(*channel);
+    });
+}
+
+int RabbitMuxChannel::close() {
+
+    if (!open_)
+        return 0;
+
+    return mux_.execute([this]() -> int {
+        mux_.close_channel(id_);
+        return 0;
+    });
+}
+
+void RabbitMuxChannel::onDeliver(const RabbitMessagePtr& message) {
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        deliveries_.push_back(message);
+    }
+    notify_.notify_one();
+}
+
+void RabbitMuxChannel::onConfirm(uint64_t seq, RabbitConfirm result) {
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        ++settled_;
+    }
+    notify_.notify_all();
+
+    if (confirm_callback_)
+        confirm_callback_(seq, result);
+}
+
+void RabbitMuxChannel::onClose() {
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        open_ = false;
+    }
+    notify_.notify_all();
+}
+
+
+RabbitMux::RabbitMux(const std::string& connect_uri, int frame_max) :
+    helper_(connect_uri, frame_max),
+    running_(false),
+    stop_(false),
+    io_thread_(),
+    lock_(),
+    commands_(),
+    channels_() {
+    wakeup_fds_[0] = wakeup_fds_[1] = -1;
+}
+
+RabbitMux::RabbitMux(const std::vector<std::string>& connect_uris, int frame_max) :
+    helper_(connect_uris, frame_max),
+    running_(false),
+    stop_(false),
+    io_thread_(),
+    lock_(),
+    commands_(),
+    channels_() {
+    wakeup_fds_[0] = wakeup_fds_[1] = -1;
+}
+
+RabbitMux::~RabbitMux() {
+
+    stop();
+
+    for (size_t i = 0; i < 2; ++i) {
+        if (wakeup_fds_[i] >= 0)
+            ::close(wakeup_fds_[i]);
+    }
+}
+
+bool RabbitMux::start() {
+
+    if (running_)
+        return true;
+
+    // 之前的I/O线程因为连接断开已经退出
+    if (io_thread_.joinable())
+        io_thread_.join();
+
+    if (wakeup_fds_[0] < 0) {
+        if (::pipe(wakeup_fds_) < 0) {
+            log_err("create wakeup pipe failed: %d", errno);
+            return false;
+        }
+
+        for (size_t i = 0; i < 2; ++i)
+            ::fcntl(wakeup_fds_[i], F_SETFL, ::fcntl(wakeup_fds_[i], F_GETFL) | O_NONBLOCK);
+    }
+
+    if (!helper_.doConnect()) {
+        log_err("RabbitMux connect failed.");
+        return false;
+    }
+
+    stop_ = false;
+    running_ = true;
+    io_thread_ = std::thread(&RabbitMux::io_run, this);
+    return true;
+}
+
+void RabbitMux::stop() {
+
+    stop_ = true;
+    wakeup();
+
+    if (io_thread_.joinable())
+        io_thread_.join();
+}
+
+RabbitMuxChannelPtr RabbitMux::openChannel(bool confirm, const RabbitConfirmCallback& callback) {
+
+    RabbitMuxChannelPtr result;
+    int ret = execute([&]() -> int {
+
+        amqp_channel_t id = helper_.createChannel();
+        if (id == 0)
+            return -1;
+
+        RabbitMuxChannelPtr mux_channel(new RabbitMuxChannel(*this, id, confirm, callback));
+        if (confirm) {
+            // 窗口不限制，发布的时候不会在通道上读取确认，确认都由I/O线程分发
+            RabbitMuxChannel* ptr = mux_channel.get();
+            int code = helper_.channelInstance(id)->setConfirmStream(
+                std::numeric_limits<size_t>::max(),
+                [ptr](uint64_t seq, RabbitConfirm result) { ptr->onConfirm(seq, result); });
+            if (code < 0) {
+                helper_.freeChannel(id);
+                return -1;
+            }
+        }
+
+        if (channels_.size() <= id)
+            channels_.resize(id + 1);
+        channels_[id] = mux_channel;
+
+        result = mux_channel;
+        return 0;
+    });
+
+    if (ret < 0) {
+        log_err("RabbitMux open channel failed.");
+        return RabbitMuxChannelPtr();
+    }
+
+    return result;
+}
+
+std::string RabbitMux::brokerVersion() {
+
+    std::string version;
+    execute([&]() -> int {
+        version = helper_.brokerVersion();
+        return 0;
+    });
+    return version;
+}
+
+int RabbitMux::execute(const std::function<int ()>& func) {
+
+    if (std::this_thread::get_id() == io_thread_.get_id())
+        return func();
+
+    Command command;
+    command.func_ = func;
+    Future<int> future = command.promise_.get_future();
+
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (!running_)
+            return -1;
+
+        // 队列非空的时候I/O线程已经被唤醒过了
+        notify = commands_.empty();
+        commands_.push_back(command);
+    }
+
+    if (notify)
+        wakeup();
+
+    return future.get();
+}
+
+void RabbitMux::wakeup() {
+
+    if (wakeup_fds_[1] < 0)
+        return;
+
+    // pipe满的时候I/O线程肯定会被唤醒，忽略EAGAIN
+    char c = 'w';
+    ssize_t n = ::write(wakeup_fds_[1], &c, 1);
+    (void)n;
+}
+
+void RabbitMux::run_commands() {
+
+    std::deque<Command> commands;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        commands.swap(commands_);
+    }
+
+    for (size_t i = 0; i < commands.size(); ++i) {
+        int ret = helper_.isConnectionOpen() ? commands[i].func_() : -1;
+        commands[i].promise_.set_value(ret);
+    }
+}
+
+void RabbitMux::io_run() {
+
+    log_warning("RabbitMux I/O thread started.");
+
+    int sockfd = amqp_get_sockfd(helper_.connection_);
+    char buff[64];
+
+    while (!stop_) {
+
+        run_commands();
+
+        if (!helper_.isConnectionOpen()) {
+            log_err("RabbitMux connection lost.");
+            break;
+        }
+
+        // librabbitmq中已经缓存了数据的时候不能阻塞在socket上
+        bool buffered = amqp_frames_enqueued(helper_.connection_) ||
+                        amqp_data_in_buffer(helper_.connection_);
+
+        struct pollfd fds[2];
+        fds[0].fd = sockfd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = wakeup_fds_[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        int ret = ::poll(fds, 2, buffered ? 0 : kPollMs);
+        if (ret < 0 && errno != EINTR) {
+            log_err("RabbitMux poll failed: %d", errno);
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            while (::read(wakeup_fds_[0], buff, sizeof(buff)) > 0)
+                ;
+        }
+
+        if (buffered || (fds[0].revents & (POLLIN | POLLERR | POLLHUP))) {
+            if (read_frames() < 0)
+                break;
+        }
+    }
+
+    close_all();
+    log_warning("RabbitMux I/O thread exit.");
+}
+
+int RabbitMux::read_frames() {
+
+    struct timeval timeout = { 0, 0 };
+
+    for (int i = 0; i < kMaxFramesPerRound && helper_.isConnectionOpen(); ++i) {
+
+        amqp_frame_t frame;
+        int status = amqp_simple_wait_frame_noblock(helper_.connection_, &frame, &timeout);
+        if (status == AMQP_STATUS_TIMEOUT)
+            break;
+
+        if (status != AMQP_STATUS_OK) {
+            log_err("RabbitMux read frame failed: %s", amqp_error_string2(status));
+            helper_.closeConnection();
+            return -1;
+        }
+
+        if (dispatch_frame(frame) < 0) {
+            helper_.closeConnection();
+            return -1;
+        }
+    }
+
+    if (helper_.isConnectionOpen())
+        amqp_maybe_release_buffers(helper_.connection_);
+
+    return 0;
+}
+
+int RabbitMux::dispatch_frame(const amqp_frame_t& frame) {
+
+    if (frame.frame_type != AMQP_FRAME_METHOD) {
+        log_warning("unexpected frame type %u on channel %d", frame.frame_type, frame.channel);
+        return 0;
+    }
+
+    RabbitChannelPtr pChannel = helper_.channelInstance(frame.channel);
+
+    switch (frame.payload.method.id) {
+
+        case AMQP_BASIC_DELIVER_METHOD:
+            return read_delivery(frame);
+
+        case AMQP_BASIC_ACK_METHOD:
+            {
+                amqp_basic_ack_t* ack = static_cast<amqp_basic_ack_t *>(frame.payload.method.decoded);
+                if (pChannel)
+                    pChannel->handleConfirm(ack->delivery_tag, ack->multiple, kConfirmAck);
+            }
+            return 0;
+
+        case AMQP_BASIC_NACK_METHOD:
+            {
+                amqp_basic_nack_t* nack = static_cast<amqp_basic_nack_t *>(frame.payload.method.decoded);
+                if (pChannel)
+                    pChannel->handleConfirm(nack->delivery_tag, nack->multiple, kConfirmNack);
+            }
+            return 0;
+
+        case AMQP_BASIC_RETURN_METHOD:
+            {
+                amqp_message_t message;
+                amqp_rpc_reply_t res = amqp_read_message(helper_.connection_, frame.channel, &message, 0);
+                if (AMQP_RESPONSE_NORMAL != res.reply_type)
+                    return -1;
+
+                amqp_destroy_message(&message);
+                if (pChannel)
+                    ++pChannel->returned_count_;
+                log_warning("basic.return on channel %d", frame.channel);
+            }
+            return 0;
+
+        case AMQP_BASIC_CANCEL_METHOD:
+            log_warning("consumer cancelled by broker on channel %d", frame.channel);
+            return 0;
+
+        case AMQP_CHANNEL_CLOSE_METHOD:
+            if (pChannel)
+                pChannel->closeByPeer();
+            close_channel(frame.channel);
+            return 0;
+
+        case AMQP_CONNECTION_CLOSE_METHOD:
+            log_warning("connection closed by broker");
+            helper_.closeConnection();
+            return 0;
+
+        default:
+            log_err("An unexpected method was received %u on channel %d",
+                    frame.payload.method.id, frame.channel);
+            return 0;
+    }
+}
+
+int RabbitMux::read_delivery(const amqp_frame_t& frame) {
+
+    // 和amqp_consume_message相同，deliver中的数据在连接的内存池中，需要先拷贝
+    amqp_basic_deliver_t* deliver = static_cast<amqp_basic_deliver_t *>(frame.payload.method.decoded);
+
+    RabbitMessagePtr message = std::make_shared<RabbitMessage>();
+    amqp_envelope_t& envelope = message->envelope;
+    envelope.channel = frame.channel;
+    envelope.consumer_tag = amqp_bytes_malloc_dup(deliver->consumer_tag);
+    envelope.delivery_tag = deliver->delivery_tag;
+    envelope.redelivered = deliver->redelivered;
+    envelope.exchange = amqp_bytes_malloc_dup(deliver->exchange);
+    envelope.routing_key = amqp_bytes_malloc_dup(deliver->routing_key);
+    message->touch();
+
+    // 读取header和body帧，其他通道的帧会被librabbitmq暂存，之后再分发
+    amqp_rpc_reply_t res = amqp_read_message(helper_.connection_, frame.channel, &envelope.message, 0);
+    if (AMQP_RESPONSE_NORMAL != res.reply_type) {
+        log_err("read message on channel %d failed.", frame.channel);
+        return -1;
+    }
+
+    RabbitMuxChannelPtr mux_channel = channel(frame.channel);
+    if (!mux_channel || !mux_channel->isChannelOpen()) {
+        log_warning("drop delivery %lu on closed channel %d", envelope.delivery_tag, frame.channel);
+        return 0;
+    }
+
+    mux_channel->onDeliver(message);
+    return 0;
+}
+
+void RabbitMux::close_channel(amqp_channel_t id) {
+
+    // 未确认的消息在RabbitChannel关闭的时候得到kConfirmLost
+    helper_.freeChannel(id);
+
+    RabbitMuxChannelPtr mux_channel = channel(id);
+    if (mux_channel) {
+        mux_channel->onClose();
+        channels_[id].reset();
+    }
+}
+
+void RabbitMux::close_all() {
+
+    helper_.closeConnection();
+
+    for (size_t i = 0; i < channels_.size(); ++i) {
+        if (channels_[i])
+            channels_[i]->onClose();
+    }
+    channels_.clear();
+
+    std::deque<Command> commands;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        running_ = false;
+        commands.swap(commands_);
+    }
+
+    for (size_t i = 0; i < commands.size(); ++i)
+        commands[i].promise_.set_value(-1);
+}
+
+} // end namespace roo
@@ -0,0 +1,554 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <cstdlib>
+
+#include <boost/lexical_cast.hpp>
+
+#include <connect/RedisCluster.h>
+
+namespace roo {
+
+static const int kMaxRedirects = 5;
+
+// CRC16-CCITT(XMODEM)，多项式0x1021，和redis cluster的实现一致
+static const uint16_t kCrc16Table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
+};
+
+static uint16_t crc16(const char* buf, size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; ++i) {
+        crc = (crc << 8) ^ kCrc16Table[((crc >> 8) ^ static_cast<uint8_t>(buf[i])) & 0xFF];
+    }
+    return crc;
+}
+
+// host:port
+static bool parse_addr(const std::string& addr, std::string& host, int& port) {
+
+    std::string::size_type pos = addr.rfind(':');
+    if (pos == std::string::npos || pos == 0 || pos + 1 == addr.size())
+        return false;
+
+    host = addr.substr(0, pos);
+    port = ::atoi(addr.c_str() + pos + 1);
+    return port > 0;
+}
+
+// MOVED 3999 127.0.0.1:6381 或者 ASK 3999 127.0.0.1:6381
+static bool parse_redirect(const std::string& error, bool& ask, uint16_t& slot, std::string& addr) {
+
+    if (error.compare(0, 6, "MOVED ") == 0) {
+        ask = false;
+    } else if (error.compare(0, 4, "ASK ") == 0) {
+        ask = true;
+    } else {
+        return false;
+    }
+
+    std::string::size_type first = error.find(' ');
+    std::string::size_type second = error.find(' ', first + 1);
+    if (second == std::string::npos)
+        return false;
+
+    slot = static_cast<uint16_t>(::atoi(error.c_str() + first + 1));
+    addr = error.substr(second + 1);
+    return slot < RedisCluster::kSlotNum && !addr.empty();
+}
+
+
+uint16_t RedisCluster::key_slot(const std::string& key) {
+
+    // 只有{}之间有内容的时候才使用hashtag
+    std::string::size_type start = key.find('{');
+    if (start != std::string::npos) {
+        std::string::size_type end = key.find('}', start + 1);
+        if (end != std::string::npos && end != start + 1)
+            return crc16(key.data() + start + 1, end - start - 1) & (kSlotNum - 1);
+    }
+
+    return crc16(key.data(), key.size()) & (kSlotNum - 1);
+}
+
+
+RedisCluster::RedisCluster(const std::vector<std::string>& seeds, const std::string& passwd,
+                           size_t pool_capacity, uint8_t thread_num) :
+    seeds_(seeds),
+    passwd_(passwd),
+    pool_capacity_(pool_capacity),
+    lock_(),
+    nodes_(),
+    slots_(kSlotNum),
+    last_refresh_(0),
+    refresh_lock_(),
+    executor_(thread_num) {
+}
+
+RedisCluster::~RedisCluster() {
+    executor_.terminate();
+}
+
+bool RedisCluster::init() {
+
+    if (!refresh_slots(true)) {
+        log_err("RedisCluster init load slots failed.");
+        return false;
+    }
+
+    log_info("RedisCluster init with %lu nodes.", node_count());
+    return true;
+}
+
+size_t RedisCluster::node_count() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return nodes_.size();
+}
+
+RedisCluster::NodePtr RedisCluster::get_node(const std::string& addr) {
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    auto iter = nodes_.find(addr);
+    if (iter != nodes_.end())
+        return iter->second;
+
+    std::string host;
+    int port = 0;
+    if (!parse_addr(addr, host, port)) {
+        log_err("invalid redis node address: %s", addr.c_str());
+        return NodePtr();
+    }
+
+    NodePtr node = std::make_shared<Node>();
+    node->addr_ = addr;
+    node->pool_ = std::make_shared<RedisPool>("RedisCluster_" + addr, pool_capacity_,
+                                              RedisConnPoolHelper(host, port, passwd_));
+    nodes_[addr] = node;
+
+    log_info("RedisCluster add new node %s", addr.c_str());
+    return node;
+}
+
+RedisCluster::NodePtr RedisCluster::node_of_slot(uint16_t slot) {
+    std::lock_guard<std::mutex> lock(lock_);
+    return slots_[slot];
+}
+
+void RedisCluster::update_slot(uint16_t slot, const NodePtr& node) {
+    std::lock_guard<std::mutex> lock(lock_);
+    slots_[slot] = node;
+}
+
+bool RedisCluster::load_slots(const NodePtr& node) {
+
+    redis_conn_ptr conn;
+    if (!node->pool_->request_scoped_conn(conn)) {
+        log_err("request conn from %s failed.", node->addr_.c_str());
+        return false;
+    }
+
+    redisReply_ptr reply = conn->Exec("CLUSTER SLOTS");
+    if (!reply || reply->type != REDIS_REPLY_ARRAY) {
+        log_err("CLUSTER SLOTS from %s failed.", node->addr_.c_str());
+        return false;
+    }
+
+    std::vector<NodePtr> slots(kSlotNum);
+    size_t covered = 0;
+
+    // [start, end, [ip, port, id], replicas...]
+    for (size_t i = 0; i < reply->elements; ++i) {
+
+        const redisReply* range = reply->element[i];
+        if (range->type != REDIS_REPLY_ARRAY || range->elements < 3 ||
+            range->element[0]->type != REDIS_REPLY_INTEGER ||
+            range->element[1]->type != REDIS_REPLY_INTEGER ||
+            range->element[2]->type != REDIS_REPLY_ARRAY ||
+            range->element[2]->elements < 2) {
+            log_err("unexpected CLUSTER SLOTS reply format.");
+            continue;
+        }
+
+        const redisReply* master = range->element[2];
+        if (master->element[0]->type != REDIS_REPLY_STRING ||
+            master->element[1]->type != REDIS_REPLY_INTEGER)
+            continue;
+
+        std::string addr = std::string(master->element[0]->str, master->element[0]->len) + ":" +
+                           boost::lexical_cast<std::string>(master->element[1]->integer);
+
+        // 节点没有配置地址的时候返回空串，使用当前连接的节点
+        if (master->element[0]->len == 0)
+            addr = node->addr_;
+
+        NodePtr master_node = get_node(addr);
+        if (!master_node)
+            continue;
+
+        long long start = range->element[0]->integer;
+        long long end = range->element[1]->integer;
+        for (long long slot = start; slot <= end && slot < static_cast<long long>(kSlotNum); ++slot) {
+            if (slot >= 0) {
+                slots[slot] = master_node;
+                ++covered;
+            }
+        }
+    }
+
+    if (covered == 0)
+        return false;
+
+    log_warning_if(covered != kSlotNum, "RedisCluster only %lu slots covered.", covered);
+
+    std::lock_guard<std::mutex> lock(lock_);
+    slots_.swap(slots);
+    last_refresh_ = ::time(NULL);
+    return true;
+}
+
+bool RedisCluster::refresh_slots(bool force) {
+
+    std::lock_guard<std::mutex> refresh_lock(refresh_lock_);
+
+    std::vector<NodePtr> candidates;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (!force && last_refresh_ >= ::time(NULL) - 1)
+            return true;
+
+        for (auto iter = nodes_.begin(); iter != nodes_.end(); ++iter)
+            candidates.push_back(iter->second);
+    }
+
+    for (size_t i = 0; i < seeds_.size(); ++i) {
+        NodePtr node = get_node(seeds_[i]);
+        if (node)
+            candidates.push_back(node);
+    }
+
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (load_slots(candidates[i]))
+            return true;
+    }
+
+    log_err("RedisCluster refresh slots failed from all %lu nodes.", candidates.size());
+    return false;
+}
+
+redisReply_ptr RedisCluster::ExecV(const std::string& key, const std::vector<std::string>& argv) {
+
+    uint16_t slot = key_slot(key);
+    NodePtr node = node_of_slot(slot);
+    bool asking = false;
+
+    for (int i = 0; i < kMaxRedirects; ++i) {
+
+        if (!node) {
+            refresh_slots(false);
+            node = node_of_slot(slot);
+            if (!node) {
+                log_err("no redis node serving slot %u", slot);
+                return redisReply_ptr();
+            }
+        }
+
+        redis_conn_ptr conn;
+        if (!node->pool_->request_scoped_conn(conn)) {
+            log_err("request conn from %s failed.", node->addr_.c_str());
+            refresh_slots(false);
+            node.reset();
+            continue;
+        }
+
+        RedisPipeline pipeline(*conn);
+        if (asking)
+            pipeline.Append({ "ASKING" });
+        size_t index = pipeline.Append(argv);
+
+        if (!pipeline.Exec()) {
+            // 连接出错，可能发生了主从切换
+            log_err("exec on %s failed.", node->addr_.c_str());
+            refresh_slots(false);
+            node.reset();
+            asking = false;
+            continue;
+        }
+
+        std::string error = pipeline.error(index);
+        if (error.empty())
+            return pipeline.reply(index);
+
+        uint16_t redirect_slot = 0;
+        std::string addr;
+        if (!parse_redirect(error, asking, redirect_slot, addr)) {
+            log_err("exec failed with error: %s", error.c_str());
+            return redisReply_ptr();
+        }
+
+        node = get_node(addr);
+        if (!asking && node) {
+            update_slot(redirect_slot, node);
+            refresh_slots(false);
+        }
+    }
+
+    log_err("too many redirects for key %s", key.c_str());
+    return redisReply_ptr();
+}
+
+bool RedisCluster::Get(const std::string& key, std::string& value) {
+
+    redisReply_ptr reply = ExecV(key, { "GET", key });
+    if (!reply)
+        return false;
+
+    if (reply->type == REDIS_REPLY_STRING && reply->str != NULL) {
+        value.assign(reply->str, reply->len);
+        return true;
+    } else if (reply->type == REDIS_REPLY_INTEGER) {
+        value = boost::lexical_cast<std::string>(reply->integer);
+        return true;
+    }
+
+    return false;
+}
+
+bool RedisCluster::Set(const std::string& key, const std::string& value, int expire) {
+
+    redisReply_ptr reply;
+    if (expire > 0) {
+        reply = ExecV(key, { "SET", key, value, "EX", boost::lexical_cast<std::string>(expire) });
+    } else {
+        reply = ExecV(key, { "SET", key, value });
+    }
+
+    return reply &&
+           reply->type == REDIS_REPLY_STATUS &&
+           reply->str != NULL &&
+           ::strcmp(reply->str, "OK") == 0;
+}
+
+boost::optional<int64_t> RedisCluster::Incr(const std::string& key) {
+
+    redisReply_ptr reply = ExecV(key, { "INCR", key });
+    if (reply && reply->type == REDIS_REPLY_INTEGER)
+        return static_cast<int64_t>(reply->integer);
+
+    return boost::none;
+}
+
+int RedisCluster::Expire(const std::string& key, int expire) {
+
+    if (key.empty() || expire < 0)
+        return -1;
+
+    redisReply_ptr reply = ExecV(key, { "EXPIRE", key, boost::lexical_cast<std::string>(expire) });
+    if (reply && reply->type == REDIS_REPLY_INTEGER)
+        return static_cast<int>(reply->integer);
+
+    return -2;
+}
+
+
+void RedisCluster::exec_node_groups(NodePtr node, std::vector<SlotGroup*> groups) {
+
+    redis_conn_ptr conn;
+    if (node->pool_->request_scoped_conn(conn)) {
+
+        RedisPipeline pipeline(*conn);
+        for (size_t i = 0; i < groups.size(); ++i)
+            pipeline.Append(groups[i]->argv_);
+
+        if (pipeline.Exec()) {
+            for (size_t i = 0; i < groups.size(); ++i) {
+                if (pipeline.error(i).empty())
+                    groups[i]->reply_ = pipeline.reply(i);
+            }
+        }
+    }
+
+    // 失败或者需要重定向的命令单独重试
+    for (size_t i = 0; i < groups.size(); ++i) {
+        if (!groups[i]->reply_) {
+            const std::string& key = groups[i]->argv_[1];
+            groups[i]->reply_ = ExecV(key, groups[i]->argv_);
+        }
+    }
+}
+
+bool RedisCluster::exec_groups(const char* command, const std::vector<std::string>& keys,
+                               const std::vector<std::string>* values, std::vector<SlotGroup>& groups) {
+
+    // 按照slot分组
+    std::map<uint16_t, size_t> slot_index;
+    for (size_t i = 0; i < keys.size(); ++i) {
+
+        uint16_t slot = key_slot(keys[i]);
+        auto iter = slot_index.find(slot);
+        if (iter == slot_index.end()) {
+            iter = slot_index.insert(std::make_pair(slot, groups.size())).first;
+            groups.push_back(SlotGroup());
+            groups.back().slot_ = slot;
+            groups.back().argv_.push_back(command);
+        }
+
+        SlotGroup& group = groups[iter->second];
+        group.indices_.push_back(i);
+        group.argv_.push_back(keys[i]);
+        if (values)
+            group.argv_.push_back((*values)[i]);
+    }
+
+    // 按照节点分组
+    std::map<NodePtr, std::vector<SlotGroup*> > node_groups;
+    for (size_t i = 0; i < groups.size(); ++i) {
+        NodePtr node = node_of_slot(groups[i].slot_);
+        if (!node) {
+            refresh_slots(false);
+            node = node_of_slot(groups[i].slot_);
+        }
+
+        if (!node) {
+            log_err("no redis node serving slot %u", groups[i].slot_);
+            return false;
+        }
+
+        node_groups[node].push_back(&groups[i]);
+    }
+
+    // 第一个节点在当前线程执行，其余的节点提交到线程池并行执行
+    std::vector<Future<void> > futures;
+    auto first = node_groups.begin();
+    for (auto iter = std::next(first); iter != node_groups.end(); ++iter) {
+        futures.push_back(executor_.submit(&RedisCluster::exec_node_groups, this, iter->first, iter->second));
+    }
+
+    if (first != node_groups.end())
+        exec_node_groups(first->first, first->second);
+
+    bool success = true;
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].wait();
+        if (futures[i].has_exception())
+            success = false;
+    }
+
+    for (size_t i = 0; i < groups.size(); ++i) {
+        if (!groups[i].reply_)
+            success = false;
+    }
+
+    return success;
+}
+
+bool RedisCluster::MGet(const std::vector<std::string>& keys, std::vector<std::string>& values,
+                        const std::string& nil_value) {
+
+    if (keys.empty()) {
+        log_err("provided keys empty");
+        return false;
+    }
+
+    std::vector<SlotGroup> groups;
+    if (!exec_groups("MGET", keys, NULL, groups))
+        return false;
+
+    values.assign(keys.size(), nil_value);
+    for (size_t i = 0; i < groups.size(); ++i) {
+
+        const redisReply* reply = groups[i].reply_.get();
+        if (reply->type != REDIS_REPLY_ARRAY || reply->elements != groups[i].indices_.size()) {
+            log_err("MGET unexpected reply->type: %d", reply->type);
+            return false;
+        }
+
+        for (size_t j = 0; j < reply->elements; ++j) {
+            const redisReply* element = reply->element[j];
+            std::string& value = values[groups[i].indices_[j]];
+            if (element->type == REDIS_REPLY_STRING && element->str != NULL) {
+                value.assign(element->str, element->len);
+            } else if (element->type == REDIS_REPLY_INTEGER) {
+                value = boost::lexical_cast<std::string>(element->integer);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool RedisCluster::MSet(const std::vector<std::string>& keys, const std::vector<std::string>& values) {
+
+    if (keys.empty() || keys.size() != values.size()) {
+        log_err("param error");
+        return false;
+    }
+
+    std::vector<SlotGroup> groups;
+    if (!exec_groups("MSET", keys, &values, groups))
+        return false;
+
+    for (size_t i = 0; i < groups.size(); ++i) {
+        const redisReply* reply = groups[i].reply_.get();
+        if (reply->type != REDIS_REPLY_STATUS || reply->str == NULL || ::strcmp(reply->str, "OK") != 0)
+            return false;
+    }
+
+    return true;
+}
+
+int RedisCluster::Del(const std::vector<std::string>& keys) {
+
+    if (keys.empty())
+        return 0;
+
+    // 部分节点失败的时候，已经删除的key仍然计数，但是整体返回-1
+    std::vector<SlotGroup> groups;
+    bool success = exec_groups("DEL", keys, NULL, groups);
+
+    int deleted = 0;
+    for (size_t i = 0; i < groups.size(); ++i) {
+        const redisReply* reply = groups[i].reply_.get();
+        if (reply && reply->type == REDIS_REPLY_INTEGER)
+            deleted += static_cast<int>(reply->integer);
+    }
+
+    return success ? deleted : -1;
+}
+
+} // end namespace roo
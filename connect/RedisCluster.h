@@ -0,0 +1,116 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+
+#ifndef __ROO_CONNECT_REDIS_CLUSTER_H__
+#define __ROO_CONNECT_REDIS_CLUSTER_H__
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <connect/RedisConn.h>
+#include <connect/RedisPipeline.h>
+#include <concurrency/WorkStealingPool.h>
+
+// Redis Cluster客户端
+//
+// 按照CRC16(key) % 16384计算hash slot，key中包含{hashtag}的时候只计算hashtag。
+// slot到节点的映射通过CLUSTER SLOTS获取，收到MOVED的时候更新对应的slot并触发一次
+// 全量刷新(限频)，ASK只对本次请求生效，先发送ASKING再重试。每个节点持有一个独立的
+// ConnPool<RedisConn, RedisConnPoolHelper>。
+//
+// MGet/MSet/Del的多个key按照节点拆分，同一个slot的key合并成一个命令，每个节点上的
+// 命令通过RedisPipeline一次发送，多个节点之间在内部的线程池中并行执行。
+
+namespace roo {
+
+class RedisCluster {
+public:
+    typedef ConnPool<RedisConn, RedisConnPoolHelper> RedisPool;
+
+    static const size_t kSlotNum = 16384;
+
+    // seeds为host:port格式的初始节点，只需要能连上其中一个
+    RedisCluster(const std::vector<std::string>& seeds, const std::string& passwd,
+                 size_t pool_capacity = 8, uint8_t thread_num = 4);
+
+    ~RedisCluster();
+
+    // 禁止拷贝
+    RedisCluster(const RedisCluster&) = delete;
+    RedisCluster& operator=(const RedisCluster&) = delete;
+
+    bool init();
+
+    // 重新获取slot映射，force为false的时候每秒最多刷新一次
+    bool refresh_slots(bool force = false);
+
+    static uint16_t key_slot(const std::string& key);
+
+    // 单key命令，按照key路由并处理MOVED/ASK重定向
+    // 出错的时候返回空的redisReply_ptr，和RedisConn::Exec一致
+    redisReply_ptr ExecV(const std::string& key, const std::vector<std::string>& argv);
+
+    bool Get(const std::string& key, std::string& value);
+    bool Set(const std::string& key, const std::string& value, int expire = -1);
+    boost::optional<int64_t> Incr(const std::string& key);
+    int Expire(const std::string& key, int expire);
+
+    // 多key命令，按照节点拆分之后并行执行
+    bool MGet(const std::vector<std::string>& keys, std::vector<std::string>& values, const std::string& nil_value = "");
+    bool MSet(const std::vector<std::string>& keys, const std::vector<std::string>& values);
+    int Del(const std::vector<std::string>& keys);
+
+    size_t node_count();
+
+private:
+
+    struct Node {
+        std::string addr_;
+        std::shared_ptr<RedisPool> pool_;
+    };
+
+    typedef std::shared_ptr<Node> NodePtr;
+
+    // 同一个slot的key合并成的一个命令
+    struct SlotGroup {
+        uint16_t slot_;
+        std::vector<size_t> indices_;     // 在原始keys中的下标
+        std::vector<std::string> argv_;
+        redisReply_ptr reply_;
+    };
+
+    NodePtr get_node(const std::string& addr);
+    NodePtr node_of_slot(uint16_t slot);
+    void update_slot(uint16_t slot, const NodePtr& node);
+    bool load_slots(const NodePtr& node);
+
+    // 拆分执行，command为每个slot的命令名，values不为空的时候按照MSET的形式组织参数
+    bool exec_groups(const char* command, const std::vector<std::string>& keys,
+                     const std::vector<std::string>* values, std::vector<SlotGroup>& groups);
+    void exec_node_groups(NodePtr node, std::vector<SlotGroup*> groups);
+
+    const std::vector<std::string> seeds_;
+    const std::string passwd_;
+    const size_t pool_capacity_;
+
+    std::mutex lock_;
+    std::map<std::string, NodePtr> nodes_;
+    std::vector<NodePtr> slots_;
+    time_t last_refresh_;
+
+    std::mutex refresh_lock_;     // 同时只有一个线程刷新
+
+    WorkStealingPool<> executor_;
+};
+
+} // end namespace roo
+
+#endif // __ROO_CONNECT_REDIS_CLUSTER_H__
@@ -7,7 +7,7 @@
 
 
 #include <iostream>
-#include <boost/lexical_cast.hpp>
+#include <string/StrUtil.h>
 
 #include <connect/RedisConn.h>
 
@@ -23,15 +23,6 @@ namespace roo {
 // #define REDIS_REPLY_INTEGER 3
 // #define REDIS_REPLY_NIL 4
 
-template<typename T>
-static std::string local_convert_to_string(const T& arg) {
-    try {
-        return boost::lexical_cast<std::string>(arg);
-    } catch (boost::bad_lexical_cast& e) {
-        return "";
-    }
-}
-
 static void printReply(const redisReply* reply) {
 
     if (!reply) {
@@ -70,12 +61,22 @@ static void printReply(const redisReply* reply) {
 
 bool RedisConn::init(int64_t conn_uuid) {
 
+    if (!connect())
+        return false;
+
+    conn_uuid_ = conn_uuid;
+    log_info("Create New Redis Connection OK! UUID: %lx", conn_uuid);
+    return true;
+}
+
+bool RedisConn::connect() {
+
     struct timeval tv;
     tv.tv_sec = 5;
     tv.tv_usec = 0;
     context_.reset(redisConnectWithTimeout(helper_.host_.c_str(), helper_.port_, tv),  redisFree);
     if (!context_ || context_->err) {
-        if (context_->err) {
+        if (context_) {
             log_err("redis context_ problem: %s", context_->errstr);
             context_.reset();
         } else {
@@ -84,20 +85,20 @@ bool RedisConn::init(int64_t conn_uuid) {
         return false;
     }
 
-    if (helper_.passwd_.empty()) // same as == ""
-        return true;
+    if (!helper_.passwd_.empty()) {
 
-    redisReply_ptr r((redisReply*)redisCommand(context_.get(), "AUTH %s", helper_.passwd_.c_str()), freeReplyObject);
-    if (!r) {
-        log_err("redis conn auth error!");
-        context_.reset();
-        return false;
-    }
+        redisReply_ptr r((redisReply*)redisCommand(context_.get(), "AUTH %s", helper_.passwd_.c_str()), freeReplyObject);
+        if (!r) {
+            log_err("redis conn auth error!");
+            context_.reset();
+            return false;
+        }
 
-    if (r->type == REDIS_REPLY_ERROR) {
-        log_err("redis conn auth failed!");
-        context_.reset();
-        return false;
+        if (r->type == REDIS_REPLY_ERROR) {
+            log_err("redis conn auth failed!");
+            context_.reset();
+            return false;
+        }
     }
 
     if (helper_.db_idx_ != 0) {
@@ -108,11 +109,32 @@ bool RedisConn::init(int64_t conn_uuid) {
         }
     }
 
-    conn_uuid_ = conn_uuid;
-    log_info("Create New Redis Connection OK! UUID: %lx", conn_uuid);
     return true;
 }
 
+bool RedisConn::CHECK_N_RECONNECT() {
+
+    if (isValid())
+        return true;
+
+    // 同一个池子里面的连接同时断开的时候，只有一个线程去探测服务端
+    // 熔断器还没有失败记录的时候也要先suspect()，否则所有线程会同时重连
+    ConnBreaker& breaker = pool_.breaker();
+    breaker.suspect();
+    ConnBreaker::Permit permit = breaker.acquire();
+    if (permit == ConnBreaker::kReject)
+        return false;
+
+    context_.reset();
+    bool success = connect();
+    breaker.release(permit, success);
+
+    if (success)
+        log_info("Redis Connection reconnected, UUID: %lx", conn_uuid_);
+
+    return success;
+}
+
 bool RedisConn::ping_test() {
     ::srand(::time(NULL));
 
@@ -279,7 +301,7 @@ redisReply_ptr RedisConn::Eval(const std::string& script,
     const char* cmd = "EVAL";
     argvs.push_back(cmd);
     argvs.push_back(script.c_str());
-    std::string str_keysnum = local_convert_to_string(keys.size());
+    std::string str_keysnum = StrUtil::to_string(keys.size());
     argvs.push_back(str_keysnum.c_str());
 
     size_t index = 0;
@@ -442,7 +464,7 @@ bool RedisConn::Get(const std::string& key, std::string& value) {
         return false;
 
     if (reply->type == REDIS_REPLY_INTEGER) {
-        value = local_convert_to_string(reply->integer);
+        value = StrUtil::to_string(reply->integer);
         return true;
     } else if (reply->type == REDIS_REPLY_STRING && reply->str != NULL) {
         value = reply->str;
@@ -557,6 +579,7 @@ bool RedisConn::MGet(const std::vector<std::string>& keys, std::vector<int64_t>&
     if (!reply)
         return false;
 
+    values.reserve(values.size() + reply->elements);
     for (size_t index = 0; index < reply->elements; index++) {
         if (reply->element[index]->type == REDIS_REPLY_INTEGER) {
             values.push_back(reply->element[index]->integer);
@@ -577,11 +600,12 @@ bool RedisConn::MGet(const std::vector<std::string>& keys, std::vector<std::stri
     if (!reply)
         return false;
 
+    values.reserve(values.size() + reply->elements);
     for (size_t index = 0; index < reply->elements; index++) {
         if (reply->element[index]->type == REDIS_REPLY_INTEGER) {
-            values.push_back(local_convert_to_string(reply->element[index]->integer));
+            values.push_back(StrUtil::to_string(reply->element[index]->integer));
         } else if (reply->element[index]->type == REDIS_REPLY_STRING && reply->element[index]->str != NULL) {
-            values.push_back(reply->element[index]->str);
+            values.emplace_back(reply->element[index]->str, reply->element[index]->len);
         } else {
             values.push_back(nil_value);
         }
@@ -590,6 +614,10 @@ bool RedisConn::MGet(const std::vector<std::string>& keys, std::vector<std::stri
     return true;
 }
 
+bool RedisConn::MGet(const std::vector<std::string>& keys, RedisArrayView& values) {
+    return values.reset(MGet(keys));
+}
+
 bool RedisConn::MSet(const std::vector<std::string>& keys, const std::vector<int64_t>& values) {
 
     if (keys.empty() || keys.size() != values.size()) {
@@ -600,7 +628,7 @@ bool RedisConn::MSet(const std::vector<std::string>& keys, const std::vector<int
     std::vector<std::string> str_values;
     str_values.reserve(values.size());
     for (size_t index = 0; index < keys.size(); index++) {
-        str_values.push_back(local_convert_to_string(values[index]));
+        str_values.push_back(StrUtil::to_string(values[index]));
     }
     return MSet(keys, str_values);
 }
@@ -700,7 +728,7 @@ int RedisConn::MExpire(const std::vector<std::string>& keys, int expire) {
 
     std::string script = "for k, v in ipairs(KEYS) do redis.pcall('EXPIRE', v, ARGV[1]); end; return 0;";
     std::vector<std::string> args;
-    args.push_back(local_convert_to_string(expire));
+    args.push_back(StrUtil::to_string(expire));
     redisReply_ptr reply = Eval(script, keys, args);
 
     return 0;
@@ -768,7 +796,7 @@ bool RedisConn::HGet(const std::string& key, const std::string& hkey, std::strin
         value = reply->str;
         return true;
     } else if (reply->type == REDIS_REPLY_INTEGER) {
-        value = local_convert_to_string(reply->integer);
+        value = StrUtil::to_string(reply->integer);
         return true;
     }
 
@@ -791,8 +819,9 @@ bool RedisConn::HGetAll(const std::string& key, std::vector<std::string>& values
         return false;
     }
 
+    values.reserve(values.size() + reply->elements);
     for (size_t index = 0; index < reply->elements; index++) {
-        values.push_back(reply->element[index]->str);
+        values.emplace_back(reply->element[index]->str, reply->element[index]->len);
     }
 
     return true;
@@ -826,6 +855,10 @@ bool RedisConn::HGetAll(const std::string& key, std::map<std::string, std::strin
     return true;
 }
 
+bool RedisConn::HGetAll(const std::string& key, RedisHashView& values) {
+    return values.reset(HGetAll(key));
+}
+
 
 int RedisConn::LPush(const std::string& key, const std::string& value) {
     return listPush("LPUSH", key, value);
@@ -886,7 +919,7 @@ bool RedisConn::listPop(const char* cmd, const std::string& key, std::string& va
         return false;
 
     if (reply->type == REDIS_REPLY_INTEGER) {
-        value = local_convert_to_string(reply->integer);
+        value = StrUtil::to_string(reply->integer);
         return true;
     } else if (reply->type == REDIS_REPLY_STRING && reply->str != NULL) {
         value = reply->str;
@@ -17,11 +17,13 @@
 
 
 #include <connect/ConnPool.h>
+#include <connect/RedisReply.h>
 
 namespace roo {
 
 
 class RedisConn;
+class RedisPipeline;
 typedef std::shared_ptr<RedisConn> redis_conn_ptr;
 
 struct RedisConnPoolHelper {
@@ -39,9 +41,11 @@ public:
     const int db_idx_;
 };
 
-typedef std::shared_ptr<redisReply> redisReply_ptr;
-
 class RedisConn : public ConnStat {
+
+    // 流水线直接使用底层的redisContext
+    friend class RedisPipeline;
+
 public:
     explicit RedisConn(ConnPool<RedisConn, RedisConnPoolHelper>& pool, const RedisConnPoolHelper& helper) :
         pool_(pool), helper_(helper) {
@@ -106,6 +110,8 @@ public:
     redisReply_ptr MGet(const std::vector<std::string>& keys);
     bool MGet(const std::vector<std::string>& keys, std::vector<int64_t>& values, int64_t nil_value = 0);
     bool MGet(const std::vector<std::string>& keys, std::vector<std::string>& values, const std::string& nil_value = "");
+    // 零拷贝，values持有应答，nil的元素得到is_nil()的view
+    bool MGet(const std::vector<std::string>& keys, RedisArrayView& values);
 
     // MSET   总是返回 OK
     bool MSet(const std::vector<std::string>& keys, const std::vector<int64_t>& values);
@@ -139,6 +145,8 @@ public:
     bool HGetAll(const std::string& key, std::vector<std::string>& values);
     bool HGetAll(const std::string& key, std::map<std::string, int64_t>& values);
     bool HGetAll(const std::string& key, std::map<std::string, std::string>& values);
+    // 零拷贝，按照field排序的平铺map
+    bool HGetAll(const std::string& key, RedisHashView& values);
 
     // List
     // 执行 LPUSH 命令后，列表的长度
@@ -164,15 +172,11 @@ private:
         return (context_ && context_->err == 0);
     }
 
-    bool CHECK_N_RECONNECT() {
-        if (isValid()) {
-            return true;
-        }
+    // 连接出错的时候经过连接池的熔断器重连，熔断期间直接返回false
+    bool CHECK_N_RECONNECT();
 
-        // TODO ...
-
-        return isValid();
-    }
+    // 建立连接并完成AUTH和SELECT
+    bool connect();
 
 
     bool replyOK(const redisReply_ptr& reply) {
@@ -188,7 +192,6 @@ private:
     }
     std::shared_ptr<redisContext> context_;
 
-    // may be used in future
     ConnPool<RedisConn, RedisConnPoolHelper>& pool_;
     const RedisConnPoolHelper helper_;
     int64_t conn_uuid_;
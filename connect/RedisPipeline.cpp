@@ -0,0 +1,261 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <string/StrUtil.h>
+
+#include <connect/RedisPipeline.h>
+
+namespace roo {
+
+
+void RedisPipeline::append_arg(const char* data, size_t len) {
+    Arg arg { buffer_.size(), len };
+    buffer_.append(data, len);
+    args_.push_back(arg);
+}
+
+size_t RedisPipeline::append_command(size_t arg_num) {
+    Command command { args_.size() - arg_num, arg_num };
+    commands_.push_back(command);
+    return commands_.size() - 1;
+}
+
+const size_t RedisPipeline::kInvalidIndex;
+
+size_t RedisPipeline::Append(const std::vector<std::string>& argv) {
+
+    if (argv.empty()) {
+        log_err("pipeline append empty command.");
+        return kInvalidIndex;
+    }
+
+    for (size_t i = 0; i < argv.size(); ++i) {
+        append_arg(argv[i].data(), argv[i].size());
+    }
+    return append_command(argv.size());
+}
+
+size_t RedisPipeline::Get(const std::string& key) {
+    append_arg("GET", 3);
+    append_arg(key.data(), key.size());
+    return append_command(2);
+}
+
+size_t RedisPipeline::Set(const std::string& key, const std::string& value, int expire) {
+
+    append_arg("SET", 3);
+    append_arg(key.data(), key.size());
+    append_arg(value.data(), value.size());
+    if (expire <= 0)
+        return append_command(3);
+
+    std::string str_expire = StrUtil::to_string(expire);
+    append_arg("EX", 2);
+    append_arg(str_expire.data(), str_expire.size());
+    return append_command(5);
+}
+
+size_t RedisPipeline::Del(const std::string& key) {
+    append_arg("DEL", 3);
+    append_arg(key.data(), key.size());
+    return append_command(2);
+}
+
+size_t RedisPipeline::Incr(const std::string& key) {
+    append_arg("INCR", 4);
+    append_arg(key.data(), key.size());
+    return append_command(2);
+}
+
+size_t RedisPipeline::IncrBy(const std::string& key, int64_t value) {
+    std::string str_value = StrUtil::to_string(value);
+    append_arg("INCRBY", 6);
+    append_arg(key.data(), key.size());
+    append_arg(str_value.data(), str_value.size());
+    return append_command(3);
+}
+
+size_t RedisPipeline::Expire(const std::string& key, int expire) {
+    std::string str_expire = StrUtil::to_string(expire);
+    append_arg("EXPIRE", 6);
+    append_arg(key.data(), key.size());
+    append_arg(str_expire.data(), str_expire.size());
+    return append_command(3);
+}
+
+size_t RedisPipeline::HSet(const std::string& key, const std::string& hkey, const std::string& value) {
+    append_arg("HSET", 4);
+    append_arg(key.data(), key.size());
+    append_arg(hkey.data(), hkey.size());
+    append_arg(value.data(), value.size());
+    return append_command(4);
+}
+
+size_t RedisPipeline::HGet(const std::string& key, const std::string& hkey) {
+    append_arg("HGET", 4);
+    append_arg(key.data(), key.size());
+    append_arg(hkey.data(), hkey.size());
+    return append_command(3);
+}
+
+size_t RedisPipeline::HIncrBy(const std::string& key, const std::string& hkey, int64_t value) {
+    std::string str_value = StrUtil::to_string(value);
+    append_arg("HINCRBY", 7);
+    append_arg(key.data(), key.size());
+    append_arg(hkey.data(), hkey.size());
+    append_arg(str_value.data(), str_value.size());
+    return append_command(4);
+}
+
+size_t RedisPipeline::LPush(const std::string& key, const std::string& value) {
+    append_arg("LPUSH", 5);
+    append_arg(key.data(), key.size());
+    append_arg(value.data(), value.size());
+    return append_command(3);
+}
+
+
+bool RedisPipeline::Exec() {
+
+    replies_.clear();
+    replies_.resize(commands_.size());
+
+    if (commands_.empty())
+        return true;
+
+    if (!conn_.CHECK_N_RECONNECT())
+        return false;
+
+    redisContext* context = conn_.context_.get();
+
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+
+    for (size_t begin = 0; begin < commands_.size(); begin += chunk_size_) {
+
+        size_t end = std::min(begin + chunk_size_, commands_.size());
+
+        for (size_t i = begin; i < end; ++i) {
+
+            const Command& command = commands_[i];
+            argv.clear();
+            argvlen.clear();
+            for (size_t j = 0; j < command.arg_num_; ++j) {
+                const Arg& arg = args_[command.first_arg_ + j];
+                argv.push_back(buffer_.data() + arg.offset_);
+                argvlen.push_back(arg.len_);
+            }
+
+            if (redisAppendCommandArgv(context, static_cast<int>(argv.size()),
+                                       &argv[0], &argvlen[0]) != REDIS_OK) {
+                // 输出缓冲区中已经有了部分命令，连接不能再使用了
+                log_err("pipeline append command failed: %s", context->errstr);
+                if (!context->err) {
+                    context->err = REDIS_ERR_OTHER;
+                    ::snprintf(context->errstr, sizeof(context->errstr), "pipeline append failed");
+                }
+                return false;
+            }
+        }
+
+        // 第一次读取的时候会把整个输出缓冲区写出去
+        for (size_t i = begin; i < end; ++i) {
+
+            void* reply = NULL;
+            if (redisGetReply(context, &reply) != REDIS_OK) {
+                log_err("pipeline get reply failed: %s", context->errstr);
+                return false;
+            }
+
+            replies_[i].reset(static_cast<redisReply*>(reply), freeReplyObject);
+        }
+    }
+
+    return true;
+}
+
+void RedisPipeline::clear() {
+    buffer_.clear();
+    args_.clear();
+    commands_.clear();
+    replies_.clear();
+}
+
+const redisReply* RedisPipeline::raw_reply(size_t index) const {
+
+    if (index >= replies_.size() || !replies_[index])
+        return NULL;
+
+    const redisReply* reply = replies_[index].get();
+    if (reply->type == REDIS_REPLY_ERROR)
+        return NULL;
+
+    return reply;
+}
+
+redisReply_ptr RedisPipeline::reply(size_t index) const {
+
+    if (!raw_reply(index))
+        return redisReply_ptr();
+
+    return replies_[index];
+}
+
+std::string RedisPipeline::error(size_t index) const {
+
+    if (index >= replies_.size() || !replies_[index])
+        return "";
+
+    const redisReply* reply = replies_[index].get();
+    if (reply->type != REDIS_REPLY_ERROR || reply->str == NULL)
+        return "";
+
+    return std::string(reply->str, reply->len);
+}
+
+bool RedisPipeline::reply_ok(size_t index) const {
+
+    const redisReply* reply = raw_reply(index);
+    return reply &&
+           reply->type == REDIS_REPLY_STATUS &&
+           reply->str != NULL &&
+           ::strcmp(reply->str, "OK") == 0;
+}
+
+boost::optional<int64_t> RedisPipeline::reply_integer(size_t index) const {
+
+    const redisReply* reply = raw_reply(index);
+    if (!reply)
+        return boost::none;
+
+    if (reply->type == REDIS_REPLY_INTEGER)
+        return static_cast<int64_t>(reply->integer);
+    if (reply->type == REDIS_REPLY_STRING && reply->str != NULL)
+        return static_cast<int64_t>(::atoll(reply->str));
+
+    return boost::none;
+}
+
+boost::optional<std::string> RedisPipeline::reply_string(size_t index) const {
+
+    const redisReply* reply = raw_reply(index);
+    if (!reply)
+        return boost::none;
+
+    if (reply->type == REDIS_REPLY_STRING && reply->str != NULL)
+        return std::string(reply->str, reply->len);
+    if (reply->type == REDIS_REPLY_INTEGER)
+        return StrUtil::to_string(reply->integer);
+
+    return boost::none;
+}
+
+} // end namespace roo
@@ -0,0 +1,112 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+
+#ifndef __ROO_CONNECT_REDIS_PIPELINE_H__
+#define __ROO_CONNECT_REDIS_PIPELINE_H__
+
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include <connect/RedisConn.h>
+
+// Redis流水线
+//
+// 相互独立的多个命令先通过redisAppendCommandArgv写入输出缓冲区，一次发送之后
+// 再用redisGetReply按顺序读取应答，只需要一个RTT。命令非常多的时候按照chunk_size
+// 分批发送，避免输出缓冲区和服务端的应答缓冲区过大。
+//
+// 命令参数保存在一块连续的缓冲区中，Exec()之后可以按照Append返回的序号读取结果，
+// clear()之后可以复用。执行期间独占连接，不是线程安全的。
+
+namespace roo {
+
+class RedisPipeline {
+public:
+
+    explicit RedisPipeline(RedisConn& conn, size_t chunk_size = 512) :
+        conn_(conn),
+        chunk_size_(chunk_size ? chunk_size : 1),
+        buffer_(),
+        args_(),
+        commands_(),
+        replies_() {
+    }
+
+    // 禁止拷贝
+    RedisPipeline(const RedisPipeline&) = delete;
+    RedisPipeline& operator=(const RedisPipeline&) = delete;
+
+    // Append参数非法时返回的序号，读取结果得到空的redisReply_ptr
+    static const size_t kInvalidIndex = static_cast<size_t>(-1);
+
+    // 追加任意命令，返回其序号，空命令返回kInvalidIndex
+    size_t Append(const std::vector<std::string>& argv);
+
+    // 常用命令的封装，返回序号
+    size_t Get(const std::string& key);
+    size_t Set(const std::string& key, const std::string& value, int expire = -1);
+    size_t Del(const std::string& key);
+    size_t Incr(const std::string& key);
+    size_t IncrBy(const std::string& key, int64_t value);
+    size_t Expire(const std::string& key, int expire);
+    size_t HSet(const std::string& key, const std::string& hkey, const std::string& value);
+    size_t HGet(const std::string& key, const std::string& hkey);
+    size_t HIncrBy(const std::string& key, const std::string& hkey, int64_t value);
+    size_t LPush(const std::string& key, const std::string& value);
+
+    // 发送所有的命令并读取应答，全部命令都得到了应答(包括错误应答)返回true；
+    // 连接出错的时候后面的命令没有应答，连接被标记为不健康
+    bool Exec();
+
+    size_t size() const {
+        return commands_.size();
+    }
+
+    void clear();
+
+    // 结果访问，错误应答和没有执行的命令得到空的redisReply_ptr
+    redisReply_ptr reply(size_t index) const;
+
+    // 错误应答的信息，没有错误返回空串
+    std::string error(size_t index) const;
+
+    bool reply_ok(size_t index) const;
+    boost::optional<int64_t> reply_integer(size_t index) const;
+    boost::optional<std::string> reply_string(size_t index) const;
+
+private:
+
+    struct Arg {
+        size_t offset_;
+        size_t len_;
+    };
+
+    struct Command {
+        size_t first_arg_;
+        size_t arg_num_;
+    };
+
+    void append_arg(const char* data, size_t len);
+    size_t append_command(size_t arg_num);
+
+    const redisReply* raw_reply(size_t index) const;
+
+    RedisConn& conn_;
+    const size_t chunk_size_;
+
+    std::string          buffer_;      // 所有命令的参数
+    std::vector<Arg>     args_;
+    std::vector<Command> commands_;
+    std::vector<redisReply_ptr> replies_;
+};
+
+} // end namespace roo
+
+#endif // __ROO_CONNECT_REDIS_PIPELINE_H__
@@ -0,0 +1,250 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+
+#ifndef __ROO_CONNECT_REDIS_REPLY_H__
+#define __ROO_CONNECT_REDIS_REPLY_H__
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include <hiredis/hiredis.h>
+
+// redisReply的零拷贝访问
+//
+// RedisStringView只是指向redisReply中bulk string的指针和长度，不分配内存；
+// RedisArrayView/RedisHashView持有整个redisReply_ptr，只要view还存在，其中取出的
+// RedisStringView就是有效的。MGET/HGETALL返回大量元素的时候，调用者可以直接在
+// 应答缓冲区上解析，需要保留的值再自己to_string()。
+//
+// RedisHashView是按照field排序的平铺数组，find()二分查找，整个结果只有一次分配。
+
+namespace roo {
+
+typedef std::shared_ptr<redisReply> redisReply_ptr;
+
+class RedisStringView {
+public:
+    RedisStringView() :
+        data_(NULL), size_(0) {
+    }
+
+    RedisStringView(const char* data, size_t size) :
+        data_(data), size_(size) {
+    }
+
+    explicit RedisStringView(const std::string& str) :
+        data_(str.data()), size_(str.size()) {
+    }
+
+    // nil和非字符串的应答得到nil的view
+    explicit RedisStringView(const redisReply* reply) :
+        data_(NULL), size_(0) {
+        if (reply &&
+            (reply->type == REDIS_REPLY_STRING || reply->type == REDIS_REPLY_STATUS) &&
+            reply->str != NULL) {
+            data_ = reply->str;
+            size_ = reply->len;
+        }
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    bool is_nil() const { return data_ == NULL; }
+
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+
+    char operator[](size_t index) const { return data_[index]; }
+
+    std::string to_string() const {
+        return is_nil() ? std::string() : std::string(data_, size_);
+    }
+
+    // 解析整数，nil或者不是合法的整数的时候返回false
+    bool to_int64(int64_t& value) const {
+
+        if (is_nil() || size_ == 0 || size_ > 20)
+            return false;
+
+        char buff[24];
+        ::memcpy(buff, data_, size_);
+        buff[size_] = '\0';
+
+        char* end = NULL;
+        long long result = ::strtoll(buff, &end, 10);
+        if (end != buff + size_)
+            return false;
+
+        value = static_cast<int64_t>(result);
+        return true;
+    }
+
+    int compare(const RedisStringView& other) const {
+        size_t len = std::min(size_, other.size_);
+        int ret = len ? ::memcmp(data_, other.data_, len) : 0;
+        if (ret != 0)
+            return ret;
+        return size_ < other.size_ ? -1 : (size_ > other.size_ ? 1 : 0);
+    }
+
+    bool operator==(const RedisStringView& other) const {
+        return size_ == other.size_ && (size_ == 0 || ::memcmp(data_, other.data_, size_) == 0);
+    }
+
+    bool operator!=(const RedisStringView& other) const { return !(*this == other); }
+    bool operator<(const RedisStringView& other) const { return compare(other) < 0; }
+
+private:
+    const char* data_;
+    size_t size_;
+};
+
+
+// 数组应答(MGET/LRANGE等)的只读访问
+class RedisArrayView {
+public:
+    RedisArrayView() :
+        reply_() {
+    }
+
+    explicit RedisArrayView(const redisReply_ptr& reply) :
+        reply_() {
+        reset(reply);
+    }
+
+    // 不是数组应答的时候得到空的view，返回false
+    bool reset(const redisReply_ptr& reply) {
+        if (reply && reply->type == REDIS_REPLY_ARRAY) {
+            reply_ = reply;
+            return true;
+        }
+
+        reply_.reset();
+        return false;
+    }
+
+    size_t size() const {
+        return reply_ ? reply_->elements : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    RedisStringView operator[](size_t index) const {
+        return RedisStringView(reply_->element[index]);
+    }
+
+    const redisReply* element(size_t index) const {
+        return reply_->element[index];
+    }
+
+    // 整数和数字字符串都可以解析，其余的返回nil_value
+    int64_t integer(size_t index, int64_t nil_value = 0) const {
+        const redisReply* elem = reply_->element[index];
+        if (elem->type == REDIS_REPLY_INTEGER)
+            return static_cast<int64_t>(elem->integer);
+
+        int64_t value = 0;
+        return RedisStringView(elem).to_int64(value) ? value : nil_value;
+    }
+
+    const redisReply_ptr& reply() const {
+        return reply_;
+    }
+
+private:
+    redisReply_ptr reply_;
+};
+
+
+// HGETALL应答的平铺map，按照field排序
+class RedisHashView {
+public:
+    typedef std::pair<RedisStringView, RedisStringView> value_type;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+    RedisHashView() :
+        reply_(), items_() {
+    }
+
+    explicit RedisHashView(const redisReply_ptr& reply) :
+        reply_(), items_() {
+        reset(reply);
+    }
+
+    bool reset(const redisReply_ptr& reply) {
+
+        items_.clear();
+        reply_.reset();
+
+        if (!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements % 2 != 0)
+            return false;
+
+        reply_ = reply;
+        items_.reserve(reply->elements / 2);
+        for (size_t index = 0; index < reply->elements; index += 2) {
+            items_.push_back(value_type(RedisStringView(reply->element[index]),
+                                        RedisStringView(reply->element[index + 1])));
+        }
+
+        std::sort(items_.begin(), items_.end(), field_less);
+        return true;
+    }
+
+    size_t size() const { return items_.size(); }
+    bool empty() const { return items_.empty(); }
+
+    const_iterator begin() const { return items_.begin(); }
+    const_iterator end() const { return items_.end(); }
+
+    const value_type& operator[](size_t index) const {
+        return items_[index];
+    }
+
+    // 没有找到返回nil的view
+    RedisStringView find(const RedisStringView& field) const {
+        const_iterator iter = std::lower_bound(items_.begin(), items_.end(),
+                                               value_type(field, RedisStringView()), field_less);
+        if (iter != items_.end() && iter->first == field)
+            return iter->second;
+
+        return RedisStringView();
+    }
+
+    RedisStringView find(const std::string& field) const {
+        return find(RedisStringView(field));
+    }
+
+    RedisStringView find(const char* field) const {
+        return find(RedisStringView(field, ::strlen(field)));
+    }
+
+    const redisReply_ptr& reply() const {
+        return reply_;
+    }
+
+private:
+
+    static bool field_less(const value_type& lhs, const value_type& rhs) {
+        return lhs.first < rhs.first;
+    }
+
+    redisReply_ptr reply_;
+    std::vector<value_type> items_;
+};
+
+} // end namespace roo
+
+#endif // __ROO_CONNECT_REDIS_REPLY_H__
@@ -0,0 +1,181 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __ROO_CONTAINER_CHASE_LEV_DEQUE_H__
+#define __ROO_CONTAINER_CHASE_LEV_DEQUE_H__
+
+#include <vector>
+#include <atomic>
+
+// Chase-Lev work-stealing双端队列，内存序参考
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al. 2013)
+//
+// 只有owner线程可以调用PUSH和TAKE(LIFO端)，其他任意线程都可以调用STEAL(FIFO端)
+// 队列中只保存指针，元素的生命周期由调用者负责
+// 扩容时旧的数组可能仍然被并发的STEAL读取，所以统一延迟到析构时释放
+
+namespace roo {
+
+template<typename T>
+class ChaseLevDeque {
+
+    // 禁止拷贝
+    ChaseLevDeque(const ChaseLevDeque&) = delete;
+    ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+public:
+
+    explicit ChaseLevDeque(size_t capacity = 1024) :
+        top_(0),
+        bottom_(0),
+        array_(new Array(round_up_power_of_2(capacity))),
+        garbage_() {
+    }
+
+    ~ChaseLevDeque() {
+        delete array_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < garbage_.size(); ++i) {
+            delete garbage_[i];
+        }
+    }
+
+    // owner only
+    void PUSH(T* item) {
+
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array* a = array_.load(std::memory_order_relaxed);
+
+        if (b - t > static_cast<int64_t>(a->capacity_) - 1) {
+            a = grow(a, t, b);
+        }
+
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // owner only, 空返回NULL
+    T* TAKE() {
+
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return NULL;
+        }
+
+        T* item = a->get(b);
+        if (t == b) {
+            // 最后一个元素，需要和STEAL竞争
+            if (!top_.compare_exchange_strong(t, t + 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                item = NULL;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+
+        return item;
+    }
+
+    // any thread, 空或者竞争失败返回NULL
+    T* STEAL() {
+
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return NULL;
+        }
+
+        Array* a = array_.load(std::memory_order_acquire);
+        T* item = a->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1,
+                                          std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return NULL;
+        }
+
+        return item;
+    }
+
+    // 并发情况下只是一个近似值
+    size_t SIZE() const {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    bool EMPTY() const {
+        return SIZE() == 0;
+    }
+
+private:
+
+    struct Array {
+        explicit Array(size_t capacity) :
+            capacity_(capacity),
+            mask_(capacity - 1),
+            items_(new std::atomic<T*>[capacity]) {
+        }
+
+        ~Array() {
+            delete[] items_;
+        }
+
+        T* get(int64_t idx) const {
+            return items_[idx & mask_].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t idx, T* item) {
+            items_[idx & mask_].store(item, std::memory_order_relaxed);
+        }
+
+        const size_t capacity_;
+        const size_t mask_;
+        std::atomic<T*>* items_;
+    };
+
+    Array* grow(Array* a, int64_t t, int64_t b) {
+
+        Array* na = new Array(a->capacity_ << 1);
+        for (int64_t i = t; i < b; ++i) {
+            na->put(i, a->get(i));
+        }
+
+        garbage_.push_back(a);
+        array_.store(na, std::memory_order_release);
+        return na;
+    }
+
+    static size_t round_up_power_of_2(size_t sz) {
+        size_t cap = 2;
+        while (cap < sz)
+            cap <<= 1;
+        return cap;
+    }
+
+    static const size_t kCacheLineSize = 64;
+
+    // top_由窃取者竞争修改，bottom_只由owner修改，分开放置
+    std::atomic<int64_t> top_;
+    char pad_[kCacheLineSize - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom_;
+    std::atomic<Array*>  array_;
+
+    std::vector<Array*>  garbage_;
+};
+
+} // roo
+
+#endif // __ROO_CONTAINER_CHASE_LEV_DEQUE_H__
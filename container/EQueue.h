@@ -15,6 +15,7 @@
 #include <condition_variable>
 #include <chrono>
 #include <functional>
+#include <utility>
 
 
 namespace roo {
@@ -31,6 +32,20 @@ public:
         item_notify_.notify_one();
     }
 
+    void PUSH(T&& t) {
+        std::lock_guard<std::mutex> lock(lock_);
+        items_.push_back(std::move(t));
+        item_notify_.notify_one();
+    }
+
+    // 直接在队列中构造元素，避免临时对象的拷贝
+    template<typename... Args>
+    void EMPLACE(Args&&... args) {
+        std::lock_guard<std::mutex> lock(lock_);
+        items_.emplace_back(std::forward<Args>(args)...);
+        item_notify_.notify_one();
+    }
+
     template<typename InputIt>
     void PUSH(InputIt first, InputIt last) {
         std::lock_guard<std::mutex> lock(lock_);
@@ -48,7 +63,7 @@ public:
             item_notify_.wait(lock);
         }
 
-        T t = items_.front();
+        T t = std::move(items_.front());
         items_.pop_front();
         return t;
     }
@@ -61,12 +76,24 @@ public:
         }
 
         vec.clear();
-        vec.assign(items_.begin(), items_.end());
+        vec.assign(std::make_move_iterator(items_.begin()),
+                   std::make_move_iterator(items_.end()));
         items_.clear();
 
         return vec.size();
     }
 
+    // 持锁一次，将整个内部队列交换出去，调用者可以无锁的批量处理
+    // 原有items的内容会被清空，其已分配的空间会被队列复用
+    size_t DRAIN_INTO(std::deque<T>& items) {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        items.clear();
+        items_.swap(items);
+
+        return items.size();
+    }
+
     size_t POP(std::vector<T>& vec, size_t max_count, uint64_t msec) {
         std::unique_lock<std::mutex> lock(lock_);
 
@@ -100,9 +127,8 @@ public:
 
         size_t ret_count = 0;
         do {
-            T t = items_.front();
+            vec.emplace_back(std::move(items_.front()));
             items_.pop_front();
-            vec.emplace_back(t);
             ++ret_count;
         } while (ret_count < max_count && !items_.empty());
 
@@ -138,7 +164,7 @@ public:
             return false;
         }
 
-        t = items_.front();
+        t = std::move(items_.front());
         items_.pop_front();
         return true;
     }
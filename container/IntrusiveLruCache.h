@@ -0,0 +1,288 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __ROO_CONTAINER_INTRUSIVE_LRU_CACHE_H__
+#define __ROO_CONTAINER_INTRUSIVE_LRU_CACHE_H__
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include <stdint.h>
+
+#include "SlabPool.h"
+
+// 接口和LruCache一致的侵入式LRU缓存
+//
+// LruCache每个元素需要new一个ListNode(再拷贝一份key)，再加上unordered_map的节点，
+// 两次堆分配、两份key，链表操作也要在不相关的内存之间跳转。这里的hash链和LRU链表
+// 指针都放在同一个节点中，key只存储一份，节点从SlabPool中分配，并缓存了hash值
+// 避免rehash和比较的时候重复计算。
+//
+// 最多保存max_count个元素；和LruCache一样不持锁，使用者进行并发控制的保护
+
+namespace roo {
+
+template<typename TKey, typename TValue,
+         class Hash     = std::hash<TKey>,
+         class KeyEqual = std::equal_to<TKey> >
+class IntrusiveLruCache {
+
+public:
+    typedef TKey   key_type;
+    typedef TValue value_type;
+
+    explicit IntrusiveLruCache(size_t max_count) :
+        max_count_(max_count),
+        count_(0),
+        bucket_bits_(kInitBucketBits),
+        buckets_(1UL << kInitBucketBits, NULL),
+        pool_(),
+        head_(),
+        hash_(),
+        equal_() {
+        head_.prev_ = &head_;
+        head_.next_ = &head_;
+    }
+
+    ~IntrusiveLruCache() {
+        clear();
+    }
+
+    // 禁止拷贝
+    IntrusiveLruCache(const IntrusiveLruCache& other) = delete;
+    IntrusiveLruCache& operator=(const IntrusiveLruCache&) = delete;
+
+public:
+
+    bool find(const TKey& key, TValue& val) {
+
+        Node* node = lookup(key, hash_(key));
+        if (!node)
+            return false;
+
+        val = node->value_;
+        delink(node);
+        link_push_front(node);
+        return true;
+    }
+
+    // 不更新LRU列表
+    bool find(const TKey& key) const {
+        return lookup(key, hash_(key)) != NULL;
+    }
+
+    // 成功插入返回true，否则返回false
+    bool insert(const TKey& key, const TValue& value) {
+
+        size_t hash = hash_(key);
+        if (lookup(key, hash))
+            return false;
+
+        do_insert(key, value, hash);
+        return true;
+    }
+
+    bool insert_or_update(const TKey& key, const TValue& value) {
+
+        size_t hash = hash_(key);
+        Node* node = lookup(key, hash);
+        if (!node) {
+            do_insert(key, value, hash);
+            return true;
+        }
+
+        node->value_ = value;
+        delink(node);
+        link_push_front(node);
+        return true;
+    }
+
+    // 删除元素，不存在返回false
+    bool erase(const TKey& key) {
+
+        Node** link = bucket_link(key, hash_(key));
+        if (!*link)
+            return false;
+
+        destroy_node(link);
+        return true;
+    }
+
+    // 清空整个缓存，已经申请的slab保留复用
+    void clear() {
+
+        Link* link = head_.next_;
+        while (link != &head_) {
+            Link* next = link->next_;
+            pool_.destroy(static_cast<Node*>(link));
+            link = next;
+        }
+
+        head_.prev_ = &head_;
+        head_.next_ = &head_;
+        std::fill(buckets_.begin(), buckets_.end(), static_cast<Node*>(NULL));
+        count_ = 0;
+    }
+
+    // 对容器中的所有key进行快照并拷贝到keys中
+    // 按照MRU->LRU的顺序
+    void snapshot_keys(std::vector<TKey>& keys) const {
+
+        keys.reserve(keys.size() + count_);
+        for (const Link* link = head_.next_; link != &head_; link = link->next_) {
+            keys.push_back(static_cast<const Node*>(link)->key_);
+        }
+    }
+
+    size_t total_count() const {
+        return count_;
+    }
+
+    // 节点池和hash桶占用的内存，不包括key/value自身额外申请的内存
+    size_t total_mem_reserved() const {
+        return pool_.memory() + buckets_.capacity() * sizeof(Node*);
+    }
+
+private:
+
+    static const size_t kInitBucketBits = 4;
+
+    struct Link {
+        Link* prev_;
+        Link* next_;
+    };
+
+    struct Node : public Link {
+
+        Node(const TKey& key, const TValue& value, size_t hash) :
+            hnext_(NULL),
+            hash_(hash),
+            key_(key),
+            value_(value) {
+        }
+
+        Node*  hnext_;    // hash桶的冲突链
+        size_t hash_;
+        TKey   key_;
+        TValue value_;
+    };
+
+    size_t bucket_of(size_t hash) const {
+        return static_cast<size_t>(
+                   (static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL) >> (64 - bucket_bits_));
+    }
+
+    Node* lookup(const TKey& key, size_t hash) const {
+
+        Node* node = buckets_[bucket_of(hash)];
+        while (node && !(node->hash_ == hash && equal_(node->key_, key)))
+            node = node->hnext_;
+        return node;
+    }
+
+    // 返回指向目标节点的指针的地址，方便从单向冲突链上摘除
+    Node** bucket_link(const TKey& key, size_t hash) {
+
+        Node** link = &buckets_[bucket_of(hash)];
+        while (*link && !((*link)->hash_ == hash && equal_((*link)->key_, key)))
+            link = &(*link)->hnext_;
+        return link;
+    }
+
+    void do_insert(const TKey& key, const TValue& value, size_t hash) {
+
+        Node* node = pool_.create(key, value, hash);
+
+        Node*& bucket = buckets_[bucket_of(hash)];
+        node->hnext_ = bucket;
+        bucket = node;
+
+        link_push_front(node);
+        ++count_;
+
+        if (count_ > buckets_.size())
+            rehash();
+
+        evict();
+    }
+
+    void destroy_node(Node** link) {
+
+        Node* node = *link;
+        *link = node->hnext_;
+
+        delink(node);
+        pool_.destroy(node);
+        --count_;
+    }
+
+    // 负载因子超过1的时候桶数目翻倍，节点本身不移动
+    void rehash() {
+
+        std::vector<Node*> buckets(buckets_.size() * 2, NULL);
+        ++bucket_bits_;
+
+        for (size_t i = 0; i < buckets_.size(); ++i) {
+            Node* node = buckets_[i];
+            while (node) {
+                Node* next = node->hnext_;
+                Node*& bucket = buckets[bucket_of(node->hash_)];
+                node->hnext_ = bucket;
+                bucket = node;
+                node = next;
+            }
+        }
+
+        buckets_.swap(buckets);
+    }
+
+    // 列表操作，从LRU链表中删除该节点
+    void delink(Link* node) {
+        node->prev_->next_ = node->next_;
+        node->next_->prev_ = node->prev_;
+        node->next_ = node->prev_ = NULL;
+    }
+
+    // 在LRU链表头部增加该节点
+    void link_push_front(Link* node) {
+        node->prev_ = &head_;
+        node->next_ = head_.next_;
+        head_.next_->prev_ = node;
+        head_.next_ = node;
+    }
+
+    // 淘汰元素
+    void evict() {
+
+        while (count_ > max_count_ && count_ > 1) {
+            Node* ill = static_cast<Node*>(head_.prev_);
+
+            Node** link = &buckets_[bucket_of(ill->hash_)];
+            while (*link != ill)
+                link = &(*link)->hnext_;
+            destroy_node(link);
+        }
+    }
+
+    const size_t max_count_;      // 最大元素个数
+    size_t       count_;
+
+    size_t             bucket_bits_;
+    std::vector<Node*> buckets_;
+    SlabPool<Node>     pool_;
+
+    Link         head_;         // 循环链表的哨兵，head_.next_为MRU，head_.prev_为LRU
+
+    Hash         hash_;
+    KeyEqual     equal_;
+};
+
+} // roo
+
+#endif // __ROO_CONTAINER_INTRUSIVE_LRU_CACHE_H__
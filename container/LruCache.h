@@ -150,6 +150,20 @@ public:
         return true;
     }
 
+    // 删除元素，不存在返回false
+    bool erase(const TKey& key) {
+
+        auto iter = container_.find(key);
+        if (iter == container_.end())
+            return false;
+
+        ListNodeType* node = iter->second.node_;
+        delink(node);
+        container_.erase(iter);
+        delete node;
+        return true;
+    }
+
     // 清空整个缓存
     void clear() {
 
@@ -10,42 +10,44 @@
 
 #include <string>
 #include <vector>
+#include <chrono>
 #include <unordered_map>
 
 #include <assert.h>
 
 #include "LruCache.h"
+#include "SizeOf.h"
 
 // 基于unordered_map(hash)实现的LRU缓存数据结构，可以集成与应用软件内部的缓存机制
-// 1. (TODO) 更加准确的内存使用计算，因为某些类型(至少std::string)的存储数据是放在内存中的
-// 2. (TODO) 提供元素TTL过期自动删除的机制
+// 1. 内存使用量包括key/value持有的堆内存、hash节点、LRU链表节点和hash桶数组，
+//    key/value的计算方式可以通过模板参数替换，AllocSizeOf为按照分配器块大小的精确模式
+// 2. 元素可以设置TTL(毫秒)，find的时候惰性删除过期元素，另外可以周期性的调用
+//    sweep_expired()进行有限步数、有限时长的增量清理，insert也会顺带检查几个元素
 //
 // 除了内部保护list外，数据结构本身不持锁，使用者进行并发控制的保护
 
 namespace roo {
 
 
-// 每个元素插入后需要额外的内部管理空间
-const static size_t kSizeAdditional =
-    sizeof(ValueNode<int32_t, int32_t>) + sizeof(ListNode<int32_t>) - sizeof(int32_t) - sizeof(int32_t);
+// 带有过期时间的ValueNode，过期时间直接存储在节点中，不需要额外的内存分配
+template<typename TKey, typename TValue>
+struct ExpireValueNode {
 
-// 默认的空间占用量计算，对于某些类型返回的类型长度可能不准确
-template<typename T>
-struct SizeOf : std::unary_function<T, size_t> {
-    size_t operator ()(const T& t) const {
-        return sizeof(t);
-    }
-};
+    typedef ListNode<TKey> ListNodeType;
 
-// 特例化常用的std::string类型的参数
-// sizeof(std::string)默认返回是8(64位机器)，然后再加上实际的数据使用量
-template<>
-size_t SizeOf<std::string>::operator()(const std::string& t) const {
-    // 觉得使用capacity可能更准确一些???
-    //return sizeof(std::string) + t.capacity();
+    ExpireValueNode() :
+        node_(NULL),
+        expire_(0) { }
 
-    return sizeof(std::string) + t.size();
-}
+    ExpireValueNode(const TValue& value, ListNodeType* node, uint64_t expire) :
+        value_(value),
+        node_(node),
+        expire_(expire) { }
+
+    TValue        value_;
+    ListNodeType* node_;
+    uint64_t      expire_;    // steady_clock毫秒，0表示永不过期
+};
 
 template<typename TKey, typename TValue,
          class ValueSize = SizeOf<TValue>,
@@ -57,16 +59,23 @@ public:
     typedef TValue value_type;
 
     typedef ListNode<TKey> ListNodeType;
-    typedef ValueNode<TKey, TValue> ValueNodeType;
+    typedef ExpireValueNode<TKey, TValue> ValueNodeType;
 
     typedef std::unordered_map<TKey, ValueNodeType> Container;
     typedef std::pair<const TKey, TValue>  SnapshotValue;
 
 
-    LruCacheMem(size_t max_count, size_t max_memory = 0) :
+    // default_ttl_ms为0表示默认不过期
+    LruCacheMem(size_t max_count, size_t max_memory = 0, uint64_t default_ttl_ms = 0) :
         max_count_(max_count),
         max_memory_(max_memory),
         mem_used_(0),
+        buckets_mem_(0),
+        default_ttl_ms_(default_ttl_ms),
+        ttl_used_(default_ttl_ms != 0),
+        sweep_cursor_(NULL),
+        expired_count_(0),
+        evicted_count_(0),
         head_(),
         tail_() {
         head_.prev_ = NULL;
@@ -92,6 +101,13 @@ public:
         if (iter == container_.end())
             return false;
 
+        // 惰性删除过期的元素
+        if (is_expired(iter->second)) {
+            remove(iter);
+            ++expired_count_;
+            return false;
+        }
+
         ListNodeType* node = iter->second.node_;
         val = iter->second.value_;
         delink(node);
@@ -100,17 +116,37 @@ public:
     }
 
 
-    // 不更新LRU列表
+    // 不更新LRU列表，过期的元素视为不存在
     bool find(const TKey& key) const {
-        return container_.find(key) != container_.end();
+        auto iter = container_.find(key);
+        return iter != container_.end() && !is_expired(iter->second);
     }
 
 
     // 成功插入返回true，否则返回false
     bool insert(const TKey& key, const TValue& value) {
+        return insert(key, value, default_ttl_ms_);
+    }
+
+    // 指定该元素的TTL，0表示永不过期
+    bool insert(const TKey& key, const TValue& value, uint64_t ttl_ms) {
+
+        if (ttl_used_)
+            sweep_expired(kSweepOnInsert, 0);
+
+        auto iter = container_.find(key);
+        if (iter != container_.end()) {
+
+            // 已经过期的元素直接被替换
+            if (!is_expired(iter->second))
+                return false;
+
+            remove(iter);
+            ++expired_count_;
+        }
 
         ListNodeType* node = new ListNodeType(key);
-        ValueNodeType valNode(value, node);
+        ValueNodeType valNode(value, node, make_expire(ttl_ms));
 
         std::pair<typename Container::iterator, bool> ret = container_.insert(
             typename Container::value_type(key, valNode)
@@ -123,35 +159,92 @@ public:
         }
 
         link_push_front(node);
-        mem_used_ = mem_used_ + calc_item_size(key, value);
+        mem_used_ = mem_used_ + calc_item_size(*ret.first);
+        update_buckets_mem();
 
         evict();
         return true;
     }
 
     bool insert_or_update(const TKey& key, const TValue& value) {
+        return insert_or_update(key, value, default_ttl_ms_);
+    }
+
+    // 更新的时候同时刷新TTL
+    bool insert_or_update(const TKey& key, const TValue& value, uint64_t ttl_ms) {
 
         auto iter = container_.find(key);
         if (iter == container_.end())
-            return insert(key, value);
+            return insert(key, value, ttl_ms);
 
         // update
         ValueNodeType& oldValue = iter->second;
         size_t old_value_size = calc_value_size_(oldValue.value_);
         oldValue.value_ = value;
+        oldValue.expire_ = make_expire(ttl_ms);
 
         delink(oldValue.node_);
         link_push_front(oldValue.node_);
-        mem_used_ = mem_used_ + calc_value_size_(value) - old_value_size;
+        mem_used_ = mem_used_ + calc_value_size_(oldValue.value_) - old_value_size;
 
         evict();
         return true;
     }
 
-    // 清空整个缓存
+    // 删除元素，不存在返回false
+    bool erase(const TKey& key) {
+
+        auto iter = container_.find(key);
+        if (iter == container_.end())
+            return false;
+
+        remove(iter);
+        return true;
+    }
+
+    // 从LRU尾部开始增量的清理过期元素，每次最多检查max_check个元素，
+    // max_msec不为0时还限制本次清理的时长；下次调用从上次停止的位置继续。
+    // 可以通过Timer周期性的调用，返回本次删除的元素个数
+    size_t sweep_expired(size_t max_check = 128, uint64_t max_msec = 20) {
+
+        if (!ttl_used_)
+            return 0;
+
+        uint64_t now = now_ms();
+        uint64_t deadline = now + max_msec;
+        size_t removed = 0;
+
+        for (size_t i = 0; i < max_check && !container_.empty(); ++i) {
+
+            if (!sweep_cursor_ || sweep_cursor_ == &head_)
+                sweep_cursor_ = tail_.prev_;
+
+            ListNodeType* node = sweep_cursor_;
+            sweep_cursor_ = node->prev_;
+
+            const auto iter = container_.find(node->key_);
+            assert(iter != container_.cend());
+
+            if (is_expired(iter->second, now)) {
+                remove(iter);
+                ++expired_count_;
+                ++removed;
+            }
+
+            if (max_msec && (i & 0xF) == 0xF) {
+                now = now_ms();
+                if (now >= deadline)
+                    break;
+            }
+        }
+
+        return removed;
+    }
+
+    // 清空整个缓存，同时释放hash桶数组
     void clear() {
 
-        container_.clear();
+        Container().swap(container_);
         ListNodeType* node = head_.next_;
         ListNodeType* next;
         while (node != &tail_) {
@@ -164,6 +257,8 @@ public:
         head_.next_ = &tail_;
         tail_.prev_ = &head_;
         mem_used_ = 0;
+        buckets_mem_ = 0;
+        sweep_cursor_ = NULL;
     }
 
     // 对容器中的所有key进行快照并拷贝到keys中
@@ -183,19 +278,84 @@ public:
     }
 
     size_t total_mem_used() const {
-        return mem_used_;
+        return mem_used_ + buckets_mem_;
+    }
+
+    // 因为过期被删除的元素个数
+    uint64_t expired_count() const {
+        return expired_count_;
+    }
+
+    // 因为容量限制被淘汰的元素个数
+    uint64_t evicted_count() const {
+        return evicted_count_;
     }
 
 private:
 
-    size_t calc_item_size(const TKey& key, const TValue& val) const {
-        return  calc_key_size_(key) * 2 +
-               calc_value_size_(val) +
-               kSizeAdditional;
+    static const size_t kSweepOnInsert = 2;
+
+    static uint64_t now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t make_expire(uint64_t ttl_ms) {
+        if (ttl_ms == 0)
+            return 0;
+
+        ttl_used_ = true;
+        return now_ms() + ttl_ms;
+    }
+
+    static bool is_expired(const ValueNodeType& value, uint64_t now) {
+        return value.expire_ != 0 && value.expire_ <= now;
+    }
+
+    // 只有设置了TTL的元素才需要读取时钟
+    static bool is_expired(const ValueNodeType& value) {
+        return value.expire_ != 0 && value.expire_ <= now_ms();
+    }
+
+    // 删除元素并更新统计
+    void remove(typename Container::iterator iter) {
+        ListNodeType* node = iter->second.node_;
+        mem_used_ = mem_used_ - calc_item_size(*iter);
+        delink(node);
+        container_.erase(iter);
+        delete node;
+    }
+
+    // 每个元素除了key/value之外的管理开销，包括hash节点和LRU链表节点的
+    // 分配块大小，key在两个节点中各存储一份
+    static size_t item_overhead() {
+        typedef typename Container::value_type HashValue;
+        typedef size_detail::HashNodeLayout<HashValue,
+                size_detail::HashCached<TKey, typename Container::hasher>::value> HashNode;
+
+        return malloc_usable(sizeof(HashNode)) + malloc_usable(sizeof(ListNodeType))
+               - 2 * sizeof(TKey) - sizeof(TValue);
+    }
+
+    // 必须使用容器中存储的对象计算，插入和删除时才能保持一致
+    size_t calc_item_size(const typename Container::value_type& item) const {
+        return calc_key_size_(item.first) +
+               calc_key_size_(item.second.node_->key_) +
+               calc_value_size_(item.second.value_) +
+               item_overhead();
+    }
+
+    // 只有一个桶的时候使用的是容器内部的存储
+    void update_buckets_mem() {
+        size_t buckets = container_.bucket_count();
+        buckets_mem_ = buckets > 1 ? malloc_usable(buckets * sizeof(void*)) : 0;
     }
 
     // 列表操作，从LRU链表中删除该节点
     void delink(ListNodeType* node) {
+        if (node == sweep_cursor_)
+            sweep_cursor_ = node->prev_;
+
         ListNodeType* prev_ = node->prev_;
         ListNodeType* next_ = node->next_;
         prev_->next_ = node->next_;
@@ -217,7 +377,7 @@ private:
     void evict() {
 
         while (container_.size() >= max_count_ ||
-               (max_memory_ != 0 && mem_used_ >= max_memory_)) {
+               (max_memory_ != 0 && total_mem_used() >= max_memory_)) {
 
             if (container_.size() <= 1)
                 return;
@@ -229,10 +389,13 @@ private:
             const auto iter = container_.find(ill->key_);
             assert(iter != container_.cend());
 
-            mem_used_ = mem_used_ - (calc_item_size(iter->first, iter->second.value_) + kSizeAdditional);
-            delink(ill);
-            container_.erase(ill->key_);
-            delete ill;
+            if (is_expired(iter->second)) {
+                ++expired_count_;
+            } else {
+                ++evicted_count_;
+            }
+
+            remove(iter);
         }
     }
 
@@ -241,8 +404,16 @@ private:
     ValueSize    calc_value_size_;
     KeySize      calc_key_size_;
 
-    const size_t max_memory_;     // 最大内存占用量(估算)
-    size_t       mem_used_;
+    const size_t max_memory_;     // 最大内存占用量
+    size_t       mem_used_;       // 所有元素的占用量
+    size_t       buckets_mem_;    // hash桶数组
+
+    const uint64_t default_ttl_ms_;
+    bool           ttl_used_;       // 没有使用TTL的时候不需要读取时钟
+    ListNodeType*  sweep_cursor_;   // 增量清理的位置，从LRU向MRU方向推进
+
+    uint64_t     expired_count_;
+    uint64_t     evicted_count_;
 
     Container    container_;   // 主元素存储hash容器
 
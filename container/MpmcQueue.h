@@ -0,0 +1,377 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __ROO_CONTAINER_MPMC_QUEUE_H__
+#define __ROO_CONTAINER_MPMC_QUEUE_H__
+
+#include <vector>
+#include <cstdint>
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// 基于Dmitry Vyukov的bounded MPMC算法实现的无锁环形队列，每个槽位带有一个
+// 序列号，生产者和消费者通过CAS推进head/tail，互相之间不需要持锁。
+//
+// 接口和EQueue保持一致(PUSH/POP/POP(vec, max, msec)/TRY_POP)，方便
+// DeferTask和AsyncTask通过模板参数直接切换。
+//
+// 阻塞模式采用先自旋、再让出CPU、最后挂起在条件变量上的混合策略，只有在确实
+// 有线程挂起的时候，生产者/消费者才会去触碰mutex进行唤醒。
+//
+// 由于是定长队列，队列满时PUSH会阻塞，可以使用TRY_PUSH进行非阻塞的尝试；
+// EQueue中的UNIQUE_PUSH、SHRINK_FRONT需要遍历整个队列，这里不提供。
+
+namespace roo {
+
+template<typename T>
+class MpmcQueue {
+
+    // 禁止拷贝
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+public:
+
+    static const size_t kDefaultCapacity = 4096;
+
+    explicit MpmcQueue(size_t capacity = kDefaultCapacity) :
+        capacity_(round_up_power_of_2(capacity)),
+        mask_(capacity_ - 1),
+        cells_(new Cell[capacity_]),
+        enqueue_pos_(0),
+        dequeue_pos_(0),
+        not_empty_(),
+        not_full_() {
+
+        for (size_t i = 0; i < capacity_; ++i) {
+            cells_[i].sequence_.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpmcQueue() {
+        T t;
+        while (do_dequeue(t)) {
+            // drop remaining items
+        }
+        delete[] cells_;
+    }
+
+    // 队列满的时候阻塞，直到有空闲槽位
+    void PUSH(const T& t) {
+        if (do_enqueue(t))
+            return;
+
+        wait_for(not_full_, [&]() { return do_enqueue(t); });
+    }
+
+    // 入队失败的时候t不会被移走，可以安全重试
+    void PUSH(T&& t) {
+        if (do_enqueue(std::move(t)))
+            return;
+
+        wait_for(not_full_, [&]() { return do_enqueue(std::move(t)); });
+    }
+
+    template<typename InputIt>
+    void PUSH(InputIt first, InputIt last) {
+        for (; first != last; ++first) {
+            PUSH(*first);
+        }
+    }
+
+    // 队列满直接返回false
+    bool TRY_PUSH(const T& t) {
+        return do_enqueue(t);
+    }
+
+    bool TRY_PUSH(T&& t) {
+        return do_enqueue(std::move(t));
+    }
+
+    void POP(T& t) {
+        if (do_dequeue(t))
+            return;
+
+        wait_for(not_empty_, [&]() { return do_dequeue(t); });
+    }
+
+    T POP() {
+        T t;
+        POP(t);
+        return t;
+    }
+
+    bool POP(T& t, uint64_t msec) {
+        if (do_dequeue(t))
+            return true;
+
+        auto expire_tp = std::chrono::steady_clock::now() + std::chrono::milliseconds(msec);
+        return wait_until(not_empty_, expire_tp, [&]() { return do_dequeue(t); });
+    }
+
+    size_t TRY_POP(std::vector<T>& vec) {
+
+        T t;
+        if (!do_dequeue(t))
+            return 0;
+
+        vec.clear();
+        do {
+            vec.emplace_back(std::move(t));
+        } while (do_dequeue(t));
+
+        return vec.size();
+    }
+
+    // 至少等待到一个元素或者超时，然后非阻塞的取出最多max_count个元素
+    size_t POP(std::vector<T>& vec, size_t max_count, uint64_t msec) {
+
+        T t;
+        if (!POP(t, msec))
+            return 0;
+
+        size_t ret_count = 0;
+        do {
+            vec.emplace_back(std::move(t));
+            ++ret_count;
+        } while (ret_count < max_count && do_dequeue(t));
+
+        return ret_count;
+    }
+
+    // 并发情况下只是一个近似值
+    size_t SIZE() const {
+        size_t tail = dequeue_pos_.load(std::memory_order_acquire);
+        size_t head = enqueue_pos_.load(std::memory_order_acquire);
+        return head > tail ? head - tail : 0;
+    }
+
+    bool EMPTY() const {
+        return SIZE() == 0;
+    }
+
+    size_t CAPACITY() const {
+        return capacity_;
+    }
+
+private:
+
+    // 槽位本身不做缓存行对齐，相邻槽位的伪共享由序列号推进的错开来缓解
+    struct Cell {
+        std::atomic<size_t> sequence_;
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage_;
+
+        T* ptr() {
+            return reinterpret_cast<T*>(&storage_);
+        }
+    };
+
+    // 只有在有线程挂起的时候，通知方才会去持锁唤醒；epoch_的作用类似于eventcount，
+    // 等待方检查条件时不需要持锁，避免两个方向的唤醒之间互相持锁
+    struct Parker {
+        std::mutex lock_;
+        std::condition_variable notify_;
+        std::atomic<int> waiters_;
+        std::atomic<uint32_t> epoch_;
+
+        Parker() : lock_(), notify_(), waiters_(0), epoch_(0) { }
+
+        uint32_t prepare_wait() {
+            waiters_.fetch_add(1, std::memory_order_seq_cst);
+            uint32_t epoch = epoch_.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return epoch;
+        }
+
+        void cancel_wait() {
+            waiters_.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        void wakeup() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiters_.load(std::memory_order_relaxed) > 0) {
+                {
+                    std::lock_guard<std::mutex> lock(lock_);
+                    epoch_.fetch_add(1, std::memory_order_release);
+                }
+                notify_.notify_all();
+            }
+        }
+    };
+
+    template<typename U>
+    bool do_enqueue(U&& data) {
+
+        Cell* cell = NULL;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence_.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        new (cell->ptr()) T(std::forward<U>(data));
+        cell->sequence_.store(pos + 1, std::memory_order_release);
+
+        not_empty_.wakeup();
+        return true;
+    }
+
+    bool do_dequeue(T& data) {
+
+        Cell* cell = NULL;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence_.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;  // empty
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        data = std::move(*cell->ptr());
+        cell->ptr()->~T();
+        cell->sequence_.store(pos + mask_ + 1, std::memory_order_release);
+
+        not_full_.wakeup();
+        return true;
+    }
+
+    static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#else
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+    }
+
+    // 自旋 -> yield -> 挂起
+    template<typename Pred>
+    void wait_for(Parker& parker, Pred pred) {
+
+        for (int i = 0; i < kSpinCount; ++i) {
+            cpu_relax();
+            if (pred())
+                return;
+        }
+
+        for (int i = 0; i < kYieldCount; ++i) {
+            std::this_thread::yield();
+            if (pred())
+                return;
+        }
+
+        for (;;) {
+            uint32_t epoch = parker.prepare_wait();
+            if (pred()) {
+                parker.cancel_wait();
+                return;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(parker.lock_);
+                while (parker.epoch_.load(std::memory_order_relaxed) == epoch) {
+                    parker.notify_.wait(lock);
+                }
+            }
+
+            parker.cancel_wait();
+            if (pred())
+                return;
+        }
+    }
+
+    template<typename Pred>
+    bool wait_until(Parker& parker, const std::chrono::steady_clock::time_point& expire_tp, Pred pred) {
+
+        for (int i = 0; i < kSpinCount; ++i) {
+            cpu_relax();
+            if (pred())
+                return true;
+        }
+
+        for (;;) {
+            uint32_t epoch = parker.prepare_wait();
+            if (pred()) {
+                parker.cancel_wait();
+                return true;
+            }
+
+            bool timeout = false;
+            {
+                std::unique_lock<std::mutex> lock(parker.lock_);
+                while (parker.epoch_.load(std::memory_order_relaxed) == epoch) {
+                    if (parker.notify_.wait_until(lock, expire_tp) == std::cv_status::timeout) {
+                        timeout = true;
+                        break;
+                    }
+                }
+            }
+
+            parker.cancel_wait();
+            if (pred())
+                return true;
+            if (timeout)
+                return false;
+        }
+    }
+
+    static size_t round_up_power_of_2(size_t sz) {
+        size_t cap = 2;
+        while (cap < sz)
+            cap <<= 1;
+        return cap;
+    }
+
+    static const int kSpinCount  = 128;
+    static const int kYieldCount = 16;
+    static const size_t kCacheLineSize = 64;
+
+    typedef char cacheline_pad_t[kCacheLineSize];
+
+    cacheline_pad_t     pad0_;
+    const size_t        capacity_;
+    const size_t        mask_;
+    Cell* const         cells_;
+
+    // 生产者、消费者的游标各自独占缓存行，避免伪共享
+    cacheline_pad_t     pad1_;
+    std::atomic<size_t> enqueue_pos_;
+    cacheline_pad_t     pad2_;
+    std::atomic<size_t> dequeue_pos_;
+    cacheline_pad_t     pad3_;
+
+    Parker              not_empty_;
+    Parker              not_full_;
+};
+
+template<typename T>
+const size_t MpmcQueue<T>::kDefaultCapacity;
+
+} // roo
+
+#endif // __ROO_CONTAINER_MPMC_QUEUE_H__
@@ -0,0 +1,174 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __ROO_CONTAINER_SHARDED_LRU_CACHE_H__
+#define __ROO_CONTAINER_SHARDED_LRU_CACHE_H__
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+
+#include "LruCacheMem.h"
+
+// 线程安全的分片LRU缓存
+//
+// LruCache/LruCacheMem本身不持锁，find()也会修改LRU链表，外面包一把全局锁的话
+// 所有的读操作都会被串行化。这里按照key的hash值分散到2^N个分片中，每个分片
+// 是独立加锁的LruCacheMem，分片之间按照cache line隔开避免伪共享。
+//
+// 容量(元素个数、内存)平均分配到各个分片，所以LRU淘汰是分片内部近似的；
+// total_count/total_mem_used需要逐个分片加锁累加，不要在热点路径上调用。
+
+namespace roo {
+
+template<typename TKey, typename TValue,
+         class ValueSize = SizeOf<TValue>,
+         class KeySize   = SizeOf<TKey>,
+         class Hash      = std::hash<TKey> >
+class ShardedLruCache {
+
+public:
+    typedef TKey   key_type;
+    typedef TValue value_type;
+
+    typedef LruCacheMem<TKey, TValue, ValueSize, KeySize> ShardCache;
+
+    static const size_t kDefaultShardNum = 16;
+
+    explicit ShardedLruCache(size_t max_count, size_t max_memory = 0,
+                             size_t shard_num = kDefaultShardNum) :
+        shard_bits_(0),
+        shards_(),
+        hash_() {
+
+        if (shard_num == 0)
+            shard_num = 1;
+
+        while ((1UL << shard_bits_) < shard_num)
+            ++shard_bits_;
+        shard_num = 1UL << shard_bits_;
+
+        // 向上取整，保证总容量不小于指定的值
+        size_t shard_count  = (max_count + shard_num - 1) / shard_num;
+        size_t shard_memory = (max_memory + shard_num - 1) / shard_num;
+
+        shards_.reserve(shard_num);
+        for (size_t i = 0; i < shard_num; ++i) {
+            shards_.emplace_back(new Shard(shard_count, shard_memory));
+        }
+    }
+
+    // 禁止拷贝
+    ShardedLruCache(const ShardedLruCache& other) = delete;
+    ShardedLruCache& operator=(const ShardedLruCache&) = delete;
+
+public:
+
+    bool find(const TKey& key, TValue& val) {
+        Shard& shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.lock_);
+        return shard.cache_.find(key, val);
+    }
+
+    // 不更新LRU列表
+    bool find(const TKey& key) {
+        Shard& shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.lock_);
+        return shard.cache_.find(key);
+    }
+
+    bool insert(const TKey& key, const TValue& value) {
+        Shard& shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.lock_);
+        return shard.cache_.insert(key, value);
+    }
+
+    bool insert_or_update(const TKey& key, const TValue& value) {
+        Shard& shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.lock_);
+        return shard.cache_.insert_or_update(key, value);
+    }
+
+    bool erase(const TKey& key) {
+        Shard& shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.lock_);
+        return shard.cache_.erase(key);
+    }
+
+    void clear() {
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i]->lock_);
+            shards_[i]->cache_.clear();
+        }
+    }
+
+    // 各个分片分别按照MRU->LRU的顺序，分片之间没有顺序关系
+    void snapshot_keys(std::vector<TKey>& keys) {
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i]->lock_);
+            shards_[i]->cache_.snapshot_keys(keys);
+        }
+    }
+
+    size_t total_count() {
+        size_t count = 0;
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i]->lock_);
+            count += shards_[i]->cache_.total_count();
+        }
+        return count;
+    }
+
+    size_t total_mem_used() {
+        size_t mem_used = 0;
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i]->lock_);
+            mem_used += shards_[i]->cache_.total_mem_used();
+        }
+        return mem_used;
+    }
+
+    size_t shard_num() const {
+        return shards_.size();
+    }
+
+private:
+
+    static const size_t kCacheLineSize = 64;
+    typedef char cacheline_pad_t[kCacheLineSize];
+
+    struct Shard {
+
+        Shard(size_t max_count, size_t max_memory) :
+            lock_(),
+            cache_(max_count, max_memory) {
+        }
+
+        cacheline_pad_t pad0_;
+        std::mutex      lock_;
+        ShardCache      cache_;
+        cacheline_pad_t pad1_;
+    };
+
+    // 分片用hash值的高位，避免和unordered_map取模使用的低位相关
+    Shard& shard_of(const TKey& key) {
+        if (shard_bits_ == 0)
+            return *shards_[0];
+
+        uint64_t h = static_cast<uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ULL;
+        return *shards_[h >> (64 - shard_bits_)];
+    }
+
+    size_t shard_bits_;
+    std::vector<std::unique_ptr<Shard> > shards_;
+    Hash   hash_;
+};
+
+} // roo
+
+#endif // __ROO_CONTAINER_SHARDED_LRU_CACHE_H__
@@ -0,0 +1,232 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __ROO_CONTAINER_SIZE_OF_H__
+#define __ROO_CONTAINER_SIZE_OF_H__
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+// 缓存内存占用量的计算
+//
+// SizeOf:      对象自身大小加上直接持有的堆内存，用于估算，可以自定义特化
+// AllocSizeOf: 精确模式，按照分配器实际返回的块大小(malloc_usable_size)统计，
+//              支持std::string(区分SSO)以及嵌套的vector/list/map/set/unordered_*容器
+//
+// 按照glibc x86_64的ptmalloc计算块大小，其他的分配器会有一定的偏差
+
+namespace roo {
+
+// 申请size字节时malloc_usable_size返回的大小
+inline size_t malloc_usable(size_t size) {
+
+    if (size == 0)
+        return 0;
+
+    const size_t kSizeSz = sizeof(size_t);
+    const size_t kAlignMask = 2 * kSizeSz - 1;
+    const size_t kMinChunk = 4 * kSizeSz;
+
+    size_t chunk = (size + kSizeSz + kAlignMask) & ~kAlignMask;
+    if (chunk < kMinChunk)
+        chunk = kMinChunk;
+    return chunk - kSizeSz;
+}
+
+namespace size_detail {
+
+template<typename T>
+struct Storage {
+    typedef typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type type;
+};
+
+// std::list的节点
+template<typename T>
+struct ListNodeLayout {
+    void* next_;
+    void* prev_;
+    typename Storage<T>::type value_;
+};
+
+// std::map/std::set红黑树的节点
+template<typename T>
+struct TreeNodeLayout {
+    int   color_;
+    void* parent_;
+    void* left_;
+    void* right_;
+    typename Storage<T>::type value_;
+};
+
+// std::unordered_*的节点，hash值是否缓存取决于hash函数
+template<typename T, bool Cached>
+struct HashNodeLayout {
+    void* next_;
+    typename Storage<T>::type value_;
+    size_t hash_;
+};
+
+template<typename T>
+struct HashNodeLayout<T, false> {
+    void* next_;
+    typename Storage<T>::type value_;
+};
+
+template<typename K, typename H>
+struct HashCached {
+#if defined(__GLIBCXX__)
+    static const bool value = std::__cache_default<K, H>::value;
+#else
+    static const bool value = true;
+#endif
+};
+
+} // size_detail
+
+
+// 对象额外持有的堆内存，不包括sizeof(T)本身
+template<typename T>
+struct HeapSizeOf {
+    size_t operator()(const T& t) const {
+        return 0;
+    }
+};
+
+template<typename C, typename Tr, typename A>
+struct HeapSizeOf<std::basic_string<C, Tr, A> > {
+    size_t operator()(const std::basic_string<C, Tr, A>& t) const {
+
+        const char* data = reinterpret_cast<const char*>(t.data());
+        const char* self = reinterpret_cast<const char*>(&t);
+
+        // SSO的数据直接存储在对象内部
+        if (data >= self && data < self + sizeof(t))
+            return 0;
+
+#if defined(__GLIBCXX__) && !_GLIBCXX_USE_CXX11_ABI
+        // COW实现的_Rep头部和数据一起分配，空串使用静态对象
+        if (t.capacity() == 0)
+            return 0;
+        return malloc_usable(3 * sizeof(size_t) + (t.capacity() + 1) * sizeof(C));
+#else
+        return malloc_usable((t.capacity() + 1) * sizeof(C));
+#endif
+    }
+};
+
+template<typename T1, typename T2>
+struct HeapSizeOf<std::pair<T1, T2> > {
+    size_t operator()(const std::pair<T1, T2>& t) const {
+        return HeapSizeOf<typename std::remove_const<T1>::type>()(t.first) +
+               HeapSizeOf<T2>()(t.second);
+    }
+};
+
+template<typename T, typename A>
+struct HeapSizeOf<std::vector<T, A> > {
+    size_t operator()(const std::vector<T, A>& t) const {
+        size_t size = malloc_usable(t.capacity() * sizeof(T));
+        for (auto iter = t.begin(); iter != t.end(); ++iter)
+            size += HeapSizeOf<T>()(*iter);
+        return size;
+    }
+};
+
+template<typename T, typename A>
+struct HeapSizeOf<std::list<T, A> > {
+    size_t operator()(const std::list<T, A>& t) const {
+        size_t size = t.size() * malloc_usable(sizeof(size_detail::ListNodeLayout<T>));
+        for (auto iter = t.begin(); iter != t.end(); ++iter)
+            size += HeapSizeOf<T>()(*iter);
+        return size;
+    }
+};
+
+template<typename Container>
+size_t tree_heap_size(const Container& t) {
+    typedef typename Container::value_type value_type;
+    size_t size = t.size() * malloc_usable(sizeof(size_detail::TreeNodeLayout<value_type>));
+    for (auto iter = t.begin(); iter != t.end(); ++iter)
+        size += HeapSizeOf<value_type>()(*iter);
+    return size;
+}
+
+template<typename K, typename V, typename C, typename A>
+struct HeapSizeOf<std::map<K, V, C, A> > {
+    size_t operator()(const std::map<K, V, C, A>& t) const {
+        return tree_heap_size(t);
+    }
+};
+
+template<typename K, typename C, typename A>
+struct HeapSizeOf<std::set<K, C, A> > {
+    size_t operator()(const std::set<K, C, A>& t) const {
+        return tree_heap_size(t);
+    }
+};
+
+// 桶数组和所有的节点，只有一个桶的时候使用对象内部的存储
+template<typename K, typename H, typename Container>
+size_t hash_heap_size(const Container& t) {
+    typedef typename Container::value_type value_type;
+    typedef size_detail::HashNodeLayout<value_type, size_detail::HashCached<K, H>::value> Node;
+
+    size_t size = t.bucket_count() > 1 ? malloc_usable(t.bucket_count() * sizeof(void*)) : 0;
+    size += t.size() * malloc_usable(sizeof(Node));
+    for (auto iter = t.begin(); iter != t.end(); ++iter)
+        size += HeapSizeOf<value_type>()(*iter);
+    return size;
+}
+
+template<typename K, typename V, typename H, typename E, typename A>
+struct HeapSizeOf<std::unordered_map<K, V, H, E, A> > {
+    size_t operator()(const std::unordered_map<K, V, H, E, A>& t) const {
+        return hash_heap_size<K, H>(t);
+    }
+};
+
+template<typename K, typename H, typename E, typename A>
+struct HeapSizeOf<std::unordered_set<K, H, E, A> > {
+    size_t operator()(const std::unordered_set<K, H, E, A>& t) const {
+        return hash_heap_size<K, H>(t);
+    }
+};
+
+
+// 默认的空间占用量计算，对于自定义的类型返回的类型长度可能不准确
+template<typename T>
+struct SizeOf : std::unary_function<T, size_t> {
+    size_t operator ()(const T& t) const {
+        return sizeof(t);
+    }
+};
+
+// 特例化常用的std::string类型的参数，加上实际申请的缓冲区
+template<>
+inline size_t SizeOf<std::string>::operator()(const std::string& t) const {
+    return sizeof(std::string) + HeapSizeOf<std::string>()(t);
+}
+
+// 精确模式，包括嵌套容器中各个元素持有的堆内存
+template<typename T>
+struct AllocSizeOf {
+    size_t operator ()(const T& t) const {
+        return sizeof(t) + HeapSizeOf<T>()(t);
+    }
+};
+
+} // roo
+
+#endif // __ROO_CONTAINER_SIZE_OF_H__
@@ -0,0 +1,108 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __ROO_CONTAINER_SLAB_POOL_H__
+#define __ROO_CONTAINER_SLAB_POOL_H__
+
+#include <new>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <type_traits>
+
+// 定长对象的内存池，每次向系统申请一整块slab，释放的对象挂到空闲链表上复用，
+// 对象的分配和释放都是O(1)且大部分情况下不会进入malloc。
+//
+// slab只会在析构的时候归还，析构前所有的对象需要已经destroy；不持锁。
+
+namespace roo {
+
+template<typename T, size_t SlabObjects = 1024>
+class SlabPool {
+
+    // 禁止拷贝
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+public:
+
+    SlabPool() :
+        slabs_(),
+        free_(NULL),
+        size_(0) {
+    }
+
+    ~SlabPool() {
+        for (size_t i = 0; i < slabs_.size(); ++i) {
+            delete[] slabs_[i];
+        }
+    }
+
+    template<typename... Args>
+    T* create(Args&&... args) {
+
+        if (!free_)
+            grow();
+
+        Slot* slot = free_;
+        T* ptr = new (&slot->storage_) T(std::forward<Args>(args)...);
+
+        // 构造成功之后才从空闲链表摘除
+        free_ = slot->next_;
+        ++size_;
+        return ptr;
+    }
+
+    void destroy(T* ptr) {
+
+        if (!ptr)
+            return;
+
+        ptr->~T();
+
+        Slot* slot = reinterpret_cast<Slot*>(ptr);
+        slot->next_ = free_;
+        free_ = slot;
+        --size_;
+    }
+
+    // 正在使用的对象数目
+    size_t size() const {
+        return size_;
+    }
+
+    // 向系统申请的内存总量
+    size_t memory() const {
+        return slabs_.size() * SlabObjects * sizeof(Slot);
+    }
+
+private:
+
+    union Slot {
+        Slot* next_;
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage_;
+    };
+
+    void grow() {
+
+        Slot* slab = new Slot[SlabObjects];
+        slabs_.push_back(slab);
+
+        for (size_t i = 0; i < SlabObjects; ++i) {
+            slab[i].next_ = (i + 1 < SlabObjects) ? &slab[i + 1] : free_;
+        }
+        free_ = slab;
+    }
+
+    std::vector<Slot*> slabs_;
+    Slot*  free_;
+    size_t size_;
+};
+
+} // roo
+
+#endif // __ROO_CONTAINER_SLAB_POOL_H__
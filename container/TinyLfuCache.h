@@ -0,0 +1,470 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __ROO_CONTAINER_TINY_LFU_CACHE_H__
+#define __ROO_CONTAINER_TINY_LFU_CACHE_H__
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include <stdint.h>
+
+#include "SlabPool.h"
+#include "SizeOf.h"
+
+// W-TinyLFU缓存，接口和LruCache/LruCacheMem一致，可以直接按类型替换
+//
+// 普通的LRU对所有的新元素都接纳，批量扫描大范围key的时候会把热点数据全部冲掉。
+// 这里新元素先进入一个很小的窗口LRU(1%)，从窗口淘汰出来的元素要和主区域
+// (SLRU: probation + protected)的淘汰候选比较访问频率，频率更高的才能留下来。
+// 访问频率由4-bit的Count-Min Sketch近似统计，计数总量达到阈值之后所有计数减半，
+// 让历史的热点逐渐衰减。
+//
+// max_memory不为0时同时按照内存占用量淘汰，统计方式和LruCacheMem相同，
+// key/value的计算方式可以通过模板参数替换；LruCacheMem的TTL这里不支持。
+//
+// 和LruCache一样不持锁，使用者进行并发控制的保护
+
+namespace roo {
+
+// 4行4-bit计数器的Count-Min Sketch，每个uint64_t存放16个计数器
+class FrequencySketch {
+
+    // 禁止拷贝
+    FrequencySketch(const FrequencySketch&) = delete;
+    FrequencySketch& operator=(const FrequencySketch&) = delete;
+
+public:
+
+    explicit FrequencySketch(size_t capacity) :
+        table_(),
+        mask_(0),
+        additions_(0),
+        sample_size_(0) {
+
+        size_t width = 16;
+        while (width < capacity)
+            width <<= 1;
+
+        table_.resize(width, 0);
+        mask_ = width - 1;
+        sample_size_ = 10 * (capacity ? capacity : 1);
+    }
+
+    void increment(size_t hash) {
+
+        bool added = false;
+        for (size_t i = 0; i < kDepth; ++i) {
+            size_t idx = index_of(hash, i);
+            size_t shift = counter_shift(hash, i);
+            if (((table_[idx] >> shift) & 0xF) != 0xF) {
+                table_[idx] += (1ULL << shift);
+                added = true;
+            }
+        }
+
+        if (added && ++additions_ >= sample_size_)
+            reset();
+    }
+
+    uint32_t frequency(size_t hash) const {
+
+        uint32_t freq = 0xF;
+        for (size_t i = 0; i < kDepth; ++i) {
+            uint32_t count = (table_[index_of(hash, i)] >> counter_shift(hash, i)) & 0xF;
+            if (count < freq)
+                freq = count;
+        }
+        return freq;
+    }
+
+private:
+
+    static const size_t kDepth = 4;
+
+    static uint64_t rehash(size_t hash, size_t i) {
+        static const uint64_t kSeeds[kDepth] = {
+            0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+            0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL
+        };
+        uint64_t h = (static_cast<uint64_t>(hash) + kSeeds[i]) * kSeeds[i];
+        return h ^ (h >> 32);
+    }
+
+    size_t index_of(size_t hash, size_t i) const {
+        return static_cast<size_t>(rehash(hash, i) >> 4) & mask_;
+    }
+
+    static size_t counter_shift(size_t hash, size_t i) {
+        return static_cast<size_t>(rehash(hash, i) & 0xF) << 2;
+    }
+
+    // 所有计数器减半
+    void reset() {
+        for (size_t i = 0; i < table_.size(); ++i) {
+            table_[i] = (table_[i] >> 1) & 0x7777777777777777ULL;
+        }
+        additions_ /= 2;
+    }
+
+    std::vector<uint64_t> table_;
+    size_t   mask_;
+    size_t   additions_;
+    size_t   sample_size_;
+};
+
+
+// 模板参数的顺序和LruCacheMem一致，方便直接替换
+template<typename TKey, typename TValue,
+         class ValueSize = SizeOf<TValue>,
+         class KeySize   = SizeOf<TKey>,
+         class Hash      = std::hash<TKey> >
+class TinyLfuCache {
+
+public:
+    typedef TKey   key_type;
+    typedef TValue value_type;
+
+    explicit TinyLfuCache(size_t max_count, size_t max_memory = 0) :
+        max_count_(max_count ? max_count : 1),
+        window_max_(0),
+        protected_max_(0),
+        max_memory_(max_memory),
+        mem_used_(0),
+        buckets_mem_(0),
+        evicted_count_(0),
+        sketch_(max_count_),
+        container_(),
+        pool_(),
+        hash_() {
+
+        window_max_ = max_count_ / 100;
+        if (window_max_ == 0)
+            window_max_ = 1;
+
+        size_t main_max = max_count_ > window_max_ ? max_count_ - window_max_ : 0;
+        protected_max_ = main_max * 8 / 10;
+
+        for (size_t i = 0; i < kRegionNum; ++i) {
+            regions_[i].head_.prev_ = &regions_[i].head_;
+            regions_[i].head_.next_ = &regions_[i].head_;
+            regions_[i].size_ = 0;
+        }
+    }
+
+    ~TinyLfuCache() {
+        clear();
+    }
+
+    // 禁止拷贝
+    TinyLfuCache(const TinyLfuCache& other) = delete;
+    TinyLfuCache& operator=(const TinyLfuCache&) = delete;
+
+public:
+
+    bool find(const TKey& key, TValue& val) {
+
+        size_t hash = hash_(key);
+        sketch_.increment(hash);
+
+        auto iter = container_.find(key);
+        if (iter == container_.end())
+            return false;
+
+        val = iter->second->value_;
+        on_hit(iter->second);
+        return true;
+    }
+
+    // 不更新LRU列表和访问频率
+    bool find(const TKey& key) const {
+        return container_.find(key) != container_.end();
+    }
+
+    // 成功插入返回true，否则返回false
+    // 注意返回true只表示进入了窗口区域，之后仍可能因为频率过低被拒绝
+    bool insert(const TKey& key, const TValue& value) {
+
+        if (container_.find(key) != container_.end())
+            return false;
+
+        size_t hash = hash_(key);
+        sketch_.increment(hash);
+
+        Node* node = pool_.create(key, value, hash);
+        container_.insert(typename Container::value_type(key, node));
+        link_push_front(kWindow, node);
+        mem_used_ += calc_item_size(node);
+        update_buckets_mem();
+
+        evict();
+        return true;
+    }
+
+    bool insert_or_update(const TKey& key, const TValue& value) {
+
+        auto iter = container_.find(key);
+        if (iter == container_.end())
+            return insert(key, value);
+
+        // update
+        Node* node = iter->second;
+        size_t old_value_size = calc_value_size_(node->value_);
+        node->value_ = value;
+        mem_used_ = mem_used_ + calc_value_size_(node->value_) - old_value_size;
+        sketch_.increment(node->hash_);
+        on_hit(node);
+
+        // 变大的value可能超出内存限制
+        evict();
+        return true;
+    }
+
+    // 删除元素，不存在返回false
+    bool erase(const TKey& key) {
+
+        auto iter = container_.find(key);
+        if (iter == container_.end())
+            return false;
+
+        remove(iter->second);
+        return true;
+    }
+
+    // 清空整个缓存，同时释放hash桶数组，访问频率的统计保留
+    void clear() {
+
+        Container().swap(container_);
+        for (size_t i = 0; i < kRegionNum; ++i) {
+            Link* head = &regions_[i].head_;
+            Link* link = head->next_;
+            while (link != head) {
+                Link* next = link->next_;
+                pool_.destroy(static_cast<Node*>(link));
+                link = next;
+            }
+
+            head->prev_ = head->next_ = head;
+            regions_[i].size_ = 0;
+        }
+
+        mem_used_ = 0;
+        update_buckets_mem();
+    }
+
+    // 对容器中的所有key进行快照并拷贝到keys中
+    // 按照protected、probation、window的顺序，每个区域内部MRU->LRU
+    void snapshot_keys(std::vector<TKey>& keys) const {
+
+        keys.reserve(keys.size() + container_.size());
+        static const size_t kOrder[kRegionNum] = { kProtected, kProbation, kWindow };
+        for (size_t i = 0; i < kRegionNum; ++i) {
+            const Link* head = &regions_[kOrder[i]].head_;
+            for (const Link* link = head->next_; link != head; link = link->next_) {
+                keys.push_back(static_cast<const Node*>(link)->key_);
+            }
+        }
+    }
+
+    size_t total_count() const {
+        return container_.size();
+    }
+
+    size_t total_mem_used() const {
+        return mem_used_ + buckets_mem_;
+    }
+
+    // 因为容量限制被淘汰的元素个数
+    uint64_t evicted_count() const {
+        return evicted_count_;
+    }
+
+private:
+
+    enum Region {
+        kWindow    = 0,
+        kProbation = 1,
+        kProtected = 2,
+        kRegionNum = 3,
+    };
+
+    struct Link {
+        Link* prev_;
+        Link* next_;
+    };
+
+    struct Node : public Link {
+
+        Node(const TKey& key, const TValue& value, size_t hash) :
+            key_(key),
+            value_(value),
+            hash_(hash),
+            region_(kWindow) {
+        }
+
+        TKey   key_;
+        TValue value_;
+        size_t hash_;
+        Region region_;
+    };
+
+    struct List {
+        Link   head_;     // 循环链表的哨兵，head_.next_为MRU，head_.prev_为LRU
+        size_t size_;
+    };
+
+    typedef std::unordered_map<TKey, Node*, Hash> Container;
+
+    void on_hit(Node* node) {
+
+        switch (node->region_) {
+            case kWindow:
+            case kProtected:
+                delink(node);
+                link_push_front(node->region_, node);
+                break;
+
+            case kProbation:
+                // 再次访问的元素晋升到protected区域
+                delink(node);
+                link_push_front(kProtected, node);
+                if (regions_[kProtected].size_ > protected_max_) {
+                    Node* demote = lru_of(kProtected);
+                    delink(demote);
+                    link_push_front(kProbation, demote);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    bool over_capacity() const {
+        return container_.size() > max_count_ ||
+               (max_memory_ != 0 && total_mem_used() > max_memory_);
+    }
+
+    // 窗口溢出的元素进入probation，主区域溢出时和probation的LRU比较频率
+    void evict() {
+
+        while (regions_[kWindow].size_ > window_max_) {
+            Node* candidate = lru_of(kWindow);
+            delink(candidate);
+            link_push_front(kProbation, candidate);
+
+            if (!over_capacity())
+                continue;
+
+            Node* victim = lru_of(kProbation);
+            if (victim == candidate && regions_[kProtected].size_ > 0)
+                victim = lru_of(kProtected);
+
+            if (victim == candidate ||
+                sketch_.frequency(candidate->hash_) > sketch_.frequency(victim->hash_)) {
+                remove(victim);
+            } else {
+                remove(candidate);
+            }
+            ++evicted_count_;
+        }
+
+        // 窗口比较大的时候主区域可能已经空了，按内存淘汰的时候一次比较
+        // 也可能不够，依次从probation、protected、window的LRU淘汰，至少保留一个元素
+        while (over_capacity() && container_.size() > 1) {
+            size_t region = kProbation;
+            if (regions_[region].size_ == 0)
+                region = kProtected;
+            if (regions_[region].size_ == 0)
+                region = kWindow;
+
+            remove(lru_of(region));
+            ++evicted_count_;
+        }
+    }
+
+    Node* lru_of(size_t region) {
+        return static_cast<Node*>(regions_[region].head_.prev_);
+    }
+
+    void remove(Node* node) {
+        mem_used_ -= calc_item_size(node);
+        container_.erase(node->key_);
+        delink(node);
+        pool_.destroy(node);
+    }
+
+    // 每个元素除了key/value之外的管理开销，包括hash节点的分配块大小和slab中的Node，
+    // key在两个节点中各存储一份
+    static size_t item_overhead() {
+        typedef typename Container::value_type HashValue;
+        typedef size_detail::HashNodeLayout<HashValue,
+                size_detail::HashCached<TKey, Hash>::value> HashNode;
+
+        return malloc_usable(sizeof(HashNode)) + sizeof(Node)
+               - 2 * sizeof(TKey) - sizeof(TValue);
+    }
+
+    size_t calc_item_size(const Node* node) const {
+        return 2 * calc_key_size_(node->key_) +
+               calc_value_size_(node->value_) +
+               item_overhead();
+    }
+
+    // 只有一个桶的时候使用的是容器内部的存储
+    void update_buckets_mem() {
+        size_t buckets = container_.bucket_count();
+        buckets_mem_ = buckets > 1 ? malloc_usable(buckets * sizeof(void*)) : 0;
+    }
+
+    // 列表操作，从所在区域的链表中删除该节点
+    void delink(Node* node) {
+        node->prev_->next_ = node->next_;
+        node->next_->prev_ = node->prev_;
+        node->next_ = node->prev_ = NULL;
+        --regions_[node->region_].size_;
+    }
+
+    // 在指定区域链表头部增加该节点
+    void link_push_front(size_t region, Node* node) {
+        Link* head = &regions_[region].head_;
+        node->prev_ = head;
+        node->next_ = head->next_;
+        head->next_->prev_ = node;
+        head->next_ = node;
+
+        node->region_ = static_cast<Region>(region);
+        ++regions_[region].size_;
+    }
+
+    const size_t max_count_;      // 最大元素个数
+    size_t       window_max_;
+    size_t       protected_max_;
+
+    ValueSize    calc_value_size_;
+    KeySize      calc_key_size_;
+
+    const size_t max_memory_;     // 最大内存占用量，0表示不限制
+    size_t       mem_used_;       // 所有元素的占用量
+    size_t       buckets_mem_;    // hash桶数组
+
+    uint64_t     evicted_count_;
+
+    FrequencySketch  sketch_;
+
+    Container        container_;
+    SlabPool<Node>   pool_;
+    List             regions_[kRegionNum];
+
+    Hash             hash_;
+};
+
+} // roo
+
+#endif // __ROO_CONTAINER_TINY_LFU_CACHE_H__
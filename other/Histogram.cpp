@@ -0,0 +1,129 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <sstream>
+
+#include <other/Histogram.h>
+
+namespace roo {
+
+Histogram::Histogram() :
+    count_(0),
+    sum_(0),
+    max_(0) {
+    for (uint32_t i = 0; i < kBucketNum; ++i)
+        buckets_[i].store(0, std::memory_order_relaxed);
+}
+
+uint32_t Histogram::bucket_index(uint64_t value) {
+
+    if (value < kLinearMax)
+        return static_cast<uint32_t>(value);
+
+    if (value >> kMaxBits)
+        return kBucketNum - 1;
+
+    uint32_t msb = 63 - __builtin_clzll(value);
+    uint32_t shift = msb - kSubBits;
+    uint32_t top = static_cast<uint32_t>(value >> shift);   // [kSubCount, 2*kSubCount)
+    return kLinearMax + (shift - 1) * kSubCount + (top - kSubCount);
+}
+
+uint64_t Histogram::bucket_upper(uint32_t index) {
+
+    if (index < kLinearMax)
+        return index;
+
+    uint32_t offset = index - kLinearMax;
+    uint32_t shift = offset / kSubCount + 1;
+    uint64_t top = kSubCount + offset % kSubCount;
+    return ((top + 1) << shift) - 1;
+}
+
+void Histogram::record(uint64_t value) {
+
+    buckets_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t curr = max_.load(std::memory_order_relaxed);
+    while (value > curr &&
+           !max_.compare_exchange_weak(curr, value, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t Histogram::percentile(double percentile) const {
+
+    uint64_t counts[kBucketNum];
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < kBucketNum; ++i) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    if (total == 0)
+        return 0;
+
+    if (percentile < 0)
+        percentile = 0;
+    if (percentile > 100)
+        percentile = 100;
+
+    uint64_t rank = static_cast<uint64_t>(percentile / 100 * total + 0.5);
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < kBucketNum; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            // 桶的上界不会超过实际记录的最大值
+            uint64_t upper = bucket_upper(i);
+            uint64_t maximum = max();
+            return upper < maximum ? upper : maximum;
+        }
+    }
+
+    return max();
+}
+
+void Histogram::reset() {
+    for (uint32_t i = 0; i < kBucketNum; ++i)
+        buckets_[i].store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+std::string Histogram::to_string() const {
+
+    std::stringstream ss;
+    ss << "count:" << count()
+       << " mean:" << mean()
+       << " p50:"  << percentile(50)
+       << " p90:"  << percentile(90)
+       << " p99:"  << percentile(99)
+       << " p999:" << percentile(99.9)
+       << " max:"  << max();
+    return ss.str();
+}
+
+std::string Histogram::to_json() const {
+
+    std::stringstream ss;
+    ss << "{\"count\":" << count()
+       << ",\"mean\":"  << mean()
+       << ",\"p50\":"   << percentile(50)
+       << ",\"p90\":"   << percentile(90)
+       << ",\"p99\":"   << percentile(99)
+       << ",\"p999\":"  << percentile(99.9)
+       << ",\"max\":"   << max()
+       << "}";
+    return ss.str();
+}
+
+} // roo
@@ -0,0 +1,82 @@
+/*-
+ * Copyright (c) 2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __ROO_OTHER_HISTOGRAM_H__
+#define __ROO_OTHER_HISTOGRAM_H__
+
+#include <atomic>
+#include <string>
+
+#include <stdint.h>
+
+// 延迟分布统计，HDR风格的对数-线性分桶
+//
+// 小于32的值每个值一个桶，之后每个2的幂次区间再均分为16个桶，相对误差不超过1/16，
+// 最大可以记录2^36(微秒约19小时)，超过的值记入最后一个桶。
+// record()只有几次relaxed原子操作，可以在多个线程中并发调用；读取的时候不加锁，
+// 得到的是近似的快照，用于状态展示足够了。
+
+namespace roo {
+
+class Histogram {
+
+    // 禁止拷贝
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+public:
+
+    Histogram();
+
+    void record(uint64_t value);
+
+    uint64_t count() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t sum() const {
+        return sum_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t max() const {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t mean() const {
+        uint64_t cnt = count();
+        return cnt ? sum() / cnt : 0;
+    }
+
+    // percentile取值[0, 100]，返回所在桶的上界，没有数据的时候返回0
+    uint64_t percentile(double percentile) const;
+
+    void reset();
+
+    // count/mean/p50/p90/p99/p999/max
+    std::string to_string() const;
+    std::string to_json() const;
+
+private:
+
+    static const uint32_t kSubBits    = 4;
+    static const uint32_t kSubCount   = 1U << kSubBits;         // 16
+    static const uint32_t kLinearMax  = 2 * kSubCount;          // 32
+    static const uint32_t kMaxBits    = 36;
+    static const uint32_t kBucketNum  = kLinearMax + (kMaxBits - kSubBits - 1) * kSubCount;
+
+    static uint32_t bucket_index(uint64_t value);
+    static uint64_t bucket_upper(uint32_t index);
+
+    std::atomic<uint64_t> buckets_[kBucketNum];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+} // roo
+
+#endif // __ROO_OTHER_HISTOGRAM_H__
@@ -0,0 +1,133 @@
+#include <gmock/gmock.h>
+#include <string>
+
+#include <iostream>
+
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <connect/AsyncRedisConn.h>
+
+using namespace ::testing;
+using namespace roo;
+
+// 连接被拒绝的时候init()返回失败，不需要redis-server
+TEST(AsyncRedisConnTest, ConnectRefusedTest) {
+
+    // 绑定一个临时端口之后关闭，保证没有人监听
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_THAT(fd, Ge(0));
+
+    struct sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    ASSERT_THAT(::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)), Eq(0));
+    ASSERT_THAT(::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len), Eq(0));
+    ::close(fd);
+
+    IoService io_service;
+    ASSERT_THAT(io_service.init(), Eq(true));
+
+    async_redis_conn_ptr conn = std::make_shared<AsyncRedisConn>(
+        io_service, RedisConnPoolHelper("127.0.0.1", ntohs(addr.sin_port), ""));
+    ASSERT_THAT(conn->init(1000), Eq(false));
+    ASSERT_THAT(conn->is_health(), Eq(false));
+
+    // 连接已经释放，之后的命令直接失败
+    std::vector<std::string> argv { "PING" };
+    ASSERT_THAT(!!conn->ExecV(argv).get(), Eq(false));
+
+    // 连接失败之后不再被context持有
+    std::weak_ptr<AsyncRedisConn> weak = conn;
+    conn.reset();
+    for (int i = 0; i < 100 && !weak.expired(); ++i) {
+        ::usleep(10 * 1000);
+    }
+    ASSERT_THAT(weak.expired(), Eq(true));
+}
+
+
+// 需要本地运行redis-server
+class AsyncRedisConnSt : public ::testing::Test {
+
+protected:
+    void SetUp() {
+        ASSERT_THAT(io_service_.init(), Eq(true));
+        conn_ = std::make_shared<AsyncRedisConn>(io_service_, RedisConnPoolHelper("127.0.0.1", 6379, ""));
+        ASSERT_THAT(conn_->init(), Eq(true));
+    }
+
+    void TearDown() {
+        if (conn_)
+            conn_->close();
+    }
+
+public:
+
+    IoService io_service_;
+    async_redis_conn_ptr conn_;
+};
+
+
+TEST_F(AsyncRedisConnSt, CommandTest) {
+
+    ASSERT_THAT(conn_->is_health(), Eq(true));
+
+    ASSERT_THAT(conn_->Set("__async_test_key", "ttz", 10).get(), Eq(true));
+    ASSERT_THAT(conn_->Get("__async_test_key").get().value_or(""), Eq("ttz"));
+    ASSERT_THAT(!!conn_->Get("__async_test_key_nil").get(), Eq(false));
+
+    ASSERT_THAT(conn_->Set("__async_test_cnt", 10).get(), Eq(true));
+    ASSERT_THAT(conn_->Incr("__async_test_cnt").get().value_or(0), Eq(11));
+
+    std::vector<std::string> keys { "__async_test_key", "__async_test_key_nil", "__async_test_cnt" };
+    std::vector<std::string> values = conn_->MGet(keys, "nil").get();
+    ASSERT_THAT(values, ElementsAre("ttz", "nil", "11"));
+
+    ASSERT_THAT(conn_->HSet("__async_test_hash", "f1", "v1").get(), Ge(0));
+    std::map<std::string, std::string> fields = conn_->HGetAll("__async_test_hash").get();
+    ASSERT_THAT(fields["f1"], Eq("v1"));
+
+    std::vector<std::string> dels { "__async_test_key", "__async_test_cnt", "__async_test_hash" };
+    ASSERT_THAT(conn_->Del(dels).get(), Eq(3));
+
+    // 错误应答得到空的reply
+    std::vector<std::string> bad { "NOSUCHCOMMAND" };
+    ASSERT_THAT(!!conn_->ExecV(bad).get(), Eq(false));
+}
+
+
+TEST_F(AsyncRedisConnSt, ConcurrentTest) {
+
+    const int kRequests = 10000;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Future<boost::optional<int64_t>>> futures;
+    futures.reserve(kRequests);
+    for (int i = 0; i < kRequests; ++i) {
+        futures.push_back(conn_->Incr("__async_test_concurrent"));
+    }
+
+    int64_t last = 0;
+    for (size_t i = 0; i < futures.size(); ++i) {
+        boost::optional<int64_t> value = futures[i].get();
+        ASSERT_THAT(!!value, Eq(true));
+
+        // 同一个连接上的命令按顺序执行
+        ASSERT_THAT(*value, Gt(last));
+        last = *value;
+    }
+    auto elapse = std::chrono::steady_clock::now() - start;
+
+    ASSERT_THAT(conn_->pending(), Eq(0));
+    ASSERT_THAT(conn_->Del("__async_test_concurrent").get(), Eq(1));
+
+    std::cout << "async incr: "
+              << static_cast<uint64_t>(kRequests * 1e6 /
+                                       std::chrono::duration_cast<std::chrono::microseconds>(elapse).count())
+              << " ops/sec on one connection" << std::endl;
+}
@@ -0,0 +1,115 @@
+#include <gmock/gmock.h>
+#include <string>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+#include <concurrency/AsyncTask.h>
+
+using namespace ::testing;
+using namespace roo;
+
+
+static bool wait_count(std::atomic<int>& count, int expect, int max_msec) {
+    for (int i = 0; i < max_msec && count.load() < expect; ++i) {
+        ::usleep(1000);
+    }
+    return count.load() == expect;
+}
+
+
+TEST(AsyncTaskTest, SlowTaskNotStallOthersTest) {
+
+    AsyncTask async(4);
+    std::atomic<int> count(0);
+
+    async.add_async_task([]() -> int { ::usleep(500 * 1000); return 0; });
+    for (int i = 0; i < 100; ++i) {
+        async.add_async_task([&]() -> int { ++count; return 0; });
+    }
+
+    // 批量join的实现中，慢任务会拖住同批次的任务
+    ASSERT_THAT(wait_count(count, 100, 200), Eq(true));
+}
+
+
+TEST(AsyncTaskTest, MaxSpawnTest) {
+
+    AsyncTask async(4);
+    std::atomic<int> running(0);
+    std::atomic<int> peak(0);
+    std::atomic<int> count(0);
+
+    async.set_max_spawn(2);
+    ASSERT_THAT(async.get_max_spawn(), Eq(2));
+
+    for (int i = 0; i < 20; ++i) {
+        async.add_async_task([&]() -> int {
+            int curr = ++running;
+            int old = peak.load();
+            while (curr > old && !peak.compare_exchange_weak(old, curr)) { }
+            ::usleep(5 * 1000);
+            --running;
+            ++count;
+            return 0;
+        });
+    }
+
+    ASSERT_THAT(wait_count(count, 20, 2000), Eq(true));
+    ASSERT_THAT(peak.load(), Le(2));
+}
+
+
+// 对比原先每批任务各自创建线程再join_all的方式
+// (ThreadMng::add_task持锁构造ThreadGuard会重入加锁，这里直接用std::thread模拟)
+TEST(AsyncTaskTest, ThroughputBenchmark) {
+
+    const int kTasks = 20000;
+    const uint8_t kMaxSpawn = 8;
+
+    std::atomic<int> count(0);
+    auto func = [&]() -> int { ++count; return 0; };
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        EQueue<TaskRunnable> tasks;
+        for (int i = 0; i < kTasks; ++i) {
+            tasks.PUSH(func);
+        }
+
+        std::vector<TaskRunnable> batch;
+        std::vector<std::thread> threads;
+        while (count.load() < kTasks) {
+            batch.clear();
+            if (!tasks.POP(batch, kMaxSpawn, 1000))
+                break;
+            for (size_t i = 0; i < batch.size(); ++i) {
+                threads.emplace_back(batch[i]);
+            }
+            for (size_t i = 0; i < threads.size(); ++i) {
+                threads[i].join();
+            }
+            threads.clear();
+        }
+    }
+    auto legacy = std::chrono::steady_clock::now() - start;
+    ASSERT_THAT(count.load(), Eq(kTasks));
+
+    count = 0;
+    start = std::chrono::steady_clock::now();
+    {
+        AsyncTask async(kMaxSpawn);
+        for (int i = 0; i < kTasks; ++i) {
+            async.add_async_task(func);
+        }
+        ASSERT_THAT(wait_count(count, kTasks, 10000), Eq(true));
+    }
+    auto persistent = std::chrono::steady_clock::now() - start;
+
+    double legacy_us = std::chrono::duration_cast<std::chrono::microseconds>(legacy).count();
+    double persistent_us = std::chrono::duration_cast<std::chrono::microseconds>(persistent).count();
+
+    std::cout << "spawn-and-join: " << static_cast<uint64_t>(kTasks * 1e6 / legacy_us) << " tasks/sec" << std::endl;
+    std::cout << "persistent:     " << static_cast<uint64_t>(kTasks * 1e6 / persistent_us) << " tasks/sec" << std::endl;
+}
@@ -0,0 +1,510 @@
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <connect/ConnPool.h>
+
+using namespace ::testing;
+using namespace roo;
+
+// 不依赖外部服务的模拟连接
+class FakeConn;
+
+struct FakeConnPoolHelper {
+    explicit FakeConnPoolHelper(bool init_ok = true) :
+        init_ok_(init_ok) {
+    }
+
+    bool init_ok_;
+};
+
+class FakeConn : public ConnStat {
+public:
+    FakeConn(ConnPool<FakeConn, FakeConnPoolHelper>& pool, const FakeConnPoolHelper& helper) :
+        helper_(helper),
+        health_(true) {
+        ++created_;
+    }
+
+    bool init(int64_t conn_uuid) {
+        ++inited_;
+        if (init_delay_ms_)
+            std::this_thread::sleep_for(std::chrono::milliseconds(init_delay_ms_));
+        return helper_.init_ok_ && !refused_;
+    }
+
+    bool ping_test() {
+        ++pinged_;
+        if (ping_delay_ms_)
+            std::this_thread::sleep_for(std::chrono::milliseconds(ping_delay_ms_));
+        return health_;
+    }
+
+    bool is_health() {
+        return health_;
+    }
+
+    const FakeConnPoolHelper helper_;
+    bool health_;
+
+    static std::atomic<int> created_;
+    static std::atomic<int> pinged_;
+    static std::atomic<int> inited_;
+    static int ping_delay_ms_;
+    static int init_delay_ms_;
+    static std::atomic<bool> refused_;     // 模拟服务端故障
+};
+
+std::atomic<int> FakeConn::created_(0);
+std::atomic<int> FakeConn::pinged_(0);
+std::atomic<int> FakeConn::inited_(0);
+int FakeConn::ping_delay_ms_ = 0;
+int FakeConn::init_delay_ms_ = 0;
+std::atomic<bool> FakeConn::refused_(false);
+
+typedef ConnPool<FakeConn, FakeConnPoolHelper> FakeConnPool;
+typedef std::shared_ptr<FakeConn> fake_conn_ptr;
+
+
+TEST(ConnPoolTest, ScopedConnTest) {
+
+    FakeConnPool pool("FakePool", 5, FakeConnPoolHelper());
+    ASSERT_THAT(pool.init(), Eq(true));
+    ASSERT_THAT(pool.get_capacity(), Eq(5));
+    ASSERT_THAT(pool.get_idle_size(), Eq(1));
+
+    fake_conn_ptr conn, conn2;
+    pool.request_scoped_conn(conn);
+    ASSERT_THAT(!!conn, Eq(true));
+    ASSERT_THAT(pool.get_busy_size(), Eq(1));
+
+    pool.request_scoped_conn(conn2);
+    ASSERT_THAT(!!conn2, Eq(true));
+    ASSERT_THAT(conn.get() != conn2.get(), Eq(true));
+
+    // 同一个线程再次申请拿到刚刚归还的连接
+    FakeConn* raw = conn.get();
+    conn.reset();
+    ASSERT_THAT(pool.get_idle_size() == 1 && pool.get_busy_size() == 1, Eq(true));
+    pool.request_scoped_conn(conn);
+    ASSERT_THAT(conn.get(), Eq(raw));
+
+    // 不健康的连接被丢弃
+    conn->health_ = false;
+    conn.reset();
+    ASSERT_THAT(pool.get_idle_size(), Eq(0));
+    ASSERT_THAT(pool.get_busy_size(), Eq(1));
+}
+
+
+TEST(ConnPoolTest, ExhaustedTest) {
+
+    FakeConnPool pool("FakePool", 2, FakeConnPoolHelper());
+
+    fake_conn_ptr conn1 = pool.request_conn();
+    fake_conn_ptr conn2 = pool.request_conn();
+    ASSERT_THAT(!!conn1 && !!conn2, Eq(true));
+
+    ASSERT_THAT(!!pool.try_request_conn(0), Eq(false));
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_THAT(!!pool.try_request_conn(50), Eq(false));
+    ASSERT_THAT(std::chrono::steady_clock::now() - start, Ge(std::chrono::milliseconds(50)));
+
+    // 阻塞的等待者被直接交付连接
+    fake_conn_ptr handed;
+    std::thread waiter([&]() { handed = pool.request_conn(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    FakeConn* raw = conn1.get();
+    pool.free_conn(conn1);
+    waiter.join();
+    ASSERT_THAT(handed.get(), Eq(raw));
+    ASSERT_THAT(pool.get_busy_size(), Eq(2));
+
+    pool.free_conn(handed);
+    pool.free_conn(conn2);
+    ASSERT_THAT(pool.get_idle_size(), Eq(2));
+    ASSERT_THAT(pool.get_busy_size(), Eq(0));
+
+    FakeConnPool bad("BadPool", 2, FakeConnPoolHelper(false));
+    ASSERT_THAT(bad.init(), Eq(false));
+    ASSERT_THAT(!!bad.try_request_conn(10), Eq(false));
+    ASSERT_THAT(bad.get_idle_size() + bad.get_busy_size(), Eq(0));
+
+    // 两次不等待、一次50ms超时
+    const ConnPoolStat& stat = pool.get_stat();
+    ASSERT_THAT(stat.timeout_count_.load(), Eq(2));
+    ASSERT_THAT(stat.acquired_success_.load(), Eq(3));
+    // 等待者线程启动需要时间，实际等待会略少于主线程的20ms
+    ASSERT_THAT(stat.acquire_wait_us_.max(), Ge(10000));
+    ASSERT_THAT(stat.hold_us_.count(), Eq(3));
+    ASSERT_THAT(bad.get_stat().create_failed_.load(), Eq(2));
+
+    std::string metrics = pool.module_metrics();
+    ASSERT_THAT(metrics, HasSubstr("\"pool\":\"FakePool\""));
+    ASSERT_THAT(metrics, HasSubstr("\"acquire_success\":3,"));
+    ASSERT_THAT(metrics, HasSubstr("\"timeout_count\":2,"));
+    ASSERT_THAT(metrics, HasSubstr("\"hold_us\":{"));
+}
+
+
+TEST(ConnPoolTest, ConcurrentTest) {
+
+    const size_t kCapacity = 4;
+    const int kThreads = 16;
+    const int kRounds = 5000;
+
+    FakeConn::created_ = 0;
+    FakeConnPool pool("FakePool", kCapacity, FakeConnPoolHelper());
+
+    std::atomic<int> in_use(0);
+    std::atomic<int> peak(0);
+    std::atomic<int> done(0);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < kRounds; ++i) {
+                fake_conn_ptr conn;
+                if (!pool.request_scoped_conn(conn))
+                    continue;
+
+                int curr = ++in_use;
+                int old = peak.load();
+                while (curr > old && !peak.compare_exchange_weak(old, curr)) { }
+                if (i % 100 == 0)
+                    std::this_thread::yield();
+                --in_use;
+                ++done;
+            }
+        });
+    }
+
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    auto elapse = std::chrono::steady_clock::now() - start;
+
+    ASSERT_THAT(done.load(), Eq(kThreads * kRounds));
+    ASSERT_THAT(peak.load(), Le(static_cast<int>(kCapacity)));
+    ASSERT_THAT(FakeConn::created_.load(), Le(static_cast<int>(kCapacity)));
+    ASSERT_THAT(pool.get_busy_size(), Eq(0));
+    ASSERT_THAT(pool.get_idle_size(), Eq(FakeConn::created_.load()));
+
+    const ConnPoolStat& stat = pool.get_stat();
+    ASSERT_THAT(stat.acquired_success_.load(), Eq(kThreads * kRounds));
+    ASSERT_THAT(stat.acquire_wait_us_.count(), Eq(kThreads * kRounds));
+    ASSERT_THAT(stat.hold_us_.count(), Eq(kThreads * kRounds));
+    ASSERT_THAT(stat.create_count_.load(), Eq(FakeConn::created_.load()));
+
+    std::string status = pool.module_status();
+    ASSERT_THAT(status, HasSubstr("FakePool:\n"));
+    ASSERT_THAT(status, HasSubstr("acquire_success:" + std::to_string(kThreads * kRounds) + "\n"));
+    ASSERT_THAT(status, HasSubstr("current_busy:0\n"));
+
+    std::cout << "acquire/release: "
+              << static_cast<uint64_t>(kThreads * kRounds * 1e6 /
+                                       std::chrono::duration_cast<std::chrono::microseconds>(elapse).count())
+              << " ops/sec" << std::endl;
+}
+
+
+TEST(ConnPoolTest, MaintenanceTest) {
+
+    Timer timer;
+    ASSERT_THAT(timer.init(), Eq(true));
+
+    ConnStat stat;
+    ASSERT_THAT(stat.expire(1), Eq(false));
+    ASSERT_THAT(stat.expire(0), Eq(true));
+
+    FakeConn::pinged_ = 0;
+    FakeConnPool pool("FakePool", 8, FakeConnPoolHelper(), 1);
+
+    ConnPoolMaintain maintain;
+    maintain.min_idle_ = 2;
+    maintain.keepalive_sec_ = 1;
+    maintain.interval_ms_ = 100;
+
+    // 启动时预热
+    ASSERT_THAT(pool.start_maintenance(timer, maintain), Eq(true));
+    ASSERT_THAT(pool.start_maintenance(timer, maintain), Eq(false));
+    ASSERT_THAT(pool.get_idle_size(), Eq(2));
+
+    std::vector<fake_conn_ptr> conns;
+    for (int i = 0; i < 6; ++i) {
+        conns.push_back(pool.request_conn());
+        ASSERT_THAT(!!conns.back(), Eq(true));
+    }
+    for (size_t i = 0; i < conns.size(); ++i) {
+        pool.free_conn(conns[i]);
+    }
+    ASSERT_THAT(pool.get_idle_size(), Eq(6));
+
+    // 闲置的连接被淘汰到min_idle_，保留下来的连接被ping保活
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+    ASSERT_THAT(pool.get_idle_size(), Eq(2));
+    ASSERT_THAT(FakeConn::pinged_.load(), Gt(0));
+
+    // 连接被借出之后补充到min_idle_
+    fake_conn_ptr conn1 = pool.request_conn();
+    fake_conn_ptr conn2 = pool.request_conn();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    ASSERT_THAT(pool.get_idle_size(), Eq(2));
+    ASSERT_THAT(pool.get_busy_size(), Eq(2));
+
+    pool.stop_maintenance();
+}
+
+
+// 保活ping比较慢的时候，维护任务不能一直占着所有的空闲连接
+TEST(ConnPoolTest, MaintenanceSlowPingTest) {
+
+    Timer timer;
+    ASSERT_THAT(timer.init(), Eq(true));
+
+    FakeConnPool pool("FakePool", 16, FakeConnPoolHelper());
+
+    ConnPoolMaintain maintain;
+    maintain.min_idle_ = 8;
+    maintain.keepalive_sec_ = 1;
+    maintain.interval_ms_ = 50;
+
+    FakeConn::ping_delay_ms_ = 50;
+    ASSERT_THAT(pool.start_maintenance(timer, maintain), Eq(true));
+    ASSERT_THAT(pool.get_idle_size(), Eq(8));
+
+    int created = FakeConn::created_.load();
+    int pinged = FakeConn::pinged_.load();
+
+    // 等到所有的连接都需要保活，ping期间申请者仍然能够拿到空闲的连接
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    for (int i = 0; i < 100; ++i) {
+        fake_conn_ptr conn = pool.try_request_conn(0);
+        ASSERT_THAT(!!conn, Eq(true));
+        pool.free_conn(conn);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    ASSERT_THAT(FakeConn::pinged_.load(), Gt(pinged));
+    ASSERT_THAT(FakeConn::created_.load(), Eq(created));
+
+    pool.stop_maintenance();
+    FakeConn::ping_delay_ms_ = 0;
+}
+
+
+TEST(ConnPoolTest, ElasticTest) {
+
+    Timer timer;
+    ASSERT_THAT(timer.init(), Eq(true));
+
+    FakeConnPool pool("FakePool", 16, FakeConnPoolHelper());
+    ASSERT_THAT(pool.get_limit(), Eq(16));
+
+    ConnPoolElastic elastic;
+    elastic.min_conn_ = 2;
+    elastic.max_conn_ = 32;
+    ASSERT_THAT(pool.set_elastic(elastic), Eq(false));
+
+    elastic.max_conn_ = 8;
+    elastic.target_wait_us_ = 1000;
+    elastic.shrink_idle_ratio_ = 0.5;
+    elastic.shrink_rounds_ = 3;
+    ASSERT_THAT(pool.set_elastic(elastic), Eq(true));
+    ASSERT_THAT(pool.get_limit(), Eq(8));
+
+    // 运行时通过Setting调整
+    libconfig::Config setting;
+    setting.readString("conn_pool = { FakePool = { min_conn = 1; max_conn = 4; }; };");
+    ASSERT_THAT(pool.update_runtime_setting(setting), Eq(0));
+    ASSERT_THAT(pool.get_limit(), Eq(4));
+
+    // 放宽上限不改变当前的limit
+    setting.readString("conn_pool = { FakePool = { min_conn = 1; max_conn = 6; }; };");
+    ASSERT_THAT(pool.update_runtime_setting(setting), Eq(0));
+    ASSERT_THAT(pool.get_limit(), Eq(4));
+
+    // 有非法的配置项的时候，其他的配置项也不生效
+    setting.readString("conn_pool = { FakePool = { max_conn = 64; failure_threshold = 9; }; };");
+    ASSERT_THAT(pool.update_runtime_setting(setting), Eq(-1));
+    ASSERT_THAT(pool.breaker().get_conf().failure_threshold_, Ne(9));
+    ASSERT_THAT(pool.get_limit(), Eq(4));
+
+    ConnPoolMaintain maintain;
+    maintain.interval_ms_ = 50;
+    ASSERT_THAT(pool.start_maintenance(timer, maintain), Eq(true));
+
+    std::vector<fake_conn_ptr> conns;
+    for (int i = 0; i < 4; ++i) {
+        conns.push_back(pool.request_conn());
+    }
+    ASSERT_THAT(!!pool.try_request_conn(0), Eq(false));
+
+    // 连接已满并且等待超过目标，扩容
+    ASSERT_THAT(!!pool.try_request_conn(20), Eq(false));
+    ASSERT_THAT(!!pool.try_request_conn(20), Eq(false));
+    std::this_thread::sleep_for(std::chrono::milliseconds(120));
+    ASSERT_THAT(pool.get_limit(), Eq(5));
+
+    conns.push_back(pool.try_request_conn(0));
+    ASSERT_THAT(!!conns.back(), Eq(true));
+    ASSERT_THAT(pool.get_busy_size(), Eq(5));
+
+    // 全部空闲之后逐步缩容到min_conn_，多余的连接被关闭
+    for (size_t i = 0; i < conns.size(); ++i) {
+        pool.free_conn(conns[i]);
+    }
+    conns.clear();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    ASSERT_THAT(pool.get_limit(), Eq(1));
+    ASSERT_THAT(pool.get_idle_size(), Eq(1));
+    ASSERT_THAT(pool.get_stat().trim_count_.load(), Eq(4));
+
+    pool.stop_maintenance();
+}
+
+
+TEST(ConnPoolTest, BreakerTest) {
+
+    ConnBreakerConf conf;
+    conf.failure_threshold_ = 2;
+    conf.base_backoff_ms_ = 50;
+    conf.wait_ms_ = 0;
+
+    ConnBreaker breaker(conf);
+    ASSERT_THAT(breaker.acquire(), Eq(ConnBreaker::kProceed));
+    breaker.release(ConnBreaker::kProceed, false);
+    ASSERT_THAT(breaker.is_open(), Eq(false));
+
+    // 出现失败之后只有一个线程探测，不等待的其他线程直接失败
+    ConnBreaker::Permit probe = breaker.acquire();
+    ASSERT_THAT(probe, Eq(ConnBreaker::kProbe));
+    ASSERT_THAT(breaker.acquire(), Eq(ConnBreaker::kReject));
+
+    // 达到阈值之后熔断，退避结束之前全部失败
+    breaker.release(probe, false);
+    ASSERT_THAT(breaker.is_open(), Eq(true));
+    ASSERT_THAT(breaker.acquire(), Eq(ConnBreaker::kReject));
+    ASSERT_THAT(breaker.open_count(), Eq(1));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    probe = breaker.acquire();
+    ASSERT_THAT(probe, Eq(ConnBreaker::kProbe));
+
+    // 等待中的线程得到探测成功的结果
+    conf.wait_ms_ = 1000;
+    breaker.set_conf(conf);
+    ConnBreaker::Permit follower = ConnBreaker::kReject;
+    std::thread waiter([&]() { follower = breaker.acquire(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    breaker.release(probe, true);
+    waiter.join();
+    ASSERT_THAT(follower, Eq(ConnBreaker::kProceed));
+    ASSERT_THAT(breaker.failures(), Eq(0));
+    ASSERT_THAT(breaker.rejected(), Eq(2));
+
+    // 连接池创建连接经过熔断器，熔断之后不再调用init
+    FakeConnPool bad("BadPool", 4, FakeConnPoolHelper(false));
+    conf.base_backoff_ms_ = 10000;
+    conf.wait_ms_ = 0;
+    bad.set_breaker(conf);
+
+    int inited = FakeConn::inited_.load();
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_THAT(!!bad.try_request_conn(0), Eq(false));
+    }
+    ASSERT_THAT(FakeConn::inited_.load() - inited, Eq(2));
+    ASSERT_THAT(bad.breaker().is_open(), Eq(true));
+    ASSERT_THAT(bad.get_stat().create_failed_.load(), Eq(5));
+    ASSERT_THAT(bad.get_idle_size() + bad.get_busy_size(), Eq(0));
+    ASSERT_THAT(bad.module_metrics().find("\"breaker\":{\"open\":true"), Ne(std::string::npos));
+}
+
+// 故障切换的时候所有连接同时断开，熔断器还没有失败记录，也只能有一个线程去重连
+TEST(ConnPoolTest, ReconnectStormTest) {
+
+    const int kThreads = 8;
+
+    FakeConnPool pool("StormPool", kThreads, FakeConnPoolHelper());
+    ASSERT_THAT(pool.init(), Eq(true));
+
+    ConnBreakerConf conf;
+    conf.failure_threshold_ = 1;
+    conf.base_backoff_ms_ = 10000;
+    conf.wait_ms_ = 1000;
+    pool.set_breaker(conf);
+
+    std::vector<fake_conn_ptr> conns;
+    for (int i = 0; i < kThreads; ++i) {
+        conns.push_back(pool.try_request_conn(0));
+        ASSERT_THAT(!!conns.back(), Eq(true));
+    }
+
+    // 所有的连接都断开，归还的时候被丢弃
+    for (int i = 0; i < kThreads; ++i) {
+        conns[i]->health_ = false;
+        pool.free_conn(conns[i]);
+    }
+    conns.clear();
+    ASSERT_THAT(pool.breaker().failures(), Eq(0));
+
+    FakeConn::refused_ = true;
+    FakeConn::init_delay_ms_ = 100;
+    int inited = FakeConn::inited_.load();
+
+    std::atomic<int> failed(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.push_back(std::thread([&]() {
+            if (!pool.try_request_conn(0))
+                ++failed;
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    FakeConn::refused_ = false;
+    FakeConn::init_delay_ms_ = 0;
+
+    ASSERT_THAT(FakeConn::inited_.load() - inited, Eq(1));
+    ASSERT_THAT(failed.load(), Eq(kThreads));
+    ASSERT_THAT(pool.breaker().is_open(), Eq(true));
+
+    // RedisConn重连的方式：先suspect()再acquire()，探测成功之后其他线程才去重连
+    ConnBreaker breaker(conf);
+    std::atomic<int> probes(0);
+    std::atomic<int> proceeds(0);
+    std::atomic<int> connecting(0);
+    std::atomic<int> overlap(0);
+    threads.clear();
+    for (int i = 0; i < kThreads; ++i) {
+        threads.push_back(std::thread([&]() {
+            breaker.suspect();
+            ConnBreaker::Permit permit = breaker.acquire();
+            if (permit == ConnBreaker::kProbe) {
+                ++probes;
+                if (++connecting > 1)
+                    ++overlap;
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                --connecting;
+            } else if (permit == ConnBreaker::kProceed) {
+                ++proceeds;
+            }
+            breaker.release(permit, true);
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    // 探测结束之后才到达的线程会重新suspect，只能依次探测，不会并发
+    ASSERT_THAT(overlap.load(), Eq(0));
+    ASSERT_THAT(probes.load(), Ge(1));
+    ASSERT_THAT(probes.load() + proceeds.load(), Eq(kThreads));
+    ASSERT_THAT(breaker.failures(), Eq(0));
+}
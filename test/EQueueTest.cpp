@@ -2,6 +2,7 @@
 #include <string>
 
 #include <iostream>
+#include <memory>
 
 #include <container/EQueue.h>
 
@@ -21,3 +22,25 @@ TEST(EQueueTest, EQueueSmokeTest) {
     ASSERT_THAT(queue.SIZE(), Eq(1));
 }
 
+
+TEST(EQueueTest, EQueueMoveAndDrainTest) {
+
+    EQueue<std::unique_ptr<std::string>> queue{};
+
+    std::unique_ptr<std::string> item(new std::string("tao"));
+    queue.PUSH(std::move(item));
+    queue.EMPLACE(new std::string("kan"));
+    ASSERT_THAT(queue.SIZE(), Eq(2));
+
+    std::unique_ptr<std::string> val = queue.POP();
+    ASSERT_THAT(*val, Eq("tao"));
+
+    queue.EMPLACE(new std::string("zhi"));
+
+    std::deque<std::unique_ptr<std::string>> batch;
+    batch.emplace_back(new std::string("stale"));
+    ASSERT_THAT(queue.DRAIN_INTO(batch), Eq(2));
+    ASSERT_THAT(*batch[0], Eq("kan"));
+    ASSERT_THAT(*batch[1], Eq("zhi"));
+    ASSERT_THAT(queue.EMPTY(), Eq(true));
+}
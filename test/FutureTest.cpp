@@ -0,0 +1,89 @@
+#include <gmock/gmock.h>
+#include <string>
+
+#include <thread>
+#include <stdexcept>
+#include <iostream>
+
+#include <concurrency/Future.h>
+#include <concurrency/DeferTask.h>
+#include <concurrency/AsyncTask.h>
+
+using namespace ::testing;
+using namespace roo;
+
+
+TEST(FutureTest, SubmitAndThenTest) {
+
+    DeferTask defer(2);
+
+    Future<int> f1 = defer.submit([](int a, int b) { return a + b; }, 1, 2);
+    ASSERT_THAT(f1.get(), Eq(3));
+
+    Future<std::string> f2 = f1.then([](int v) { return std::to_string(v * 10); });
+    ASSERT_THAT(f2.get(), Eq("30"));
+
+    // 后续任务返回Future时自动展开
+    Future<int> f3 = f2.then([&](const std::string& s) {
+        return defer.submit([s]() { return static_cast<int>(s.size()); });
+    });
+    ASSERT_THAT(f3.get(), Eq(2));
+
+    Future<void> f4 = defer.submit([]() { });
+    f4.get();
+    ASSERT_THAT(f4.is_ready(), Eq(true));
+}
+
+
+TEST(FutureTest, ExceptionPropagateTest) {
+
+    AsyncTask async(2);
+
+    Future<int> f1 = async.submit([]() -> int { throw std::runtime_error("redis down"); });
+    Future<int> f2 = f1.then([](int v) { return v + 1; });
+
+    ASSERT_THAT(f2.has_exception(), Eq(true));
+    ASSERT_THROW(f2.get(), std::runtime_error);
+}
+
+
+TEST(FutureTest, WhenAllWhenAnyTest) {
+
+    DeferTask defer(4);
+
+    Future<int> redis = defer.submit([]() { ::usleep(20 * 1000); return 1; });
+    Future<std::string> mysql = defer.submit([]() { return std::string("row"); });
+
+    std::tuple<int, std::string> both = when_all(redis, mysql).get();
+    ASSERT_THAT(std::get<0>(both), Eq(1));
+    ASSERT_THAT(std::get<1>(both), Eq("row"));
+
+    std::vector<Future<int>> futures;
+    for (int i = 0; i < 10; ++i) {
+        futures.push_back(defer.submit([i]() { return i * i; }));
+    }
+    std::vector<int> values = when_all(futures).get();
+    ASSERT_THAT(values.size(), Eq(10));
+    ASSERT_THAT(values[9], Eq(81));
+
+    Promise<int> never;
+    std::vector<Future<int>> racers;
+    racers.push_back(never.get_future());
+    racers.push_back(defer.submit([]() { return 7; }));
+    std::pair<size_t, int> first = when_any(racers).get();
+    ASSERT_THAT(first.first, Eq(1));
+    ASSERT_THAT(first.second, Eq(7));
+}
+
+
+TEST(FutureTest, BrokenPromiseTest) {
+
+    Future<int> future;
+    {
+        Promise<int> promise;
+        future = promise.get_future();
+    }
+
+    ASSERT_THAT(future.wait_for(10), Eq(true));
+    ASSERT_THAT(future.has_exception(), Eq(true));
+}
@@ -0,0 +1,68 @@
+#include <gmock/gmock.h>
+
+#include <thread>
+#include <vector>
+
+#include <other/Histogram.h>
+
+using namespace ::testing;
+using namespace roo;
+
+
+TEST(HistogramTest, PercentileTest) {
+
+    Histogram hist;
+    ASSERT_THAT(hist.count(), Eq(0));
+    ASSERT_THAT(hist.percentile(99), Eq(0));
+
+    for (uint64_t i = 1; i <= 10000; ++i)
+        hist.record(i);
+
+    ASSERT_THAT(hist.count(), Eq(10000));
+    ASSERT_THAT(hist.mean(), Eq(5000));
+    ASSERT_THAT(hist.max(), Eq(10000));
+
+    // 分桶的相对误差不超过1/16
+    const double kPercentiles[] = { 1, 50, 90, 99, 99.9 };
+    for (size_t i = 0; i < sizeof(kPercentiles) / sizeof(kPercentiles[0]); ++i) {
+        double expect = kPercentiles[i] * 100;
+        double actual = static_cast<double>(hist.percentile(kPercentiles[i]));
+        ASSERT_THAT(actual, Ge(expect));
+        ASSERT_THAT(actual, Le(expect * (1 + 1.0 / 16)));
+    }
+    ASSERT_THAT(hist.percentile(100), Eq(10000));
+
+    // 小值精确记录，超大值记入最后一个桶
+    Histogram small;
+    small.record(3);
+    small.record(7);
+    ASSERT_THAT(small.percentile(50), Eq(3));
+    ASSERT_THAT(small.percentile(100), Eq(7));
+
+    small.record(1ULL << 40);
+    ASSERT_THAT(small.max(), Eq(1ULL << 40));
+    ASSERT_THAT(small.percentile(100), Le(1ULL << 40));
+
+    small.reset();
+    ASSERT_THAT(small.count() + small.sum() + small.max(), Eq(0));
+    ASSERT_THAT(hist.to_json().find("\"p99\":"), Ne(std::string::npos));
+}
+
+
+TEST(HistogramTest, ConcurrentTest) {
+
+    Histogram hist;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&hist]() {
+            for (uint64_t i = 0; i < 100000; ++i)
+                hist.record(i % 1000);
+        });
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    ASSERT_THAT(hist.count(), Eq(800000));
+    ASSERT_THAT(hist.max(), Eq(999));
+    ASSERT_THAT(hist.sum(), Eq(8ULL * 100 * (999 * 1000 / 2)));
+}
@@ -0,0 +1,158 @@
+#include <gmock/gmock.h>
+
+#include <malloc.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <container/LruCache.h>
+#include <container/IntrusiveLruCache.h>
+
+using namespace ::testing;
+using namespace roo;
+
+// 统计堆内存的实际占用，用来对比两种节点布局
+static size_t g_heap_used = 0;
+
+void* operator new(size_t size) {
+    void* ptr = ::malloc(size);
+    if (!ptr)
+        throw std::bad_alloc();
+    g_heap_used += ::malloc_usable_size(ptr);
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr) {
+        g_heap_used -= ::malloc_usable_size(ptr);
+        ::free(ptr);
+    }
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    ::operator delete(ptr);
+}
+
+
+TEST(IntrusiveLruCacheTest, SmokeTest) {
+
+    IntrusiveLruCache<std::string, std::string> caches(10);
+
+    ASSERT_THAT(caches.insert("key1", "value1"), Eq(true));
+    ASSERT_THAT(caches.insert("key2", "value2"), Eq(true));
+    ASSERT_THAT(caches.insert("key1", "value3"), Eq(false));
+
+    std::string value;
+    ASSERT_THAT(caches.find("key2", value) && value == "value2", Eq(true));
+    ASSERT_THAT(caches.total_count(), Eq(2));
+
+    ASSERT_THAT(caches.find("key1"), Eq(true));
+    ASSERT_THAT(caches.find("key3"), Eq(false));
+
+    ASSERT_THAT(caches.insert_or_update("key1", "value3"), Eq(true));
+    ASSERT_THAT(caches.find("key1", value) && value == "value3", Eq(true));
+
+    ASSERT_THAT(caches.erase("key2"), Eq(true));
+    ASSERT_THAT(caches.erase("key2"), Eq(false));
+    ASSERT_THAT(caches.total_count(), Eq(1));
+
+    caches.clear();
+    ASSERT_THAT(caches.total_count(), Eq(0));
+}
+
+
+TEST(IntrusiveLruCacheTest, EvictTest) {
+
+    IntrusiveLruCache<int, int> caches(100);
+    for (int i = 0; i < 1000; ++i) {
+        caches.insert(i, i);
+    }
+    ASSERT_THAT(caches.total_count(), Eq(100));
+    ASSERT_THAT(caches.find(899), Eq(false));
+    ASSERT_THAT(caches.find(900), Eq(true));
+
+    // find之后变成MRU，不会被淘汰
+    int value;
+    ASSERT_THAT(caches.find(900, value), Eq(true));
+    caches.insert(1000, 1000);
+    ASSERT_THAT(caches.find(900), Eq(true));
+    ASSERT_THAT(caches.find(901), Eq(false));
+
+    std::vector<int> keys;
+    caches.snapshot_keys(keys);
+    ASSERT_THAT(keys.size(), Eq(100));
+    ASSERT_THAT(keys[0], Eq(1000));
+    ASSERT_THAT(keys[1], Eq(900));
+}
+
+
+// 1M个std::string的key(超过SSO长度)，对比LruCache的内存占用和延迟
+TEST(IntrusiveLruCacheTest, MemoryAndLatencyBenchmark) {
+
+    const size_t kItems = 1000000;
+
+    std::vector<std::string> keys;
+    keys.reserve(kItems);
+    char buf[64];
+    for (size_t i = 0; i < kItems; ++i) {
+        snprintf(buf, sizeof(buf), "roo_cache_bench_key_%08lu", i);
+        keys.push_back(buf);
+    }
+
+    auto elapse_ns = [](std::chrono::steady_clock::time_point start) -> double {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - start).count();
+    };
+
+    {
+        size_t base = g_heap_used;
+        LruCache<std::string, uint64_t> caches(kItems + 1);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kItems; ++i) {
+            caches.insert(keys[i], i);
+        }
+        double insert_ns = elapse_ns(start) / kItems;
+        size_t heap = g_heap_used - base;
+
+        uint64_t value = 0, sum = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kItems; ++i) {
+            caches.find(keys[(i * 7919) % kItems], value);
+            sum += value;
+        }
+        double find_ns = elapse_ns(start) / kItems;
+        ASSERT_THAT(caches.total_count(), Eq(kItems));
+
+        std::cout << "LruCache:          " << heap / kItems << " bytes/item, "
+                  << "insert " << insert_ns << " ns, find " << find_ns << " ns" << std::endl;
+    }
+
+    {
+        size_t base = g_heap_used;
+        IntrusiveLruCache<std::string, uint64_t> caches(kItems);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kItems; ++i) {
+            caches.insert(keys[i], i);
+        }
+        double insert_ns = elapse_ns(start) / kItems;
+        size_t heap = g_heap_used - base;
+
+        uint64_t value = 0, sum = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kItems; ++i) {
+            caches.find(keys[(i * 7919) % kItems], value);
+            sum += value;
+        }
+        double find_ns = elapse_ns(start) / kItems;
+        ASSERT_THAT(caches.total_count(), Eq(kItems));
+
+        std::cout << "IntrusiveLruCache: " << heap / kItems << " bytes/item, "
+                  << "insert " << insert_ns << " ns, find " << find_ns << " ns" << std::endl;
+    }
+}
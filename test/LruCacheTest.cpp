@@ -1,5 +1,6 @@
 #include <gmock/gmock.h>
 #include <string>
+#include <unistd.h>
 
 #include <container/LruCache.h>
 #include <container/LruCacheMem.h>
@@ -48,7 +49,78 @@ TEST(LruCacheTest, LruCacheMemTest) {
     ASSERT_THAT(caches.total_mem_used(), Eq(mem));
     std::cout << mem << std::endl;
 
+    // SSO的字符串不持有堆内存，长度变化不影响占用量
     ASSERT_THAT(caches.insert_or_update("key2", "value333"), Eq(true));
-    ASSERT_THAT(caches.total_mem_used(), Eq(mem + 2));
+    ASSERT_THAT(caches.total_mem_used(), Eq(mem));
+
+    ASSERT_THAT(caches.insert_or_update("key2", std::string(100, 'v')), Eq(true));
+    ASSERT_THAT(caches.total_mem_used(), Gt(mem + 100));
+
+    caches.clear();
+    ASSERT_THAT(caches.total_mem_used(), Eq(0));
+
+}
+
+
+TEST(LruCacheTest, LruCacheMemTTLTest) {
+
+    LruCacheMem<std::string, std::string> caches(100, 0, 30);
+
+    ASSERT_THAT(caches.insert("key1", "value1"), Eq(true));
+    ASSERT_THAT(caches.insert("key2", "value2", 0), Eq(true));
+    ASSERT_THAT(caches.insert("key3", "value3", 1000), Eq(true));
+    ASSERT_THAT(caches.find("key1"), Eq(true));
+
+    ::usleep(50 * 1000);
+
+    // 惰性删除
+    std::string value;
+    ASSERT_THAT(caches.find("key1"), Eq(false));
+    ASSERT_THAT(caches.find("key1", value), Eq(false));
+    ASSERT_THAT(caches.expired_count(), Eq(1));
+    ASSERT_THAT(caches.find("key2", value) && value == "value2", Eq(true));
+    ASSERT_THAT(caches.find("key3", value) && value == "value3", Eq(true));
+    ASSERT_THAT(caches.total_count(), Eq(2));
+
+    // 过期的元素可以被再次插入
+    ASSERT_THAT(caches.insert("key4", "value4", 10), Eq(true));
+    ::usleep(20 * 1000);
+    ASSERT_THAT(caches.insert("key4", "value5"), Eq(true));
+    ASSERT_THAT(caches.find("key4", value) && value == "value5", Eq(true));
+    ASSERT_THAT(caches.expired_count(), Eq(2));
+}
+
+
+TEST(LruCacheTest, LruCacheMemSweepTest) {
+
+    LruCacheMem<int, int> caches(10000);
+
+    for (int i = 0; i < 1000; ++i) {
+        caches.insert(i, i, (i % 2) ? 10 : 0);
+    }
+    ::usleep(20 * 1000);
+
+    // 每次最多检查100个元素，分批清理完成
+    size_t removed = 0;
+    for (int i = 0; i < 10; ++i) {
+        size_t count = caches.sweep_expired(100);
+        ASSERT_THAT(count, Le(100));
+        removed += count;
+    }
+
+    ASSERT_THAT(removed, Eq(500));
+    ASSERT_THAT(caches.total_count(), Eq(500));
+    ASSERT_THAT(caches.expired_count(), Eq(500));
+    ASSERT_THAT(caches.evicted_count(), Eq(0));
+
+    size_t mem = caches.total_mem_used();
+    ASSERT_THAT(caches.sweep_expired(), Eq(0));
+    ASSERT_THAT(caches.total_mem_used(), Eq(mem));
 
+    LruCacheMem<int, int> small(10);
+    for (int i = 0; i < 100; ++i) {
+        small.insert(i, i);
+    }
+    ASSERT_THAT(small.evicted_count(), Gt(0));
+    ASSERT_THAT(small.expired_count(), Eq(0));
 }
@@ -0,0 +1,86 @@
+#include <gmock/gmock.h>
+#include <string>
+
+#include <thread>
+#include <atomic>
+#include <iostream>
+
+#include <container/MpmcQueue.h>
+
+using namespace ::testing;
+using namespace roo;
+
+TEST(MpmcQueueTest, MpmcQueueSmokeTest) {
+
+    MpmcQueue<std::string> queue(3);
+    ASSERT_THAT(queue.CAPACITY(), Eq(4));
+
+    queue.PUSH("tao");
+    queue.PUSH("kan");
+
+    std::string val = queue.POP();
+
+    ASSERT_THAT(val, Eq("tao"));
+    ASSERT_THAT(queue.SIZE(), Eq(1));
+
+    ASSERT_THAT(queue.TRY_PUSH("a"), Eq(true));
+    ASSERT_THAT(queue.TRY_PUSH("b"), Eq(true));
+    ASSERT_THAT(queue.TRY_PUSH("c"), Eq(true));
+    ASSERT_THAT(queue.TRY_PUSH("d"), Eq(false));
+
+    std::vector<std::string> vec;
+    ASSERT_THAT(queue.POP(vec, 2, 10), Eq(2));
+    ASSERT_THAT(vec[0], Eq("kan"));
+    ASSERT_THAT(queue.TRY_POP(vec), Eq(2));
+    ASSERT_THAT(vec[1], Eq("c"));
+
+    ASSERT_THAT(queue.POP(val, 10), Eq(false));
+    ASSERT_THAT(queue.EMPTY(), Eq(true));
+}
+
+TEST(MpmcQueueTest, MpmcQueueConcurrentTest) {
+
+    const int kProducer = 4;
+    const int kConsumer = 4;
+    const int kPerProducer = 100000;
+
+    MpmcQueue<int64_t> queue(64);
+    std::atomic<int64_t> sum(0);
+    std::atomic<int64_t> count(0);
+
+    // 0作为结束标记，生产者都退出之后每个消费者一个，消费者不依赖超时退出
+    std::vector<std::thread> consumers;
+    for (int i = 0; i < kConsumer; ++i) {
+        consumers.emplace_back([&]() {
+            int64_t val = 0;
+            while ((val = queue.POP()) != 0) {
+                sum += val;
+                ++count;
+            }
+        });
+    }
+
+    std::vector<std::thread> producers;
+    for (int i = 0; i < kProducer; ++i) {
+        producers.emplace_back([&]() {
+            for (int j = 1; j <= kPerProducer; ++j) {
+                queue.PUSH(j);
+            }
+        });
+    }
+
+    for (size_t i = 0; i < producers.size(); ++i) {
+        producers[i].join();
+    }
+
+    for (int i = 0; i < kConsumer; ++i) {
+        queue.PUSH(0);
+    }
+
+    for (size_t i = 0; i < consumers.size(); ++i) {
+        consumers[i].join();
+    }
+
+    ASSERT_THAT(count.load(), Eq(kProducer * kPerProducer));
+    ASSERT_THAT(sum.load(), Eq(static_cast<int64_t>(kProducer) * kPerProducer * (kPerProducer + 1) / 2));
+}
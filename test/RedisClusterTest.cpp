@@ -0,0 +1,41 @@
+#include <gmock/gmock.h>
+#include <string>
+
+#include <connect/RedisCluster.h>
+
+using namespace ::testing;
+using namespace roo;
+
+
+// 需要本地运行redis cluster，节点为7000-7005
+TEST(RedisClusterTest, ClusterTest) {
+
+    RedisCluster cluster({ "127.0.0.1:7000", "127.0.0.1:7001" }, "");
+    ASSERT_THAT(cluster.init(), Eq(true));
+    ASSERT_THAT(cluster.node_count(), Ge(1));
+
+    std::string value;
+    ASSERT_THAT(cluster.Set("__cluster_key", "ttz", 10), Eq(true));
+    ASSERT_THAT(cluster.Get("__cluster_key", value), Eq(true));
+    ASSERT_THAT(value, Eq("ttz"));
+
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    for (size_t i = 0; i < 64; ++i) {
+        keys.push_back("__cluster_key_" + std::to_string(i));
+        values.push_back(std::to_string(i));
+    }
+
+    ASSERT_THAT(cluster.MSet(keys, values), Eq(true));
+
+    keys.push_back("__cluster_key_nil");
+    std::vector<std::string> results;
+    ASSERT_THAT(cluster.MGet(keys, results, "nil"), Eq(true));
+    ASSERT_THAT(results.size(), Eq(keys.size()));
+    for (size_t i = 0; i < values.size(); ++i)
+        ASSERT_THAT(results[i], Eq(values[i]));
+    ASSERT_THAT(results.back(), Eq("nil"));
+
+    keys.push_back("__cluster_key");
+    ASSERT_THAT(cluster.Del(keys), Eq(65));
+}
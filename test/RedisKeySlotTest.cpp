@@ -0,0 +1,27 @@
+#include <gmock/gmock.h>
+#include <string>
+
+#include <connect/RedisCluster.h>
+
+using namespace ::testing;
+using namespace roo;
+
+// 只计算slot，不需要redis cluster
+
+TEST(RedisKeySlotTest, KeySlotTest) {
+
+    // 和CLUSTER KEYSLOT的结果一致
+    ASSERT_THAT(RedisCluster::key_slot("123456789"), Eq(0x31C3));
+    ASSERT_THAT(RedisCluster::key_slot("foo"), Eq(12182));
+    ASSERT_THAT(RedisCluster::key_slot("bar"), Eq(5061));
+
+    // hashtag
+    ASSERT_THAT(RedisCluster::key_slot("{user1000}.following"),
+                Eq(RedisCluster::key_slot("{user1000}.followers")));
+    ASSERT_THAT(RedisCluster::key_slot("foo{bar}zap"), Eq(RedisCluster::key_slot("bar")));
+    ASSERT_THAT(RedisCluster::key_slot("foo{{bar}}zap"), Eq(RedisCluster::key_slot("{bar")));
+
+    // 空的hashtag使用整个key，CLUSTER KEYSLOT foo{}{bar}
+    ASSERT_THAT(RedisCluster::key_slot("foo{}{bar}"), Eq(8363));
+    ASSERT_THAT(RedisCluster::key_slot("foo{}{bar}"), Ne(RedisCluster::key_slot("bar")));
+}
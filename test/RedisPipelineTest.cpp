@@ -0,0 +1,110 @@
+#include <gmock/gmock.h>
+#include <string>
+
+#include <chrono>
+#include <iostream>
+
+#include <connect/RedisPipeline.h>
+
+using namespace ::testing;
+using namespace roo;
+
+// 需要本地运行redis-server
+class RedisPipelineSt : public ::testing::Test {
+
+protected:
+    void SetUp() {
+        ASSERT_THAT(redis_pool_.init(), Eq(true));
+    }
+
+    void TearDown() {
+    }
+
+public:
+
+    RedisPipelineSt() :
+        redis_pool_("RedisPool", 2,
+                    RedisConnPoolHelper("127.0.0.1", 6379, "")) {
+    }
+
+    virtual ~RedisPipelineSt() {
+    }
+
+    ConnPool<RedisConn, RedisConnPoolHelper> redis_pool_;
+};
+
+
+TEST_F(RedisPipelineSt, PipelineTest) {
+
+    redis_conn_ptr conn;
+    redis_pool_.request_scoped_conn(conn);
+    ASSERT_THAT(!!conn, Eq(true));
+
+    // chunk_size为2，强制分批发送
+    RedisPipeline pipeline(*conn, 2);
+    size_t set_idx  = pipeline.Set("__pipeline_key", "ttz", 10);
+    size_t get_idx  = pipeline.Get("__pipeline_key");
+    size_t incr_idx = pipeline.Incr("__pipeline_cnt");
+    size_t bad_idx  = pipeline.Incr("__pipeline_key");
+    size_t nil_idx  = pipeline.Get("__pipeline_key_nil");
+    size_t del_idx  = pipeline.Append({ "DEL", "__pipeline_key", "__pipeline_cnt" });
+
+    // 空命令被拒绝，不会进入流水线
+    ASSERT_THAT(pipeline.Append(std::vector<std::string>()), Eq(RedisPipeline::kInvalidIndex));
+    ASSERT_THAT(pipeline.size(), Eq(6));
+
+    ASSERT_THAT(pipeline.Exec(), Eq(true));
+    ASSERT_THAT(pipeline.reply_ok(set_idx), Eq(true));
+    ASSERT_THAT(pipeline.reply_string(get_idx).value_or(""), Eq("ttz"));
+    ASSERT_THAT(pipeline.reply_integer(incr_idx).value_or(0), Eq(1));
+
+    // 错误应答不影响后面的命令
+    ASSERT_THAT(!!pipeline.reply(bad_idx), Eq(false));
+    ASSERT_THAT(pipeline.error(bad_idx).empty(), Eq(false));
+    ASSERT_THAT(!!pipeline.reply_string(nil_idx), Eq(false));
+    ASSERT_THAT(pipeline.reply_integer(del_idx).value_or(0), Eq(2));
+    ASSERT_THAT(!!pipeline.reply(RedisPipeline::kInvalidIndex), Eq(false));
+
+    ASSERT_THAT(conn->is_health(), Eq(true));
+}
+
+
+TEST_F(RedisPipelineSt, BenchmarkTest) {
+
+    const int kCommands = 20000;
+
+    redis_conn_ptr conn;
+    redis_pool_.request_scoped_conn(conn);
+    ASSERT_THAT(!!conn, Eq(true));
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kCommands; ++i) {
+        conn->Set("__pipeline_bench_" + std::to_string(i), "value", 60);
+    }
+    auto single = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    RedisPipeline pipeline(*conn);
+    for (int i = 0; i < kCommands; ++i) {
+        pipeline.Set("__pipeline_bench_" + std::to_string(i), "value", 60);
+    }
+    ASSERT_THAT(pipeline.Exec(), Eq(true));
+    auto pipelined = std::chrono::steady_clock::now() - start;
+
+    for (int i = 0; i < kCommands; ++i) {
+        ASSERT_THAT(pipeline.reply_ok(i), Eq(true));
+    }
+
+    pipeline.clear();
+    for (int i = 0; i < kCommands; ++i) {
+        pipeline.Del("__pipeline_bench_" + std::to_string(i));
+    }
+    ASSERT_THAT(pipeline.Exec(), Eq(true));
+
+    typedef std::chrono::microseconds us;
+    std::cout << "per-command SET: "
+              << static_cast<uint64_t>(kCommands * 1e6 / std::chrono::duration_cast<us>(single).count())
+              << " ops/sec, pipelined SET: "
+              << static_cast<uint64_t>(kCommands * 1e6 / std::chrono::duration_cast<us>(pipelined).count())
+              << " ops/sec" << std::endl;
+}
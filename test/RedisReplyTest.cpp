@@ -0,0 +1,196 @@
+#include <gmock/gmock.h>
+#include <string>
+
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <new>
+
+#include <connect/RedisReply.h>
+
+using namespace ::testing;
+using namespace roo;
+
+// 统计堆分配的次数，malloc/free配对，不需要mismatched的检查
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<uint64_t> alloc_count(0);
+
+void* operator new(size_t size) {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = ::malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    ::free(ptr);
+}
+
+
+// 不依赖redis-server，手工构造应答
+static redisReply* make_string(const std::string& str) {
+    redisReply* reply = static_cast<redisReply*>(::calloc(1, sizeof(redisReply)));
+    reply->type = REDIS_REPLY_STRING;
+    reply->len = str.size();
+    reply->str = static_cast<char*>(::malloc(str.size() + 1));
+    ::memcpy(reply->str, str.c_str(), str.size() + 1);
+    return reply;
+}
+
+static redisReply* make_nil() {
+    redisReply* reply = static_cast<redisReply*>(::calloc(1, sizeof(redisReply)));
+    reply->type = REDIS_REPLY_NIL;
+    return reply;
+}
+
+static void free_reply(redisReply* reply) {
+    for (size_t i = 0; i < reply->elements; ++i)
+        free_reply(reply->element[i]);
+    ::free(reply->element);
+    ::free(reply->str);
+    ::free(reply);
+}
+
+static redisReply_ptr make_array(const std::vector<redisReply*>& elements) {
+    redisReply* reply = static_cast<redisReply*>(::calloc(1, sizeof(redisReply)));
+    reply->type = REDIS_REPLY_ARRAY;
+    reply->elements = elements.size();
+    reply->element = static_cast<redisReply**>(::calloc(elements.size(), sizeof(redisReply*)));
+    for (size_t i = 0; i < elements.size(); ++i)
+        reply->element[i] = elements[i];
+    return redisReply_ptr(reply, free_reply);
+}
+
+
+TEST(RedisReplyTest, StringViewTest) {
+
+    std::string str("12345");
+    RedisStringView view(str);
+    ASSERT_THAT(view.is_nil(), Eq(false));
+    ASSERT_THAT(view.size(), Eq(5));
+    ASSERT_THAT(view.to_string(), Eq(str));
+
+    int64_t value = 0;
+    ASSERT_THAT(view.to_int64(value), Eq(true));
+    ASSERT_THAT(value, Eq(12345));
+    ASSERT_THAT(RedisStringView("12a", 3).to_int64(value), Eq(false));
+    ASSERT_THAT(RedisStringView().to_int64(value), Eq(false));
+
+    ASSERT_THAT(RedisStringView("abc", 3) == RedisStringView("abc", 3), Eq(true));
+    ASSERT_THAT(RedisStringView("ab", 2) < RedisStringView("abc", 3), Eq(true));
+    ASSERT_THAT(RedisStringView().is_nil(), Eq(true));
+    ASSERT_THAT(RedisStringView("", 0).is_nil(), Eq(false));
+}
+
+TEST(RedisReplyTest, ArrayViewTest) {
+
+    RedisArrayView view;
+    ASSERT_THAT(view.empty(), Eq(true));
+    ASSERT_THAT(view.reset(redisReply_ptr()), Eq(false));
+
+    redisReply_ptr reply = make_array({ make_string("v1"), make_nil(), make_string("42") });
+    ASSERT_THAT(view.reset(reply), Eq(true));
+    reply.reset();
+
+    // view持有应答
+    ASSERT_THAT(view.size(), Eq(3));
+    ASSERT_THAT(view[0].to_string(), Eq("v1"));
+    ASSERT_THAT(view[1].is_nil(), Eq(true));
+    ASSERT_THAT(view.integer(1, -1), Eq(-1));
+    ASSERT_THAT(view.integer(2), Eq(42));
+}
+
+TEST(RedisReplyTest, HashViewTest) {
+
+    redisReply_ptr reply = make_array({ make_string("f2"), make_string("v2"),
+                                        make_string("f1"), make_string("v1"),
+                                        make_string("f3"), make_string("") });
+    RedisHashView view(reply);
+    ASSERT_THAT(view.size(), Eq(3));
+
+    // 按照field排序
+    ASSERT_THAT(view[0].first.to_string(), Eq("f1"));
+    ASSERT_THAT(view[2].first.to_string(), Eq("f3"));
+
+    ASSERT_THAT(view.find("f2").to_string(), Eq("v2"));
+    ASSERT_THAT(view.find("f3").is_nil(), Eq(false));
+    ASSERT_THAT(view.find("f3").empty(), Eq(true));
+    ASSERT_THAT(view.find("f4").is_nil(), Eq(true));
+
+    // 奇数个元素不是合法的HGETALL应答
+    ASSERT_THAT(view.reset(make_array({ make_string("f1") })), Eq(false));
+    ASSERT_THAT(view.empty(), Eq(true));
+}
+
+
+// 500个key的MGET和500个field的HGETALL，比较拷贝和view两种方式的分配次数
+TEST(RedisReplyTest, BenchmarkTest) {
+
+    const size_t kKeys = 500;
+    const int kRounds = 200;
+    const std::string kValue(40, 'v');   // 超过SSO的长度
+
+    std::vector<redisReply*> elements;
+    std::vector<redisReply*> pairs;
+    for (size_t i = 0; i < kKeys; ++i) {
+        elements.push_back(i % 10 ? make_string(kValue + std::to_string(i)) : make_nil());
+        pairs.push_back(make_string("field_with_long_name_" + std::to_string(i)));
+        pairs.push_back(make_string(kValue + std::to_string(i)));
+    }
+    redisReply_ptr array = make_array(elements);
+    redisReply_ptr hash = make_array(pairs);
+
+    typedef std::chrono::microseconds us;
+    size_t checksum = 0;
+
+    // 原来RedisConn::MGet/HGetAll的拷贝方式
+    uint64_t start_alloc = alloc_count.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kRounds; ++round) {
+        std::vector<std::string> values;
+        for (size_t i = 0; i < array->elements; ++i) {
+            const redisReply* elem = array->element[i];
+            if (elem->type == REDIS_REPLY_STRING && elem->str != NULL)
+                values.push_back(elem->str);
+            else
+                values.push_back("");
+        }
+
+        std::map<std::string, std::string> fields;
+        for (size_t i = 0; i < hash->elements; i += 2)
+            fields[hash->element[i]->str] = hash->element[i + 1]->str;
+
+        checksum += values.size() + fields.size();
+    }
+    auto copy_time = std::chrono::steady_clock::now() - start;
+    uint64_t copy_alloc = alloc_count.load() - start_alloc;
+
+    start_alloc = alloc_count.load();
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kRounds; ++round) {
+        RedisArrayView values(array);
+        for (size_t i = 0; i < values.size(); ++i)
+            checksum += values[i].size();
+
+        RedisHashView fields(hash);
+        checksum += fields.find("field_with_long_name_7").size();
+    }
+    auto view_time = std::chrono::steady_clock::now() - start;
+    uint64_t view_alloc = alloc_count.load() - start_alloc;
+
+    // view方式每轮只有RedisHashView的一次分配
+    ASSERT_THAT(view_alloc, Le(static_cast<uint64_t>(kRounds)));
+    ASSERT_THAT(view_alloc * 100, Lt(copy_alloc));
+    ASSERT_THAT(checksum, Gt(0));
+
+    std::cout << "copy: " << copy_alloc / kRounds << " allocs/call, "
+              << std::chrono::duration_cast<us>(copy_time).count() / kRounds << " us/call; "
+              << "view: " << view_alloc / kRounds << " allocs/call, "
+              << std::chrono::duration_cast<us>(view_time).count() / kRounds << " us/call"
+              << std::endl;
+}
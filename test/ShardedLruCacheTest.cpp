@@ -0,0 +1,124 @@
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <container/ShardedLruCache.h>
+
+using namespace ::testing;
+using namespace roo;
+
+
+TEST(ShardedLruCacheTest, SmokeTest) {
+
+    ShardedLruCache<std::string, std::string> caches(100, 0, 5);
+    ASSERT_THAT(caches.shard_num(), Eq(8));
+
+    ASSERT_THAT(caches.insert("key1", "value1"), Eq(true));
+    ASSERT_THAT(caches.insert("key2", "value2"), Eq(true));
+    ASSERT_THAT(caches.insert("key1", "value3"), Eq(false));
+    ASSERT_THAT(caches.total_count(), Eq(2));
+    ASSERT_THAT(caches.total_mem_used(), Gt(0));
+
+    std::string value;
+    ASSERT_THAT(caches.find("key2", value) && value == "value2", Eq(true));
+    ASSERT_THAT(caches.find("key3"), Eq(false));
+
+    ASSERT_THAT(caches.insert_or_update("key1", "value3"), Eq(true));
+    ASSERT_THAT(caches.find("key1", value) && value == "value3", Eq(true));
+
+    ASSERT_THAT(caches.erase("key1"), Eq(true));
+    ASSERT_THAT(caches.erase("key1"), Eq(false));
+    ASSERT_THAT(caches.total_count(), Eq(1));
+
+    std::vector<std::string> keys;
+    caches.snapshot_keys(keys);
+    ASSERT_THAT(keys.size(), Eq(1));
+
+    caches.clear();
+    ASSERT_THAT(caches.total_count(), Eq(0));
+    ASSERT_THAT(caches.total_mem_used(), Eq(0));
+}
+
+
+TEST(ShardedLruCacheTest, EvictTest) {
+
+    ShardedLruCache<int, int> caches(1000, 0, 4);
+    for (int i = 0; i < 10000; ++i) {
+        caches.insert(i, i);
+    }
+
+    // 每个分片独立淘汰，总量不超过容量
+    ASSERT_THAT(caches.total_count(), Le(1000));
+    ASSERT_THAT(caches.total_count(), Gt(900));
+    ASSERT_THAT(caches.find(9999), Eq(true));
+}
+
+
+// 90%读、10%写，对比一把全局锁保护的LruCacheMem
+TEST(ShardedLruCacheTest, ThroughputBenchmark) {
+
+    const int kKeys = 100000;
+    const int kOps  = 2000000;
+    const int kThreads[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+    auto run = [&](int thread_num, const std::function<void(int, bool)>& op) -> double {
+        std::atomic<bool> start(false);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_num; ++t) {
+            threads.emplace_back([&, t]() {
+                uint32_t seed = t * 2654435761U + 1;
+                while (!start.load()) { }
+                for (int i = 0; i < kOps / thread_num; ++i) {
+                    seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+                    op(seed % kKeys, seed % 10 == 0);
+                }
+            });
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        start = true;
+        for (size_t t = 0; t < threads.size(); ++t) {
+            threads[t].join();
+        }
+        auto elapse = std::chrono::steady_clock::now() - begin;
+        return kOps * 1e6 / std::chrono::duration_cast<std::chrono::microseconds>(elapse).count();
+    };
+
+    for (size_t k = 0; k < sizeof(kThreads) / sizeof(kThreads[0]); ++k) {
+
+        std::mutex lock;
+        LruCacheMem<int, int> global(kKeys * 2);
+        ShardedLruCache<int, int> sharded(kKeys * 2, 0, 64);
+        for (int i = 0; i < kKeys; ++i) {
+            global.insert(i, i);
+            sharded.insert(i, i);
+        }
+
+        double global_ops = run(kThreads[k], [&](int key, bool write) {
+            int value;
+            std::lock_guard<std::mutex> guard(lock);
+            if (write)
+                global.insert_or_update(key, key);
+            else
+                global.find(key, value);
+        });
+
+        double sharded_ops = run(kThreads[k], [&](int key, bool write) {
+            int value;
+            if (write)
+                sharded.insert_or_update(key, key);
+            else
+                sharded.find(key, value);
+        });
+
+        std::cout << kThreads[k] << " threads: "
+                  << "global lock " << static_cast<uint64_t>(global_ops) << " ops/sec, "
+                  << "sharded " << static_cast<uint64_t>(sharded_ops) << " ops/sec" << std::endl;
+    }
+}
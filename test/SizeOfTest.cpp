@@ -0,0 +1,173 @@
+#include <gmock/gmock.h>
+
+#include <malloc.h>
+#include <stdio.h>
+
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <container/SizeOf.h>
+#include <container/LruCacheMem.h>
+
+using namespace ::testing;
+using namespace roo;
+
+// 按照malloc_usable_size统计实际的堆内存占用
+static size_t g_heap_used = 0;
+
+void* operator new(size_t size) {
+    void* ptr = ::malloc(size);
+    if (!ptr)
+        throw std::bad_alloc();
+    g_heap_used += ::malloc_usable_size(ptr);
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr) {
+        g_heap_used -= ::malloc_usable_size(ptr);
+        ::free(ptr);
+    }
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    ::operator delete(ptr);
+}
+
+
+// 空闲块剩余的部分太小不足以切分的时候，malloc会返回稍大的块，
+// 所以计算值不会超过实际值，并且误差在1%以内
+static void expect_near(size_t calc, size_t actual) {
+    EXPECT_THAT(calc, Le(actual));
+    EXPECT_THAT(actual - calc, Le(actual / 100));
+}
+
+// 拷贝构造一个对象，比较实际申请的堆内存和HeapSizeOf的计算结果
+template<typename T>
+static void expect_heap_size(const T& src) {
+    size_t base = g_heap_used;
+    T copy(src);
+    expect_near(HeapSizeOf<T>()(copy), g_heap_used - base);
+}
+
+static std::string long_string(size_t i) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "size_of_test_long_string_%08lu", i);
+    return buf;
+}
+
+
+TEST(SizeOfTest, MallocUsableTest) {
+
+    for (size_t size = 1; size < 4096; ++size) {
+        void* ptr = ::malloc(size);
+        ASSERT_THAT(malloc_usable(size), Eq(::malloc_usable_size(ptr)));
+        ::free(ptr);
+    }
+}
+
+
+TEST(SizeOfTest, StringTest) {
+
+    std::string sso("short");
+    ASSERT_THAT(HeapSizeOf<std::string>()(sso), Eq(0));
+    expect_heap_size(sso);
+
+    std::string heap(long_string(1));
+    ASSERT_THAT(HeapSizeOf<std::string>()(heap), Gt(heap.size()));
+    expect_heap_size(heap);
+
+    // 扩容之后按照capacity而不是size计算
+    std::string reserved;
+    reserved.reserve(1000);
+    reserved = "abc";
+    ASSERT_THAT(HeapSizeOf<std::string>()(reserved), Ge(1000));
+    ASSERT_THAT(SizeOf<std::string>()(reserved), Ge(1000 + sizeof(std::string)));
+}
+
+
+TEST(SizeOfTest, NestedContainerTest) {
+
+    std::vector<std::string> vec;
+    for (size_t i = 0; i < 100; ++i) {
+        vec.push_back(i % 2 ? long_string(i) : "sso");
+    }
+    expect_heap_size(vec);
+
+    std::list<std::vector<int> > lst;
+    for (int i = 0; i < 50; ++i) {
+        lst.push_back(std::vector<int>(i, i));
+    }
+    expect_heap_size(lst);
+
+    std::map<std::string, std::vector<std::string> > tree;
+    std::set<int> set;
+    for (size_t i = 0; i < 100; ++i) {
+        tree[long_string(i)] = std::vector<std::string>(i % 5, long_string(i));
+        set.insert(i);
+    }
+    expect_heap_size(tree);
+    expect_heap_size(set);
+
+    std::unordered_map<std::string, std::string> hash;
+    std::unordered_map<int, std::vector<int> > int_hash;
+    std::unordered_set<std::string> hash_set;
+    for (size_t i = 0; i < 1000; ++i) {
+        hash[long_string(i)] = long_string(i * 2);
+        int_hash[i] = std::vector<int>(i % 7, 1);
+        hash_set.insert(long_string(i));
+    }
+    expect_heap_size(hash);
+    expect_heap_size(int_hash);
+    expect_heap_size(hash_set);
+}
+
+
+// 整个缓存的占用量和分配器统计的结果一致，包括淘汰和删除之后
+TEST(SizeOfTest, LruCacheMemAccountingTest) {
+
+    std::vector<std::string> keys;
+    std::vector<std::vector<std::string> > values;
+    for (size_t i = 0; i < 20000; ++i) {
+        keys.push_back(long_string(i));
+        values.push_back(std::vector<std::string>(i % 4, long_string(i)));
+    }
+
+    typedef std::vector<std::string> Value;
+    size_t base = g_heap_used;
+    {
+        LruCacheMem<std::string, Value, AllocSizeOf<Value>, AllocSizeOf<std::string> > caches(10000);
+
+        for (size_t i = 0; i < keys.size(); ++i) {
+            caches.insert(keys[i], values[i]);
+        }
+        ASSERT_THAT(caches.evicted_count(), Gt(0));
+        expect_near(caches.total_mem_used(), g_heap_used - base);
+
+        for (size_t i = 0; i < keys.size(); i += 3) {
+            caches.insert_or_update(keys[i], values[(i + 1) % values.size()]);
+            caches.erase(keys[i + 1]);
+        }
+        expect_near(caches.total_mem_used(), g_heap_used - base);
+
+        caches.clear();
+        ASSERT_THAT(caches.total_mem_used(), Eq(0));
+        ASSERT_THAT(g_heap_used - base, Eq(0));
+    }
+
+    // 内存上限按照实际占用生效
+    {
+        const size_t kMaxMemory = 1024 * 1024;
+        LruCacheMem<std::string, Value, AllocSizeOf<Value>, AllocSizeOf<std::string> > caches(100000, kMaxMemory);
+
+        for (size_t i = 0; i < keys.size(); ++i) {
+            caches.insert(keys[i], values[i]);
+            ASSERT_THAT(caches.total_mem_used(), Lt(kMaxMemory));
+            ASSERT_THAT(g_heap_used - base, Le(kMaxMemory + kMaxMemory / 100));
+        }
+        expect_near(caches.total_mem_used(), g_heap_used - base);
+        std::cout << "items within 1MB: " << caches.total_count() << std::endl;
+    }
+}
@@ -0,0 +1,165 @@
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <concurrency/Timer.h>
+
+using namespace ::testing;
+using namespace roo;
+
+
+static bool wait_count(std::atomic<int>& count, int expect, int msec) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(msec);
+    while (count.load() < expect) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+
+TEST(TimingWheelTest, FireAndCancelTest) {
+
+    Timer timer;
+    ASSERT_THAT(timer.init(), Eq(true));
+
+    std::atomic<int> fired(0);
+    std::atomic<int> cancelled(0);
+
+    // 跨越第一层的定时器需要经过cascade
+    WheelTimer short_timer([&](const boost::system::error_code& ec) { ++fired; });
+    WheelTimer long_timer([&](const boost::system::error_code& ec) { ++fired; });
+    WheelTimer cancel_timer([&](const boost::system::error_code& ec) { ++cancelled; });
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_THAT(timer.add_wheel_timer(short_timer, 10), Eq(true));
+    ASSERT_THAT(timer.add_wheel_timer(long_timer, 300), Eq(true));
+    ASSERT_THAT(timer.add_wheel_timer(cancel_timer, 50), Eq(true));
+    ASSERT_THAT(timer.get_timing_wheel().size(), Eq(3));
+
+    ASSERT_THAT(timer.cancel_wheel_timer(cancel_timer), Eq(true));
+    ASSERT_THAT(timer.cancel_wheel_timer(cancel_timer), Eq(false));
+
+    ASSERT_THAT(wait_count(fired, 1, 1000), Eq(true));
+    ASSERT_THAT(wait_count(fired, 2, 1000), Eq(true));
+    auto elapse = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start).count();
+    ASSERT_THAT(elapse, Ge(300));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_THAT(cancelled.load(), Eq(0));
+    ASSERT_THAT(short_timer.pending(), Eq(false));
+    ASSERT_THAT(timer.get_timing_wheel().size(), Eq(0));
+}
+
+
+TEST(TimingWheelTest, ForeverAndRescheduleTest) {
+
+    Timer timer;
+    ASSERT_THAT(timer.init(), Eq(true));
+
+    std::atomic<int> ticks(0);
+    WheelTimer periodic([&](const boost::system::error_code& ec) { ++ticks; });
+    ASSERT_THAT(timer.add_wheel_timer(periodic, 5, true), Eq(true));
+    ASSERT_THAT(wait_count(ticks, 5, 1000), Eq(true));
+    ASSERT_THAT(timer.cancel_wheel_timer(periodic), Eq(true));
+
+    // 重新调度会覆盖之前的到期时间
+    std::atomic<int> fired(0);
+    WheelTimer once([&](const boost::system::error_code& ec) { ++fired; });
+    ASSERT_THAT(timer.add_wheel_timer(once, 20), Eq(true));
+    ASSERT_THAT(timer.add_wheel_timer(once, 500), Eq(true));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_THAT(fired.load(), Eq(0));
+    ASSERT_THAT(timer.add_wheel_timer(once, 1), Eq(true));
+    ASSERT_THAT(wait_count(fired, 1, 1000), Eq(true));
+
+    // 回调中再次调度自身
+    std::atomic<int> rearm(0);
+    WheelTimer* self = NULL;
+    WheelTimer chained([&](const boost::system::error_code& ec) {
+        if (++rearm < 3)
+            timer.add_wheel_timer(*self, 2);
+    });
+    self = &chained;
+    ASSERT_THAT(timer.add_wheel_timer(chained, 2), Eq(true));
+    ASSERT_THAT(wait_count(rearm, 3, 1000), Eq(true));
+}
+
+
+// 对比add_better_timer，统计大量存活定时器时的插入和取消开销
+TEST(TimingWheelTest, LiveTimersBenchmark) {
+
+    const size_t kLive[] = { 10000, 100000, 1000000 };
+    auto noop = [](const boost::system::error_code& ec) {};
+
+    for (size_t k = 0; k < sizeof(kLive) / sizeof(kLive[0]); ++k) {
+
+        const size_t n = kLive[k];
+        uint64_t seed = 88172645463325252ULL;
+        std::vector<uint64_t> timeouts(n);
+        for (size_t i = 0; i < n; ++i) {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            timeouts[i] = 60 * 1000 + seed % (600 * 1000);
+        }
+
+        double wheel_add_ns = 0, wheel_cancel_ns = 0;
+        double asio_add_ns = 0, asio_cancel_ns = 0;
+
+        {
+            Timer timer;
+            timer.init();
+
+            // 句柄由调用者预先持有，调度和取消的过程中不再分配内存
+            std::vector<std::unique_ptr<WheelTimer>> handles;
+            handles.reserve(n);
+            for (size_t i = 0; i < n; ++i) {
+                handles.emplace_back(new WheelTimer(noop));
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < n; ++i) {
+                timer.add_wheel_timer(*handles[i], timeouts[i]);
+            }
+            auto middle = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < n; ++i) {
+                timer.cancel_wheel_timer(*handles[i]);
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            ASSERT_THAT(timer.get_timing_wheel().size(), Eq(0));
+            wheel_add_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(middle - start).count() / (double)n;
+            wheel_cancel_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - middle).count() / (double)n;
+        }
+
+        {
+            Timer timer;
+            timer.init();
+
+            std::vector<std::shared_ptr<TimerObject>> objects;
+            objects.reserve(n);
+
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < n; ++i) {
+                objects.push_back(timer.add_better_timer(noop, timeouts[i], false));
+            }
+            auto middle = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < n; ++i) {
+                objects[i]->revoke_timer();
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            asio_add_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(middle - start).count() / (double)n;
+            asio_cancel_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - middle).count() / (double)n;
+        }
+
+        std::cout << "live " << n << " timers:" << std::endl;
+        std::cout << "  TimingWheel      add " << wheel_add_ns << " ns/op, cancel " << wheel_cancel_ns << " ns/op" << std::endl;
+        std::cout << "  add_better_timer add " << asio_add_ns << " ns/op, cancel " << asio_cancel_ns << " ns/op" << std::endl;
+    }
+}
@@ -0,0 +1,224 @@
+#include <gmock/gmock.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <container/LruCache.h>
+#include <container/TinyLfuCache.h>
+
+using namespace ::testing;
+using namespace roo;
+
+
+TEST(TinyLfuCacheTest, SmokeTest) {
+
+    TinyLfuCache<std::string, std::string> caches(10);
+
+    ASSERT_THAT(caches.insert("key1", "value1"), Eq(true));
+    ASSERT_THAT(caches.insert("key2", "value2"), Eq(true));
+    ASSERT_THAT(caches.insert("key1", "value3"), Eq(false));
+
+    std::string value;
+    ASSERT_THAT(caches.find("key2", value) && value == "value2", Eq(true));
+    ASSERT_THAT(caches.total_count(), Eq(2));
+
+    ASSERT_THAT(caches.find("key1"), Eq(true));
+    ASSERT_THAT(caches.find("key3"), Eq(false));
+
+    ASSERT_THAT(caches.insert_or_update("key1", "value3"), Eq(true));
+    ASSERT_THAT(caches.find("key1", value) && value == "value3", Eq(true));
+
+    ASSERT_THAT(caches.erase("key1"), Eq(true));
+    ASSERT_THAT(caches.erase("key1"), Eq(false));
+
+    std::vector<std::string> keys;
+    caches.snapshot_keys(keys);
+    ASSERT_THAT(keys.size(), Eq(1));
+
+    caches.clear();
+    ASSERT_THAT(caches.total_count(), Eq(0));
+}
+
+
+TEST(TinyLfuCacheTest, CapacityTest) {
+
+    TinyLfuCache<int, int> caches(100);
+    for (int i = 0; i < 10000; ++i) {
+        caches.insert(i, i);
+        ASSERT_THAT(caches.total_count(), Le(100));
+    }
+
+    std::vector<int> keys;
+    caches.snapshot_keys(keys);
+    ASSERT_THAT(keys.size(), Eq(caches.total_count()));
+}
+
+
+TEST(TinyLfuCacheTest, MemoryLimitTest) {
+
+    const size_t kMaxMemory = 64 * 1024;
+    TinyLfuCache<std::string, std::string> caches(100000, kMaxMemory);
+
+    ASSERT_THAT(caches.total_mem_used(), Eq(0));
+
+    for (int i = 0; i < 10000; ++i) {
+        caches.insert("key" + std::to_string(i), std::string(200, 'v'));
+        ASSERT_THAT(caches.total_mem_used(), Le(kMaxMemory));
+    }
+
+    ASSERT_THAT(caches.total_count(), Lt(10000));
+    ASSERT_THAT(caches.evicted_count(), Eq(10000 - caches.total_count()));
+
+    // 变大的value同样会触发淘汰
+    std::vector<std::string> keys;
+    caches.snapshot_keys(keys);
+    size_t count = caches.total_count();
+    ASSERT_THAT(caches.insert_or_update(keys[0], std::string(8 * 1024, 'v')), Eq(true));
+    ASSERT_THAT(caches.total_mem_used(), Le(kMaxMemory));
+    ASSERT_THAT(caches.total_count(), Lt(count));
+
+    caches.clear();
+    ASSERT_THAT(caches.total_mem_used(), Eq(0));
+}
+
+TEST(TinyLfuCacheTest, MemoryAccountingTest) {
+
+    TinyLfuCache<std::string, std::string> caches(10);
+
+    ASSERT_THAT(caches.insert("key1", "value1"), Eq(true));
+    size_t mem = caches.total_mem_used();
+    ASSERT_THAT(mem, Gt(0));
+
+    ASSERT_THAT(caches.insert_or_update("key1", std::string(100, 'v')), Eq(true));
+    ASSERT_THAT(caches.total_mem_used(), Gt(mem + 100));
+
+    // 删除之后重新插入，占用量和之前一致
+    ASSERT_THAT(caches.erase("key1"), Eq(true));
+    ASSERT_THAT(caches.total_mem_used(), Lt(mem));
+    ASSERT_THAT(caches.insert("key1", "value1"), Eq(true));
+    ASSERT_THAT(caches.total_mem_used(), Eq(mem));
+}
+
+
+// 每个value按照固定的1K计算
+struct FixedValueSize {
+    size_t operator()(const int&) const {
+        return 1024;
+    }
+};
+
+TEST(TinyLfuCacheTest, CustomValueSizeTest) {
+
+    // 模板参数和LruCacheMem一样，第三个是ValueSize
+    TinyLfuCache<int, int, FixedValueSize> caches(1000, 8 * 1024);
+
+    for (int i = 0; i < 100; ++i) {
+        caches.insert(i, i);
+        ASSERT_THAT(caches.total_mem_used(), Le(8 * 1024));
+    }
+
+    ASSERT_THAT(caches.total_count(), Lt(8));
+    ASSERT_THAT(caches.total_mem_used(), Ge(caches.total_count() * 1024));
+}
+
+// 热点数据的访问中夹杂着大范围的顺序扫描，只统计热点数据的命中率
+template<typename Cache>
+static double scan_trace_hit_rate(Cache& caches) {
+
+    const int kHotKeys = 500;
+    const int kAccesses = 200000;
+
+    uint64_t hits = 0;
+    uint32_t seed = 2463534242U;
+    int scan_key = 1000000;
+
+    for (int i = 0; i < kAccesses; ++i) {
+
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        int key = seed % kHotKeys;
+
+        int value;
+        if (caches.find(key, value)) {
+            ++hits;
+        } else {
+            caches.insert(key, key);
+        }
+
+        // 每次热点访问伴随两个只访问一次的扫描key
+        for (int j = 0; j < 2; ++j, ++scan_key) {
+            if (!caches.find(scan_key, value))
+                caches.insert(scan_key, scan_key);
+        }
+    }
+
+    return hits * 100.0 / kAccesses;
+}
+
+TEST(TinyLfuCacheTest, ScanResistanceTest) {
+
+    LruCache<int, int> lru(1000);
+    TinyLfuCache<int, int> tinylfu(1000);
+
+    double lru_hit = scan_trace_hit_rate(lru);
+    double tinylfu_hit = scan_trace_hit_rate(tinylfu);
+
+    std::cout << "hot-set hit rate with scans: "
+              << "LruCache " << lru_hit << "%, "
+              << "TinyLfuCache " << tinylfu_hit << "%" << std::endl;
+
+    ASSERT_THAT(tinylfu_hit, Gt(lru_hit));
+    ASSERT_THAT(tinylfu_hit, Gt(90.0));
+}
+
+
+// 回放线上记录的访问序列，每行一个key，没有设置ROO_CACHE_TRACE的时候不执行
+// ROO_CACHE_TRACE_SIZE指定缓存的元素个数，默认10000
+template<typename Cache>
+static double replay_trace_hit_rate(Cache& caches, const std::vector<std::string>& trace) {
+
+    uint64_t hits = 0;
+    for (size_t i = 0; i < trace.size(); ++i) {
+        int value;
+        if (caches.find(trace[i], value)) {
+            ++hits;
+        } else {
+            caches.insert(trace[i], 0);
+        }
+    }
+
+    return trace.empty() ? 0 : hits * 100.0 / trace.size();
+}
+
+TEST(TinyLfuCacheTest, TraceReplayTest) {
+
+    const char* path = ::getenv("ROO_CACHE_TRACE");
+    if (!path)
+        return;
+
+    std::ifstream ifs(path);
+    ASSERT_THAT(ifs.is_open(), Eq(true));
+
+    std::vector<std::string> trace;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (!line.empty())
+            trace.push_back(line);
+    }
+
+    size_t size = 10000;
+    if (const char* env = ::getenv("ROO_CACHE_TRACE_SIZE"))
+        size = ::atol(env);
+
+    LruCache<std::string, int> lru(size);
+    TinyLfuCache<std::string, int> tinylfu(size);
+
+    double lru_hit = replay_trace_hit_rate(lru, trace);
+    double tinylfu_hit = replay_trace_hit_rate(tinylfu, trace);
+
+    std::cout << "trace " << path << " (" << trace.size() << " accesses, size " << size << "): "
+              << "LruCache " << lru_hit << "%, "
+              << "TinyLfuCache " << tinylfu_hit << "%" << std::endl;
+}
@@ -0,0 +1,81 @@
+#include <gmock/gmock.h>
+#include <string>
+
+#include <atomic>
+#include <chrono>
+
+#include <concurrency/DeferTask.h>
+#include <concurrency/WorkStealingPool.h>
+
+using namespace ::testing;
+using namespace roo;
+
+
+TEST(WorkStealingPoolTest, ExternalAndLocalSubmitTest) {
+
+    const int kExternal = 1000;
+    const int kNested = 10;
+
+    WorkStealingPool<> pool(4);
+    std::atomic<int> count(0);
+
+    for (int i = 0; i < kExternal; ++i) {
+        pool.add_task([&]() -> int {
+            for (int j = 0; j < kNested; ++j) {
+                pool.add_task([&]() -> int { ++count; return 0; });
+            }
+            ++count;
+            return 0;
+        });
+    }
+
+    const int kTotal = kExternal * (kNested + 1);
+    for (int i = 0; i < 500 && count.load() < kTotal; ++i) {
+        ::usleep(10 * 1000);
+    }
+    ASSERT_THAT(count.load(), Eq(kTotal));
+
+    // 任务返回之后工作线程才会更新executed_，等线程都退出之后再统计
+    pool.terminate();
+
+    uint64_t executed = 0;
+    for (size_t i = 0; i < pool.thread_num(); ++i) {
+        executed += pool.worker_stat(i).executed_;
+    }
+    ASSERT_THAT(executed, Eq(static_cast<uint64_t>(kTotal)));
+
+    std::string module, name, val;
+    pool.module_status(module, name, val);
+    ASSERT_THAT(val, HasSubstr("thread_num: 4"));
+    ASSERT_THAT(val, HasSubstr("injection_pending: 0"));
+}
+
+
+TEST(WorkStealingPoolTest, PromptTerminateTest) {
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        DeferTask defer(4);
+        ::usleep(50 * 1000);
+        defer.terminate();
+    }
+    auto elapse = std::chrono::steady_clock::now() - start;
+
+    ASSERT_THAT(std::chrono::duration_cast<std::chrono::milliseconds>(elapse).count(), Lt(1000));
+}
+
+
+TEST(WorkStealingPoolTest, DeferTaskWithMpmcQueueTest) {
+
+    std::atomic<int> count(0);
+    BasicDeferTask<MpmcQueue<TaskRunnable>> defer(2);
+
+    for (int i = 0; i < 100; ++i) {
+        defer.add_defer_task([&]() -> int { ++count; return 0; });
+    }
+
+    for (int i = 0; i < 500 && count.load() < 100; ++i) {
+        ::usleep(10 * 1000);
+    }
+    ASSERT_THAT(count.load(), Eq(100));
+}